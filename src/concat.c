@@ -0,0 +1,243 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64 // Same off_t as in playlistfs.h
+
+#include "concat.h"
+#include "stats.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+struct pfs_concat {
+	GPtrArray* paths; // Paths of files, in strings
+	GArray* offsets; // off_t, offset of each file's start, plus the total size at the end
+	GArray* starts; // off_t, offset in each original file where its part starts
+	GStringChunk* strings;
+};
+
+// Streaming through thousands of files would run out of descriptors if all were kept open,
+// so each reader keeps only a few, closing the least recently read ones.
+#define PFS_CONCAT_OPEN_FILES 4
+
+typedef struct {
+	guint file; // Index of the file, G_MAXUINT if the slot is empty
+	int fd;
+	guint users; // Reads using the descriptor, it is not closed while there are any
+	guint64 used; // Value of the reader's clock when last used
+} pfs_concat_slot;
+
+struct pfs_concat_reader {
+	const pfs_concat* concat;
+	GMutex lock; // Protects fields below
+	guint64 clock;
+	pfs_concat_slot slots[PFS_CONCAT_OPEN_FILES];
+};
+
+pfs_concat* pfs_concat_new (void) {
+	pfs_concat* concat = g_malloc (sizeof (*concat));
+	concat->paths = g_ptr_array_new ();
+	concat->offsets = g_array_new (FALSE, FALSE, sizeof (off_t));
+	concat->starts = g_array_new (FALSE, FALSE, sizeof (off_t));
+	concat->strings = g_string_chunk_new (64 * 1024);
+	off_t start = 0;
+	g_array_append_val (concat->offsets, start);
+	return concat;
+}
+
+void pfs_concat_append (pfs_concat* concat, const char* path, off_t start, off_t size) {
+	g_ptr_array_add (concat->paths, g_string_chunk_insert (concat->strings, path));
+	g_array_append_val (concat->starts, start);
+	off_t end = pfs_concat_size (concat) + size;
+	g_array_append_val (concat->offsets, end);
+}
+
+off_t pfs_concat_size (const pfs_concat* concat) {
+	return g_array_index (concat->offsets, off_t, concat->offsets->len - 1);
+}
+
+guint pfs_concat_count (const pfs_concat* concat) {
+	return concat->paths->len;
+}
+
+pfs_concat_reader* pfs_concat_open (const pfs_concat* concat) {
+	pfs_concat_reader* reader = g_malloc0 (sizeof (*reader));
+	reader->concat = concat;
+	g_mutex_init (&reader->lock);
+	for (guint islot = 0; islot < PFS_CONCAT_OPEN_FILES; islot++) {
+		reader->slots[islot].file = G_MAXUINT;
+		reader->slots[islot].fd = -1;
+	}
+	return reader;
+}
+
+off_t pfs_concat_reader_size (const pfs_concat_reader* reader) {
+	return pfs_concat_size (reader->concat);
+}
+
+// Find the last file starting at or before offset, which skips empty files.
+static guint pfs_concat_find (const pfs_concat* concat, off_t offset) {
+	const off_t* offsets = (const off_t*) concat->offsets->data;
+	guint low = 0;
+	guint high = concat->paths->len;
+	while (high - low > 1) {
+		guint middle = low + (high - low) / 2;
+		if (offsets[middle] <= offset)
+			low = middle;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+// Must be called with the lock held.
+static pfs_concat_slot* pfs_concat_find_slot (pfs_concat_reader* reader, guint ifile) {
+	for (guint islot = 0; islot < PFS_CONCAT_OPEN_FILES; islot++) {
+		if (reader->slots[islot].file == ifile)
+			return &reader->slots[islot];
+	}
+	return NULL;
+}
+
+/*
+Get a descriptor of a file, opening it if needed, and put it into *slot.
+If all slots are in use by other reads, the descriptor is not kept, and *slot is NULL.
+Returns the descriptor or -errno, which is passed to pfs_concat_put_fd() after reading.
+*/
+static int pfs_concat_get_fd (pfs_concat_reader* reader, guint ifile, pfs_concat_slot** slot) {
+	g_mutex_lock (&reader->lock);
+	*slot = pfs_concat_find_slot (reader, ifile);
+	if (*slot != NULL) {
+		(*slot)->users++;
+		(*slot)->used = ++reader->clock;
+		int fd = (*slot)->fd;
+		g_mutex_unlock (&reader->lock);
+		return fd;
+	}
+	g_mutex_unlock (&reader->lock);
+
+	// Opening may be slow, other reads should not wait for it.
+	int fd = open (g_ptr_array_index (reader->concat->paths, ifile), O_RDONLY | O_CLOEXEC);
+	pfs_stats_count (PFS_COUNTER_SYSCALLS, 1);
+	if (fd < 0)
+		return -errno;
+
+	g_mutex_lock (&reader->lock);
+	*slot = pfs_concat_find_slot (reader, ifile);
+	if (*slot != NULL) {
+		// Another thread has opened the same file in the meantime.
+		close (fd);
+		fd = (*slot)->fd;
+	}
+	else {
+		for (guint islot = 0; islot < PFS_CONCAT_OPEN_FILES; islot++) {
+			pfs_concat_slot* candidate = &reader->slots[islot];
+			// Empty slots were never used, so they are taken first.
+			if (candidate->users == 0 && (*slot == NULL || candidate->used < (*slot)->used))
+				*slot = candidate;
+		}
+		if (*slot != NULL) {
+			if ((*slot)->fd >= 0)
+				close ((*slot)->fd);
+			(*slot)->file = ifile;
+			(*slot)->fd = fd;
+		}
+	}
+	if (*slot != NULL) {
+		(*slot)->users++;
+		(*slot)->used = ++reader->clock;
+	}
+	g_mutex_unlock (&reader->lock);
+	return fd;
+}
+
+static void pfs_concat_put_fd (pfs_concat_reader* reader, int fd, pfs_concat_slot* slot) {
+	if (slot == NULL) {
+		close (fd);
+		return;
+	}
+	g_mutex_lock (&reader->lock);
+	slot->users--;
+	g_mutex_unlock (&reader->lock);
+}
+
+ssize_t pfs_concat_read (pfs_concat_reader* reader, char* buf, size_t size, off_t offset) {
+	const pfs_concat* concat = reader->concat;
+	const off_t* offsets = (const off_t*) concat->offsets->data;
+	const off_t* starts = (const off_t*) concat->starts->data;
+	off_t total = pfs_concat_size (concat);
+	if (offset >= total || size == 0)
+		return 0;
+	if ((off_t) size > total - offset)
+		size = total - offset;
+
+	size_t done = 0;
+	for (guint ifile = pfs_concat_find (concat, offset); done < size; ifile++) {
+		off_t start = offsets[ifile];
+		off_t end = offsets[ifile + 1];
+		size_t want = MIN ((off_t) (size - done), end - (offset + (off_t) done));
+		if (want == 0)
+			continue;
+		pfs_concat_slot* slot;
+		int fd = pfs_concat_get_fd (reader, ifile, &slot);
+		if (fd < 0)
+			return done > 0 ? (ssize_t) done : fd;
+		// Reads may be short without reaching the end, on network filesystems for example.
+		size_t got = 0;
+		while (got < want) {
+			ssize_t result = pread (fd, buf + done + got, want - got, starts[ifile] + offset + done + got - start);
+			if (result < 0 && errno == EINTR)
+				continue;
+			if (result < 0) {
+				int error = errno;
+				pfs_concat_put_fd (reader, fd, slot);
+				return done + got > 0 ? (ssize_t) (done + got) : -error;
+			}
+			if (result == 0)
+				break;
+			got += result;
+		}
+		pfs_concat_put_fd (reader, fd, slot);
+		if (got < want) {
+			// The file has shrunk, but offsets of later files must stay the same.
+			memset (buf + done + got, 0, want - got);
+		}
+		done += want;
+	}
+	return done;
+}
+
+void pfs_concat_close (pfs_concat_reader* reader) {
+	for (guint islot = 0; islot < PFS_CONCAT_OPEN_FILES; islot++) {
+		if (reader->slots[islot].fd >= 0)
+			close (reader->slots[islot].fd);
+	}
+	g_mutex_clear (&reader->lock);
+	g_free (reader);
+}
+
+void pfs_concat_free (pfs_concat* concat) {
+	g_string_chunk_free (concat->strings);
+	g_array_free (concat->offsets, TRUE);
+	g_array_free (concat->starts, TRUE);
+	g_ptr_array_free (concat->paths, TRUE);
+	g_free (concat);
+}
@@ -0,0 +1,79 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PLAYLISTFS_CONCAT_H
+#define PLAYLISTFS_CONCAT_H
+
+#include <glib.h>
+#include <sys/types.h>
+
+/*
+A virtual file which is a concatenation of original files, in order.
+Sizes are taken once, when files are appended, and offsets are found
+by a binary search over their running sums.
+*/
+typedef struct pfs_concat pfs_concat;
+
+/*
+State of one open concatenation. Original files are opened when they are first read,
+and only a few are kept open, so reading through any number of files is fine.
+*/
+typedef struct pfs_concat_reader pfs_concat_reader;
+
+pfs_concat* pfs_concat_new (void);
+
+/*
+Append a file, or a part of it, to the end. Not thread-safe, only used while building the playlist.
+@parameter path: Full path to the original file
+@parameter start: Offset in the file where the appended part starts
+@parameter size: Size of the part, which the file is expected to keep
+*/
+void pfs_concat_append (pfs_concat* concat, const char* path, off_t start, off_t size);
+
+/*
+Get total size of all files.
+*/
+off_t pfs_concat_size (const pfs_concat* concat);
+
+/*
+Get number of files.
+*/
+guint pfs_concat_count (const pfs_concat* concat);
+
+pfs_concat_reader* pfs_concat_open (const pfs_concat* concat);
+
+/*
+Get total size of the concatenation the reader was opened for.
+*/
+off_t pfs_concat_reader_size (const pfs_concat_reader* reader);
+
+/*
+Read straight into buf, from as many files as the range spans.
+Files which have shrunk since they were appended read as zeros.
+Returns number of bytes read, or -errno. Can be called from many threads at once.
+*/
+ssize_t pfs_concat_read (pfs_concat_reader* reader, char* buf, size_t size, off_t offset);
+
+/*
+Close original files kept open by the reader and free it.
+*/
+void pfs_concat_close (pfs_concat_reader* reader);
+
+void pfs_concat_free (pfs_concat* concat);
+
+#endif // PLAYLISTFS_CONCAT_H
@@ -0,0 +1,451 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "control.h"
+#include "server.h"
+#include "watch.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// Batches may replace every file of a big playlist at once.
+#define PFS_CONTROL_MAX_REQUEST (256 << 20)
+#define PFS_CONTROL_SEPARATOR '\t'
+
+typedef enum {
+	PFS_CONTROL_ADD,
+	PFS_CONTROL_REMOVE,
+	PFS_CONTROL_RENAME,
+} pfs_control_command_type;
+
+typedef struct {
+	pfs_control_command_type type;
+	char* name; // Owned for additions, points into the request otherwise
+	const char* new_name; // For renames
+	pfs_file* file; // For additions, freed with the batch unless it was committed
+} pfs_control_command;
+
+// A change to the file table, kept to undo it if a later command fails.
+typedef struct {
+	char* name; // Key in the file table, owned by the change while it is not in the table
+	pfs_file* file; // File which was stolen with the name, NULL if the name was inserted
+	gboolean dropped; // Whether the stolen name is gone for good, and not just renamed
+} pfs_control_change;
+
+typedef struct {
+	pfs_data* data;
+	struct fuse* fuse;
+} pfs_control_state;
+
+static gpointer pfs_control_thread (
+	gpointer pointer
+);
+static int pfs_control_handle (
+	pfs_control_state* state, char** request, GString* messages
+);
+static gboolean pfs_control_parse (
+	pfs_data* data, char** request, GArray* commands, GString* messages
+);
+static gboolean pfs_control_apply_command (
+	pfs_data* data, pfs_control_command* command, GArray* changes, GString* messages
+);
+static gboolean pfs_control_steal (
+	pfs_data* data, const char* name, gboolean dropped, GArray* changes
+);
+static void pfs_control_insert (
+	pfs_data* data, char* name, pfs_file* file, GArray* changes
+);
+static gboolean pfs_control_is_valid_name (
+	const char* name
+);
+
+gboolean pfs_control_listen (
+	pfs_data* data
+) {
+	if (data->opts.control == NULL || data->control.path != NULL) {
+		return TRUE;
+	}
+	int fd = pfs_server_listen (data->opts.control);
+	if (fd == -EADDRINUSE) {
+		printerrf ("changes are already accepted at '%s'", data->opts.control);
+		return FALSE;
+	}
+	if (fd < 0) {
+		printerrf ("could not listen at '%s': %s", data->opts.control, strerror (-fd));
+		return FALSE;
+	}
+	data->control.wake_fd = eventfd (0, EFD_CLOEXEC);
+	if (data->control.wake_fd < 0) {
+		printerrf ("could not listen at '%s': %s", data->opts.control, strerror (errno));
+		close (fd);
+		unlink (data->opts.control);
+		return FALSE;
+	}
+	data->control.listen_fd = fd;
+	// FUSE changes the working directory when daemonizing, and the socket is removed after that.
+	if (g_path_is_absolute (data->opts.control)) {
+		data->control.path = g_strdup (data->opts.control);
+	}
+	else {
+		char* cwd = g_get_current_dir ();
+		data->control.path = g_build_filename (cwd, data->opts.control, NULL);
+		g_free (cwd);
+	}
+	return TRUE;
+}
+
+void pfs_control_start (
+	pfs_data* data, struct fuse* fuse
+) {
+	if (data->control.path == NULL || data->control.thread != NULL) {
+		return;
+	}
+	pfs_control_state* state = g_malloc0 (sizeof (*state));
+	state->data = data;
+	state->fuse = fuse;
+	data->control.thread = g_thread_new ("control", pfs_control_thread, state);
+}
+
+void pfs_control_stop (
+	pfs_data* data
+) {
+	if (data->control.thread != NULL) {
+		guint64 value = 1;
+		if (write (data->control.wake_fd, &value, sizeof (value)) < 0) {
+			printerrf ("could not stop accepting changes: %s", strerror (errno));
+		}
+		g_thread_join (data->control.thread);
+		data->control.thread = NULL;
+	}
+	if (data->control.path == NULL) {
+		return;
+	}
+	close (data->control.listen_fd);
+	close (data->control.wake_fd);
+	unlink (data->control.path);
+	g_clear_pointer (&data->control.path, g_free);
+}
+
+int pfs_control_apply (
+	pfs_data* data
+) {
+	GPtrArray* lines = g_ptr_array_new_with_free_func (free);
+	char* line = NULL;
+	size_t size = 0;
+	ssize_t length;
+	while ((length = getline (&line, &size, stdin)) >= 0) {
+		if (length > 0 && line[length - 1] == '\n') {
+			line[length - 1] = '\0';
+		}
+		g_ptr_array_add (lines, line);
+		line = NULL;
+	}
+	free (line);
+	if (ferror (stdin)) {
+		printerrf ("could not read commands: %s", strerror (errno));
+		g_ptr_array_unref (lines);
+		return EXIT_FAILURE;
+	}
+
+	int status = EXIT_SUCCESS;
+	if (lines->len > 0) {
+		status = pfs_server_request (data->opts.apply, lines->len, (char**) lines->pdata);
+		if (status == PFS_SERVER_UNREACHABLE) {
+			printerrf ("could not connect to '%s': %s", data->opts.apply, strerror (errno));
+		}
+	}
+	g_ptr_array_unref (lines);
+	return status;
+}
+
+static gpointer pfs_control_thread (
+	gpointer pointer
+) {
+	pfs_control_state* state = pointer;
+	pfs_data* data = state->data;
+	struct pollfd fds[2] = {
+		{ .fd = data->control.listen_fd, .events = POLLIN },
+		{ .fd = data->control.wake_fd, .events = POLLIN },
+	};
+	while (TRUE) {
+		if (poll (fds, G_N_ELEMENTS (fds), -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (fds[1].revents != 0) {
+			break;
+		}
+		int client = accept4 (data->control.listen_fd, NULL, NULL, SOCK_CLOEXEC);
+		if (client < 0) {
+			continue;
+		}
+		char** request = pfs_server_read_request (client, PFS_CONTROL_MAX_REQUEST);
+		if (request == NULL) {
+			pfs_server_reply (client, EXIT_FAILURE);
+			close (client);
+			continue;
+		}
+		// Messages of other threads still go to stderr, so these are collected separately.
+		GString* messages = g_string_new (NULL);
+		int status = pfs_control_handle (state, request, messages);
+		pfs_server_send (client, messages->str);
+		pfs_server_reply (client, status);
+		close (client);
+		g_string_free (messages, TRUE);
+		g_strfreev (request);
+	}
+	g_free (state);
+	return NULL;
+}
+
+static int pfs_control_handle (
+	pfs_control_state* state, char** request, GString* messages
+) {
+	pfs_data* data = state->data;
+	GArray* commands = g_array_new (FALSE, FALSE, sizeof (pfs_control_command));
+	// Original files are checked before taking the lock, so that operations only wait for the table.
+	gboolean result = pfs_control_parse (data, request, commands, messages);
+
+	GArray* changes = g_array_new (FALSE, FALSE, sizeof (pfs_control_change));
+	if (result) {
+		// Files loaded in background should not override changes.
+		pfs_background_load_wait (data);
+		g_rw_lock_writer_lock (&data->filetable_lock);
+		for (guint icommand = 0; icommand < commands->len && result; icommand++) {
+			result = pfs_control_apply_command (
+				data, &g_array_index (commands, pfs_control_command, icommand), changes, messages
+			);
+		}
+		if (!result) {
+			// Undo in reverse, so that every name gets back what it had.
+			for (guint ichange = changes->len; ichange > 0; ichange--) {
+				pfs_control_change* change = &g_array_index (changes, pfs_control_change, ichange - 1);
+				if (change->file == NULL) {
+					pfs_table_steal (data->filetable, change->name);
+					g_free (change->name);
+				}
+				else {
+					pfs_table_insert (data->filetable, change->name, change->file);
+				}
+			}
+			g_array_set_size (changes, 0);
+		}
+		g_rw_lock_writer_unlock (&data->filetable_lock);
+	}
+
+	// Kernel may have cached any of the changed names.
+	GPtrArray* names = g_ptr_array_new_with_free_func (g_free);
+	for (guint ichange = 0; ichange < changes->len; ichange++) {
+		pfs_control_change* change = &g_array_index (changes, pfs_control_change, ichange);
+		g_ptr_array_add (names, pfs_name_to_path (data, change->name));
+		if (change->file == NULL) {
+			continue;
+		}
+		// Same as in pfs_unlink().
+		g_free (change->name);
+		if (change->dropped && --change->file->nlink == 0) {
+			pfs_file_free (change->file);
+		}
+	}
+	gboolean added = FALSE;
+	for (guint icommand = 0; icommand < commands->len; icommand++) {
+		pfs_control_command* command = &g_array_index (commands, pfs_control_command, icommand);
+		if (command->type != PFS_CONTROL_ADD) {
+			continue;
+		}
+		// Committed files are owned by the table.
+		if (!result) {
+			pfs_file_free (command->file);
+		}
+		g_free (command->name);
+		added = TRUE;
+	}
+	if (result) {
+		printinfof ("Applied %u changes from '%s'", commands->len, data->opts.control);
+		if (added) {
+			pfs_watch_added (data);
+		}
+	}
+	#if FUSE_USE_VERSION >= 30
+	for (guint iname = 0; iname < names->len; iname++) {
+		// Fails with ENOENT if the kernel does not know the name, which is fine.
+		fuse_invalidate_path (state->fuse, g_ptr_array_index (names, iname));
+	}
+	#endif
+	g_ptr_array_unref (names);
+	g_array_free (changes, TRUE);
+	g_array_free (commands, TRUE);
+	return result ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+Split commands into fields and resolve added files. All errors are reported, not only the first one.
+*/
+static gboolean pfs_control_parse (
+	pfs_data* data, char** request, GArray* commands, GString* messages
+) {
+	GString* relative_base = NULL;
+	if (!data->opts.relative_disabled.files) {
+		relative_base = g_string_new (request[0]);
+		if (relative_base->str[relative_base->len - 1] != '/') {
+			g_string_append_c (relative_base, '/');
+		}
+	}
+
+	gboolean result = TRUE;
+	for (guint iline = 1; request[iline] != NULL; iline++) {
+		char* line = request[iline];
+		if (line[0] == '\0' || line[0] == '#') {
+			continue;
+		}
+		char* fields[3] = { NULL, NULL, NULL };
+		guint count = 0;
+		for (char* field = line; field != NULL; count++) {
+			char* next = strchr (field, PFS_CONTROL_SEPARATOR);
+			if (next != NULL) {
+				*next++ = '\0';
+			}
+			if (count < G_N_ELEMENTS (fields)) {
+				fields[count] = field;
+			}
+			field = next;
+		}
+
+		pfs_control_command command = { 0 };
+		guint expected = 2;
+		if (0 == strcmp (fields[0], "add") || 0 == strcmp (fields[0], "symlink")) {
+			command.type = PFS_CONTROL_ADD;
+		}
+		else if (0 == strcmp (fields[0], "remove")) {
+			command.type = PFS_CONTROL_REMOVE;
+		}
+		else if (0 == strcmp (fields[0], "rename")) {
+			command.type = PFS_CONTROL_RENAME;
+			expected = 3;
+		}
+		else {
+			g_string_append_printf (messages, "error: unknown command '%s' on line %u\n", fields[0], iline);
+			result = FALSE;
+			continue;
+		}
+		if (count != expected) {
+			g_string_append_printf (messages, "error: wrong number of arguments for '%s' on line %u\n", fields[0], iline);
+			result = FALSE;
+			continue;
+		}
+
+		if (command.type == PFS_CONTROL_ADD) {
+			pfs_file_entry entry = {
+				.path = fields[1],
+				.type = (0 == strcmp (fields[0], "symlink")) ? S_IFLNK : S_IFREG,
+			};
+			command.file = pfs_build_playlist_resolve_entry (data, relative_base, &entry, &command.name);
+			if (command.file == NULL) {
+				g_string_append_printf (messages, "error: could not add '%s' on line %u\n", fields[1], iline);
+				result = FALSE;
+				continue;
+			}
+		}
+		else {
+			command.name = fields[1];
+			command.new_name = fields[2];
+			if (command.new_name != NULL && !pfs_control_is_valid_name (command.new_name)) {
+				g_string_append_printf (messages, "error: '%s' is not a valid name on line %u\n", command.new_name, iline);
+				result = FALSE;
+				continue;
+			}
+		}
+		g_array_append_val (commands, command);
+	}
+
+	if (relative_base != NULL) {
+		g_string_free (relative_base, TRUE);
+	}
+	return result;
+}
+
+// Must be called with the table locked for writing.
+static gboolean pfs_control_apply_command (
+	pfs_data* data, pfs_control_command* command, GArray* changes, GString* messages
+) {
+	switch (command->type) {
+	case PFS_CONTROL_ADD:
+		// Same as entries of lists, a later one replaces an earlier one.
+		pfs_control_steal (data, command->name, TRUE, changes);
+		pfs_control_insert (data, g_strdup (command->name), command->file, changes);
+		return TRUE;
+	case PFS_CONTROL_REMOVE:
+		if (!pfs_control_steal (data, command->name, TRUE, changes)) {
+			g_string_append_printf (messages, "error: can not remove '%s', it does not exist\n", command->name);
+			return FALSE;
+		}
+		return TRUE;
+	case PFS_CONTROL_RENAME: {
+		pfs_file* file = pfs_table_lookup (data->filetable, command->name);
+		if (file == NULL) {
+			g_string_append_printf (messages, "error: can not rename '%s', it does not exist\n", command->name);
+			return FALSE;
+		}
+		// Same as rename(2), names of the same file are left alone.
+		if (file == pfs_table_lookup (data->filetable, command->new_name)) {
+			return TRUE;
+		}
+		pfs_control_steal (data, command->name, FALSE, changes);
+		pfs_control_steal (data, command->new_name, TRUE, changes);
+		pfs_control_insert (data, g_strdup (command->new_name), file, changes);
+		return TRUE;
+	}
+	}
+	return FALSE;
+}
+
+// Returns FALSE if there is no such name.
+static gboolean pfs_control_steal (
+	pfs_data* data, const char* name, gboolean dropped, GArray* changes
+) {
+	pfs_control_change change = { .dropped = dropped };
+	if (!pfs_table_lookup_extended (data->filetable, name, (void**) &change.name, (void**) &change.file)) {
+		return FALSE;
+	}
+	pfs_table_steal (data->filetable, name);
+	g_array_append_val (changes, change);
+	return TRUE;
+}
+
+static void pfs_control_insert (
+	pfs_data* data, char* name, pfs_file* file, GArray* changes
+) {
+	pfs_table_insert (data->filetable, name, file);
+	pfs_control_change change = { .name = name };
+	g_array_append_val (changes, change);
+}
+
+static gboolean pfs_control_is_valid_name (
+	const char* name
+) {
+	size_t length = strlen (name);
+	return length > 0 && length <= NAME_MAX && strchr (name, '/') == NULL
+		&& 0 != strcmp (name, ".") && 0 != strcmp (name, "..");
+}
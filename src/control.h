@@ -0,0 +1,61 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PLAYLISTFS_CONTROL_H
+#define PLAYLISTFS_CONTROL_H
+
+#include "playlistfs.h"
+
+/*
+Changes to a mounted filesystem through a local socket, enabled by --control.
+A client started with --apply sends a batch of commands in one request, using the protocol
+of --server, with one command per string:
+	add<TAB>PATH
+	symlink<TAB>PATH
+	remove<TAB>NAME
+	rename<TAB>NAME<TAB>NEW_NAME
+Paths are resolved the same way as for --file and --symlink. The whole batch is applied
+at once, while operations wait, or not at all if any command fails.
+*/
+
+/*
+Start listening, if --control was given. Done before mounting, so that errors are reported
+and relative paths work.
+Returns FALSE if the socket could not be created.
+*/
+gboolean pfs_control_listen (pfs_data* data);
+
+/*
+Start accepting changes. Must be called after FUSE has daemonized, as threads do not survive fork().
+@parameter data: Filesystem data
+@parameter fuse: FUSE instance to invalidate caches in
+*/
+void pfs_control_start (pfs_data* data, struct fuse* fuse);
+
+/*
+Stop the thread and remove the socket. Does nothing if already stopped.
+*/
+void pfs_control_stop (pfs_data* data);
+
+/*
+Send commands read from standard input to a filesystem at --apply, printing messages it sends back.
+Returns exit status for the client.
+*/
+int pfs_control_apply (pfs_data* data);
+
+#endif // PLAYLISTFS_CONTROL_H
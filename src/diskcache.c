@@ -0,0 +1,359 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64 // Same off_t as in playlistfs.h
+
+#include "diskcache.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+// Enough for six 64-bit numbers in hex and separators.
+#define PFS_DISKCACHE_NAME_MAX 128
+// Blocks are written under a temporary name and renamed into place, so they are never seen half-written.
+#define PFS_DISKCACHE_TEMP_SUFFIX ".tmp"
+
+typedef struct {
+	GList link; // In lru, data points to the block itself
+	char* name;
+	guint64 size;
+	gint64 used_at; // Only for ordering blocks found at startup
+} pfs_diskcache_block;
+
+struct pfs_diskcache {
+	int dirfd; // Locked with flock() while the cache is in use
+	guint64 budget;
+	GMutex lock; // Protects fields below
+	GHashTable* blocks; // Name -> pfs_diskcache_block*
+	GQueue lru; // Most recently used first
+	guint64 used; // Total size of blocks
+	gint temp_counter; // Distinguishes temporary files of different threads
+};
+
+static void pfs_diskcache_index (
+	pfs_diskcache* cache
+);
+static void pfs_diskcache_add_locked (
+	pfs_diskcache* cache, pfs_diskcache_block* block, GPtrArray* evicted
+);
+static void pfs_diskcache_remove_evicted (
+	pfs_diskcache* cache, GPtrArray* evicted
+);
+static ssize_t pfs_diskcache_read_block (
+	pfs_diskcache* cache, const pfs_diskcache_key* key, int fd, guint64 index, size_t block_size,
+	char* buf, size_t size, size_t offset
+);
+static void pfs_diskcache_store_block (
+	pfs_diskcache* cache, const char* name, const char* data, size_t size
+);
+static void pfs_diskcache_block_free (
+	void* block
+);
+
+pfs_diskcache* pfs_diskcache_new (const char* path, guint64 budget) {
+	int dirfd = open (path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dirfd < 0) {
+		return NULL;
+	}
+	// Two mounts would evict each other's blocks without knowing, and count space twice.
+	if (flock (dirfd, LOCK_EX | LOCK_NB) < 0) {
+		int error = (errno == EWOULDBLOCK) ? EBUSY : errno;
+		close (dirfd);
+		errno = error;
+		return NULL;
+	}
+
+	pfs_diskcache* cache = g_malloc0 (sizeof (*cache));
+	cache->dirfd = dirfd;
+	cache->budget = budget;
+	g_mutex_init (&cache->lock);
+	cache->blocks = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, pfs_diskcache_block_free);
+	g_queue_init (&cache->lru);
+	pfs_diskcache_index (cache);
+	return cache;
+}
+
+static void pfs_diskcache_block_free (
+	void* block
+) {
+	g_free (((pfs_diskcache_block*) block)->name);
+	g_free (block);
+}
+
+static void pfs_diskcache_format_name (
+	char* name, const pfs_diskcache_key* key, guint64 index
+) {
+	snprintf (
+		name, PFS_DISKCACHE_NAME_MAX, "%" PRIx64 "-%" PRIx64 "-%" PRIx64 ".%09ld-%" PRIx64 "-%" PRIx64,
+		(guint64) key->dev, (guint64) key->ino, (guint64) key->mtime.tv_sec, (long) key->mtime.tv_nsec,
+		(guint64) key->size, index
+	);
+}
+
+static gboolean pfs_diskcache_is_block_name (
+	const char* name
+) {
+	guint64 dev, ino, sec, size, index;
+	long nsec;
+	int length = -1;
+	sscanf (
+		name, "%" SCNx64 "-%" SCNx64 "-%" SCNx64 ".%9ld-%" SCNx64 "-%" SCNx64 "%n",
+		&dev, &ino, &sec, &nsec, &size, &index, &length
+	);
+	return length > 0 && name[length] == '\0';
+}
+
+static gint pfs_diskcache_compare_used_at (
+	gconstpointer a, gconstpointer b
+) {
+	gint64 used_a = (*(pfs_diskcache_block* const*) a)->used_at;
+	gint64 used_b = (*(pfs_diskcache_block* const*) b)->used_at;
+	return (used_a > used_b) - (used_a < used_b);
+}
+
+// Blocks from earlier mounts are ordered by when they were written, which is close enough to use.
+static void pfs_diskcache_index (
+	pfs_diskcache* cache
+) {
+	int fd = dup (cache->dirfd);
+	DIR* dir = (fd < 0) ? NULL : fdopendir (fd);
+	if (dir == NULL) {
+		if (fd >= 0)
+			close (fd);
+		return;
+	}
+	GPtrArray* found = g_ptr_array_new ();
+	struct dirent* entry;
+	while ((entry = readdir (dir)) != NULL) {
+		if (g_str_has_suffix (entry->d_name, PFS_DISKCACHE_TEMP_SUFFIX)) {
+			// Left by a mount which was killed while writing, named "BLOCK.COUNTER.tmp".
+			char* name = g_strndup (entry->d_name, strlen (entry->d_name) - strlen (PFS_DISKCACHE_TEMP_SUFFIX));
+			char* counter = strrchr (name, '.');
+			if (counter != NULL) {
+				*counter = '\0';
+				if (pfs_diskcache_is_block_name (name))
+					unlinkat (cache->dirfd, entry->d_name, 0);
+			}
+			g_free (name);
+			continue;
+		}
+		struct stat blockstat;
+		if (!pfs_diskcache_is_block_name (entry->d_name)
+			|| fstatat (cache->dirfd, entry->d_name, &blockstat, AT_SYMLINK_NOFOLLOW) < 0
+			|| !S_ISREG (blockstat.st_mode)) {
+			continue;
+		}
+		pfs_diskcache_block* block = g_malloc0 (sizeof (*block));
+		block->name = g_strdup (entry->d_name);
+		block->size = blockstat.st_size;
+		block->used_at = (gint64) blockstat.st_mtim.tv_sec * G_USEC_PER_SEC + blockstat.st_mtim.tv_nsec / 1000;
+		g_ptr_array_add (found, block);
+	}
+	closedir (dir);
+
+	g_ptr_array_sort (found, pfs_diskcache_compare_used_at);
+	// Budget may be smaller than it was, the oldest blocks are evicted then.
+	GPtrArray* evicted = g_ptr_array_new_with_free_func (g_free);
+	for (guint iblock = 0; iblock < found->len; iblock++) {
+		pfs_diskcache_add_locked (cache, g_ptr_array_index (found, iblock), evicted);
+	}
+	pfs_diskcache_remove_evicted (cache, evicted);
+	g_ptr_array_free (found, TRUE);
+}
+
+// Adds a block as the most recently used, evicting the least recently used ones over budget.
+// Names of evicted blocks are added to evicted, so that files are removed without holding the lock.
+static void pfs_diskcache_add_locked (
+	pfs_diskcache* cache, pfs_diskcache_block* block, GPtrArray* evicted
+) {
+	block->link.data = block;
+	g_hash_table_insert (cache->blocks, block->name, block);
+	g_queue_push_head_link (&cache->lru, &block->link);
+	cache->used += block->size;
+	while (cache->used > cache->budget && cache->lru.tail != NULL) {
+		pfs_diskcache_block* oldest = cache->lru.tail->data;
+		g_queue_unlink (&cache->lru, &oldest->link);
+		cache->used -= oldest->size;
+		g_ptr_array_add (evicted, g_strdup (oldest->name));
+		g_hash_table_remove (cache->blocks, oldest->name);
+	}
+}
+
+static void pfs_diskcache_remove_evicted (
+	pfs_diskcache* cache, GPtrArray* evicted
+) {
+	for (guint iname = 0; iname < evicted->len; iname++) {
+		unlinkat (cache->dirfd, g_ptr_array_index (evicted, iname), 0);
+	}
+	g_ptr_array_free (evicted, TRUE);
+}
+
+gboolean pfs_diskcache_key_from_fd (int fd, pfs_diskcache_key* key) {
+	struct stat filestat;
+	if (fstat (fd, &filestat) < 0 || !S_ISREG (filestat.st_mode)) {
+		return FALSE;
+	}
+	key->dev = filestat.st_dev;
+	key->ino = filestat.st_ino;
+	key->size = filestat.st_size;
+	key->mtime = filestat.st_mtim;
+	return TRUE;
+}
+
+ssize_t pfs_diskcache_read (
+	pfs_diskcache* cache, const pfs_diskcache_key* key, int fd, char* buf, size_t size, off_t offset
+) {
+	if (offset >= key->size) {
+		// The file has grown since it was opened, new data is not cached.
+		ssize_t result = pread (fd, buf, size, offset);
+		return (result < 0) ? -errno : result;
+	}
+	size = MIN ((off_t) size, key->size - offset);
+
+	size_t done = 0;
+	while (done < size) {
+		off_t position = offset + done;
+		guint64 index = position / PFS_DISKCACHE_BLOCK_SIZE;
+		off_t block_start = (off_t) index * PFS_DISKCACHE_BLOCK_SIZE;
+		size_t block_size = MIN (PFS_DISKCACHE_BLOCK_SIZE, key->size - block_start);
+		size_t in_block = position - block_start;
+		size_t want = MIN (size - done, block_size - in_block);
+		ssize_t got = pfs_diskcache_read_block (cache, key, fd, index, block_size, buf + done, want, in_block);
+		if (got < 0) {
+			return (done > 0) ? (ssize_t) done : got;
+		}
+		done += got;
+		if ((size_t) got < want) {
+			// The file has shrunk, this is the end of it now.
+			break;
+		}
+	}
+	return done;
+}
+
+static ssize_t pfs_diskcache_read_block (
+	pfs_diskcache* cache, const pfs_diskcache_key* key, int fd, guint64 index, size_t block_size,
+	char* buf, size_t size, size_t offset
+) {
+	char name[PFS_DISKCACHE_NAME_MAX];
+	pfs_diskcache_format_name (name, key, index);
+
+	g_mutex_lock (&cache->lock);
+	pfs_diskcache_block* block = g_hash_table_lookup (cache->blocks, name);
+	if (block != NULL) {
+		g_queue_unlink (&cache->lru, &block->link);
+		g_queue_push_head_link (&cache->lru, &block->link);
+	}
+	g_mutex_unlock (&cache->lock);
+
+	if (block != NULL) {
+		// The block may be evicted by another thread in the meantime, it is then read again.
+		int blockfd = openat (cache->dirfd, name, O_RDONLY | O_CLOEXEC);
+		if (blockfd >= 0) {
+			ssize_t result = pread (blockfd, buf, size, offset);
+			close (blockfd);
+			if (result == (ssize_t) size) {
+				return result;
+			}
+		}
+	}
+
+	// Whole blocks are read, so that following reads are served from the cache.
+	char* data = g_malloc (block_size);
+	off_t block_start = (off_t) index * PFS_DISKCACHE_BLOCK_SIZE;
+	size_t filled = 0;
+	while (filled < block_size) {
+		ssize_t result = pread (fd, data + filled, block_size - filled, block_start + filled);
+		if (result < 0 && errno == EINTR) {
+			continue;
+		}
+		if (result < 0) {
+			int error = errno;
+			g_free (data);
+			return -error;
+		}
+		if (result == 0) {
+			break;
+		}
+		filled += result;
+	}
+	if (filled == block_size) {
+		pfs_diskcache_store_block (cache, name, data, block_size);
+	}
+	size_t copied = (filled > offset) ? MIN (size, filled - offset) : 0;
+	memcpy (buf, data + offset, copied);
+	g_free (data);
+	return copied;
+}
+
+// Failing to store a block (for example, when the cache device is full) is not an error for reading.
+static void pfs_diskcache_store_block (
+	pfs_diskcache* cache, const char* name, const char* data, size_t size
+) {
+	char temp_name[PFS_DISKCACHE_NAME_MAX + 32];
+	snprintf (
+		temp_name, sizeof (temp_name), "%s.%u" PFS_DISKCACHE_TEMP_SUFFIX,
+		name, (guint) g_atomic_int_add (&cache->temp_counter, 1)
+	);
+	int tempfd = openat (cache->dirfd, temp_name, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (tempfd < 0) {
+		return;
+	}
+	size_t written = 0;
+	while (written < size) {
+		ssize_t result = write (tempfd, data + written, size - written);
+		if (result < 0 && errno == EINTR) {
+			continue;
+		}
+		if (result <= 0) {
+			break;
+		}
+		written += result;
+	}
+	if (close (tempfd) < 0 || written < size
+		|| renameat (cache->dirfd, temp_name, cache->dirfd, name) < 0) {
+		unlinkat (cache->dirfd, temp_name, 0);
+		return;
+	}
+
+	GPtrArray* evicted = g_ptr_array_new_with_free_func (g_free);
+	g_mutex_lock (&cache->lock);
+	// Another thread may have stored the same block, the file was simply replaced then.
+	if (!g_hash_table_contains (cache->blocks, name)) {
+		pfs_diskcache_block* block = g_malloc0 (sizeof (*block));
+		block->name = g_strdup (name);
+		block->size = size;
+		pfs_diskcache_add_locked (cache, block, evicted);
+	}
+	g_mutex_unlock (&cache->lock);
+	pfs_diskcache_remove_evicted (cache, evicted);
+}
+
+void pfs_diskcache_free (pfs_diskcache* cache) {
+	g_hash_table_unref (cache->blocks);
+	g_mutex_clear (&cache->lock);
+	close (cache->dirfd);
+	g_free (cache);
+}
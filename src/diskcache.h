@@ -0,0 +1,79 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PLAYLISTFS_DISKCACHE_H
+#define PLAYLISTFS_DISKCACHE_H
+
+#include <glib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/*
+Read cache on fast local storage, for original files on slow storage.
+Files are cached in blocks, each block in its own file in the cache directory,
+named after the device, inode, modification time and size of the original file.
+A changed file gets new names, so stale blocks are never read, and are evicted
+like any other least recently used blocks once the cache is over its budget.
+Blocks left by earlier mounts are used again. All functions except
+pfs_diskcache_new() and pfs_diskcache_free() can be called from any thread.
+*/
+typedef struct pfs_diskcache pfs_diskcache;
+
+// Size of a block, only the last block of a file is smaller.
+#define PFS_DISKCACHE_BLOCK_SIZE (1024 * 1024)
+
+/*
+Identity and version of an original file, taken when it is opened.
+*/
+typedef struct {
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtime;
+} pfs_diskcache_key;
+
+/*
+Open a cache directory, taking a lock on it, and index blocks already there.
+Returns NULL with errno set if the directory can not be used (EBUSY if it is used by another mount).
+@parameter path: Path to an existing directory, only files named like blocks are ever removed from it
+@parameter budget: Maximum total size of blocks, in bytes
+*/
+pfs_diskcache* pfs_diskcache_new (const char* path, guint64 budget);
+
+/*
+Fill a key for an open original file. Returns FALSE if the file can not be cached.
+*/
+gboolean pfs_diskcache_key_from_fd (int fd, pfs_diskcache_key* key);
+
+/*
+Read from an original file through the cache, storing blocks which are not cached yet.
+Reads past the size in the key go to the original file directly.
+Returns number of bytes read, or -errno.
+@parameter key: Key of the original file
+@parameter fd: Descriptor of the original file, opened for reading
+*/
+ssize_t pfs_diskcache_read (
+	pfs_diskcache* cache, const pfs_diskcache_key* key, int fd, char* buf, size_t size, off_t offset
+);
+
+/*
+Close the directory, keeping cached blocks for later mounts.
+*/
+void pfs_diskcache_free (pfs_diskcache* cache);
+
+#endif // PLAYLISTFS_DISKCACHE_H
@@ -17,14 +17,33 @@
  */
 
 #define _GNU_SOURCE // S_IFMT and co without underscores
+#define _FILE_OFFSET_BITS 64 // Same off_t as in playlistfs.h
 
 #include "files.h"
+#include "stats.h"
 
+#include <fcntl.h>
 #include <glib.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <unistd.h>
 
+// Files can be created by several filesystems at once in server mode.
+static GMutex ino_lock;
 static ino_t current_ino = PFS_FILE_INO_MIN;
 
+// Directories are shared between all files, and files can be added from any thread.
+static GMutex dirs_lock;
+static GHashTable* dirs = NULL; // path -> pfs_dir*
+// Leave enough descriptors for files opened through the filesystem.
+static rlim_t dirs_max_open = 0;
+static rlim_t dirs_open = 0;
+
+static pfs_dir* pfs_dir_get (const char* path, size_t length);
+static void pfs_dir_release (pfs_dir* dir);
+static void pfs_file_find_dir (pfs_file* file);
+
 pfs_file* pfs_file_create (const char* path, const mode_t type, const struct timespec* ts) {
 	ino_t new_ino = pfs_file_next_ino ();
 	if (new_ino == 0)
@@ -32,6 +51,9 @@ pfs_file* pfs_file_create (const char* path, const mode_t type, const struct tim
 
 	pfs_file* file = g_malloc0 (sizeof(*file));
 	file->path = g_string_new (path);
+	if (!S_ISLNK(type)) {
+		pfs_file_find_dir (file);
+	}
 	if (ts != NULL) {
 		file->ts.tv_sec = ts->tv_sec;
 		file->ts.tv_nsec = ts->tv_nsec;
@@ -39,10 +61,35 @@ pfs_file* pfs_file_create (const char* path, const mode_t type, const struct tim
 	file->type = type&S_IFMT;
 	file->nlink = S_ISDIR(type) ? 2 : 1;
 	file->ino = new_ino;
+	file->length = -1;
 	return file;
 }
 
+void pfs_file_set_path (pfs_file* file, const char* path) {
+	pfs_dir* old_dir = file->dir;
+	g_string_assign (file->path, path);
+	file->dir = NULL;
+	file->name = NULL;
+	if (!S_ISLNK(file->type)) {
+		pfs_file_find_dir (file);
+	}
+	// Released after getting the new one, so that it is not reopened when staying the same.
+	if (old_dir != NULL)
+		pfs_dir_release (old_dir);
+}
+
+static void pfs_file_find_dir (pfs_file* file) {
+	const char* slash = strrchr (file->path->str, '/');
+	if (slash != NULL) {
+		// Root directory is the only one which keeps its "/".
+		file->dir = pfs_dir_get (file->path->str, slash == file->path->str ? 1 : slash - file->path->str);
+		file->name = slash + 1;
+	}
+}
+
 void pfs_file_free (pfs_file* file) {
+	if (file->dir != NULL)
+		pfs_dir_release (file->dir);
 	g_string_free (file->path, TRUE);
 	g_free (file);
 }
@@ -52,11 +99,74 @@ void pfs_file_free_void (void* file) {
 }
 
 ino_t pfs_file_next_ino (void) {
-	if (current_ino > PFS_FILE_INO_MAX)
-		return 0;
-	return current_ino++;
+	ino_t ino = 0;
+	g_mutex_lock (&ino_lock);
+	if (current_ino <= PFS_FILE_INO_MAX)
+		ino = current_ino++;
+	g_mutex_unlock (&ino_lock);
+	return ino;
 }
 
 fsfilcnt_t pfs_file_used_ino_count (void) {
 	return (fsfilcnt_t)(current_ino - PFS_FILE_INO_MIN);
 }
+
+const char* pfs_file_at (const pfs_file* file, int* dirfd) {
+	if (file->dir == NULL || file->dir->fd < 0) {
+		*dirfd = AT_FDCWD;
+		return file->path->str;
+	}
+	*dirfd = file->dir->fd;
+	return file->name;
+}
+
+static pfs_dir* pfs_dir_get (const char* path, size_t length) {
+	char* key = g_strndup (path, length);
+
+	g_mutex_lock (&dirs_lock);
+	if (dirs == NULL) {
+		dirs = g_hash_table_new (g_str_hash, g_str_equal);
+		struct rlimit limit;
+		if (0 == getrlimit (RLIMIT_NOFILE, &limit) && limit.rlim_cur != RLIM_INFINITY) {
+			dirs_max_open = limit.rlim_cur / 2;
+		}
+		else {
+			dirs_max_open = 1024;
+		}
+	}
+
+	pfs_dir* dir = g_hash_table_lookup (dirs, key);
+	if (dir == NULL) {
+		dir = g_malloc0 (sizeof(*dir));
+		dir->path = key;
+		dir->fd = -1;
+		if (dirs_open < dirs_max_open) {
+			dir->fd = open (key, O_PATH | O_DIRECTORY | O_CLOEXEC);
+			pfs_stats_count (PFS_COUNTER_SYSCALLS, 1);
+			if (dir->fd >= 0)
+				dirs_open++;
+		}
+		g_hash_table_insert (dirs, dir->path, dir);
+	}
+	else {
+		g_free (key);
+	}
+	dir->refs++;
+	g_mutex_unlock (&dirs_lock);
+
+	return dir;
+}
+
+static void pfs_dir_release (pfs_dir* dir) {
+	g_mutex_lock (&dirs_lock);
+	if (--dir->refs == 0) {
+		g_hash_table_remove (dirs, dir->path);
+		if (dir->fd >= 0) {
+			close (dir->fd);
+			dirs_open--;
+		}
+		g_free (dir->path);
+		g_free (dir);
+	}
+	g_mutex_unlock (&dirs_lock);
+}
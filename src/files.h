@@ -28,12 +28,27 @@
 #include <sys/types.h>
 #include <time.h>
 
+/*
+A directory containing original files, shared by all files inside it.
+Keeping it open allows to access files by name, without walking the whole path.
+*/
+typedef struct {
+	char* path; // Path to the directory
+	int fd; // O_PATH descriptor, or -1 if it could not be opened
+	gint refs; // Number of files using this directory
+} pfs_dir;
+
 typedef struct {
 	GString* path; // Path to original file
+	pfs_dir* dir; // Directory of original file, NULL for symlink records
+	const char* name; // Name of original file inside dir, points into path
 	nlink_t nlink; // Number of links inside FS
 	ino_t ino; // File serial number
 	mode_t type; // Type of record, not type of the actual file
 	struct timespec ts; // When the record was created
+	struct pfs_concat* concat; // Files this one concatenates, NULL for records of original files
+	off_t offset; // Start of the slice of original file
+	off_t length; // Length of the slice, -1 if the whole file is used
 } pfs_file;
 
 /*
@@ -44,6 +59,13 @@ Create a new pfs_file.
 */
 pfs_file* pfs_file_create (const char* path, const mode_t type, const struct timespec* ts);
 
+/*
+Change path to original file, after it was moved. Directory is changed as needed.
+@parameter file: The pfs_file to change
+@parameter path: New path of the file
+*/
+void pfs_file_set_path (pfs_file* file, const char* path);
+
 /*
 Free a pfs_file. Should only be called if deleted from the file table.
 @parameter file: The pfs_file to free
@@ -51,11 +73,19 @@ Free a pfs_file. Should only be called if deleted from the file table.
 void pfs_file_free (pfs_file*);
 
 /*
-Same as pfs_file_free, but for use with GHashTable.
+Same as pfs_file_free, but for use as a GDestroyNotify.
 @parameter file: The pfs_file to free
 */
 void pfs_file_free_void (void*);
 
+/*
+Get a directory descriptor and a name to use with *at() functions to access original file.
+If the directory could not be opened, returns the full path and AT_FDCWD instead.
+@parameter file: The pfs_file to access
+@parameter dirfd: Where to store the directory descriptor
+*/
+const char* pfs_file_at (const pfs_file* file, int* dirfd);
+
 /*
 Get next inode number between PFS_FILE_INO_MIN and PFS_FILE_INO_MAX, inclusive.
 Returns 0 if the pool is exhausted (quite unlikely to happen in reality).
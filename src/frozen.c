@@ -0,0 +1,257 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include "frozen.h"
+
+#include <string.h>
+
+// Average number of names per bucket. Bigger buckets need less memory for seeds,
+// but take longer to place.
+#define PFS_FROZEN_BUCKET_SIZE 2
+// Hashes point into a slightly bigger range than there are names, otherwise placing
+// the last names takes forever. Slots past the end are then remapped to the free ones.
+#define PFS_FROZEN_SPARE_SLOTS(size) ((size) / 64 + 1)
+// Give up after this many seeds for a single bucket, which means hashes collide.
+#define PFS_FROZEN_MAX_SEED (1u << 24)
+
+typedef struct {
+	guint64 hash;
+	guint32 name; // Offset of name in names
+	guint32 name_length;
+	pfs_file* file;
+} pfs_frozen_entry;
+
+struct pfs_frozen {
+	guint32 size; // Number of entries
+	guint32 slots; // Number of slots hashes point to, size plus spare ones
+	guint32 buckets; // Number of buckets
+	guint32* seeds; // Seed for each bucket, which places all its names into free slots
+	guint32* remap; // Where names from spare slots are actually put
+	pfs_frozen_entry* entries; // Each name in the slot given by the hash
+	char* names; // All names, with terminating '\0'
+};
+
+// Hash is an FNV-1a, with a final mix, as names often differ only in their last bytes.
+static inline guint64 pfs_frozen_mix (guint64 x) {
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+static inline guint64 pfs_frozen_hash (const char* name, size_t length) {
+	guint64 hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < length; i++) {
+		hash ^= (unsigned char) name[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return pfs_frozen_mix (hash);
+}
+
+static inline guint32 pfs_frozen_bucket (const pfs_frozen* frozen, guint64 hash) {
+	return (guint32) ((hash >> 32) % frozen->buckets);
+}
+
+static inline guint32 pfs_frozen_slot (const pfs_frozen* frozen, guint64 hash, guint32 seed) {
+	return (guint32) (pfs_frozen_mix (hash ^ (seed * 0x9e3779b97f4a7c15ULL)) % frozen->slots);
+}
+
+static gboolean pfs_frozen_place (
+	pfs_frozen* frozen, pfs_frozen_entry* sorted, guint32* bucket_start, guint32* bucket_order, guint32 order_length
+);
+
+pfs_frozen* pfs_frozen_new (pfs_table* filetable) {
+	pfs_frozen* frozen = g_malloc0 (sizeof (*frozen));
+	frozen->size = pfs_table_size (filetable);
+	frozen->slots = frozen->size + PFS_FROZEN_SPARE_SLOTS (frozen->size);
+	frozen->buckets = frozen->size / PFS_FROZEN_BUCKET_SIZE + 1;
+	frozen->seeds = g_new0 (guint32, frozen->buckets);
+	frozen->remap = g_new0 (guint32, frozen->slots - frozen->size);
+	frozen->entries = g_new0 (pfs_frozen_entry, frozen->size);
+
+	// Copy names together, in hash table order, and sort them into buckets.
+	size_t names_length = 0;
+	pfs_table_iter iter;
+	gpointer key, value;
+	pfs_table_iter_init (&iter, filetable);
+	while (pfs_table_iter_next (&iter, &key, &value)) {
+		names_length += strlen (key) + 1;
+	}
+	frozen->names = g_malloc (names_length);
+
+	pfs_frozen_entry* unplaced = g_new (pfs_frozen_entry, frozen->size);
+	guint32* bucket_start = g_new0 (guint32, frozen->buckets + 1);
+	size_t offset = 0;
+	guint32 ientry = 0;
+	pfs_table_iter_init (&iter, filetable);
+	while (pfs_table_iter_next (&iter, &key, &value)) {
+		size_t length = strlen (key);
+		memcpy (frozen->names + offset, key, length + 1);
+		unplaced[ientry] = (pfs_frozen_entry) {
+			.hash = pfs_frozen_hash (key, length),
+			.name = offset,
+			.name_length = length,
+			.file = value,
+		};
+		bucket_start[pfs_frozen_bucket (frozen, unplaced[ientry].hash) + 1]++;
+		offset += length + 1;
+		ientry++;
+	}
+	for (guint32 ibucket = 0; ibucket < frozen->buckets; ibucket++) {
+		bucket_start[ibucket + 1] += bucket_start[ibucket];
+	}
+	pfs_frozen_entry* sorted = g_new (pfs_frozen_entry, frozen->size);
+	guint32* fill = g_new (guint32, frozen->buckets);
+	memcpy (fill, bucket_start, sizeof (*fill) * frozen->buckets);
+	for (guint32 i = 0; i < frozen->size; i++) {
+		sorted[fill[pfs_frozen_bucket (frozen, unplaced[i].hash)]++] = unplaced[i];
+	}
+	g_free (fill);
+	g_free (unplaced);
+
+	// Biggest buckets are the hardest to place, so they go first, while most slots are free.
+	guint32 max_bucket_size = 0;
+	for (guint32 ibucket = 0; ibucket < frozen->buckets; ibucket++) {
+		max_bucket_size = MAX (max_bucket_size, bucket_start[ibucket + 1] - bucket_start[ibucket]);
+	}
+	guint32* bucket_order = g_new (guint32, frozen->buckets);
+	guint32 iorder = 0;
+	for (guint32 size = max_bucket_size; size > 0; size--) {
+		for (guint32 ibucket = 0; ibucket < frozen->buckets; ibucket++) {
+			if (bucket_start[ibucket + 1] - bucket_start[ibucket] == size) {
+				bucket_order[iorder++] = ibucket;
+			}
+		}
+	}
+
+	gboolean placed = pfs_frozen_place (frozen, sorted, bucket_start, bucket_order, iorder);
+	g_free (bucket_order);
+	g_free (bucket_start);
+	g_free (sorted);
+	if (!placed) {
+		pfs_frozen_free (frozen);
+		return NULL;
+	}
+	return frozen;
+}
+
+static gboolean pfs_frozen_place (
+	pfs_frozen* frozen, pfs_frozen_entry* sorted, guint32* bucket_start, guint32* bucket_order, guint32 order_length
+) {
+	guint32 slots[PFS_FROZEN_BUCKET_SIZE * 16];
+	// Entries are put in place only at the end, this is smaller and checked often.
+	guint8* taken = g_new0 (guint8, frozen->slots);
+	guint32* placement = g_new (guint32, frozen->size);
+	gboolean result = TRUE;
+	for (guint32 iorder = 0; iorder < order_length && result; iorder++) {
+		guint32 ibucket = bucket_order[iorder];
+		guint32 start = bucket_start[ibucket];
+		guint32 size = bucket_start[ibucket + 1] - start;
+		if (size > G_N_ELEMENTS (slots)) {
+			// Extremely unlikely with a good hash.
+			result = FALSE;
+			break;
+		}
+
+		guint32 seed = 0;
+		for (; seed < PFS_FROZEN_MAX_SEED; seed++) {
+			guint32 iname = 0;
+			for (; iname < size; iname++) {
+				slots[iname] = pfs_frozen_slot (frozen, sorted[start + iname].hash, seed);
+				if (taken[slots[iname]]) break;
+				// Names in the bucket must not take the same slot either.
+				gboolean repeated = FALSE;
+				for (guint32 iprevious = 0; iprevious < iname && !repeated; iprevious++) {
+					repeated = (slots[iprevious] == slots[iname]);
+				}
+				if (repeated) break;
+			}
+			if (iname == size) break;
+		}
+		if (seed == PFS_FROZEN_MAX_SEED) {
+			result = FALSE;
+			break;
+		}
+
+		frozen->seeds[ibucket] = seed;
+		for (guint32 iname = 0; iname < size; iname++) {
+			taken[slots[iname]] = 1;
+			placement[start + iname] = slots[iname];
+		}
+	}
+
+	if (result) {
+		// There are exactly as many free slots before the end as taken slots after it.
+		guint32 free_slot = 0;
+		for (guint32 spare = frozen->size; spare < frozen->slots; spare++) {
+			if (!taken[spare]) continue;
+			while (taken[free_slot]) free_slot++;
+			taken[free_slot] = 1;
+			frozen->remap[spare - frozen->size] = free_slot;
+		}
+		for (guint32 iname = 0; iname < frozen->size; iname++) {
+			guint32 slot = placement[iname];
+			if (slot >= frozen->size) {
+				slot = frozen->remap[slot - frozen->size];
+			}
+			frozen->entries[slot] = sorted[iname];
+		}
+	}
+	g_free (placement);
+	g_free (taken);
+	return result;
+}
+
+pfs_file* pfs_frozen_lookup (const pfs_frozen* frozen, const char* name) {
+	if (frozen->size == 0) {
+		return NULL;
+	}
+	size_t length = strlen (name);
+	guint64 hash = pfs_frozen_hash (name, length);
+	guint32 seed = frozen->seeds[pfs_frozen_bucket (frozen, hash)];
+	guint32 slot = pfs_frozen_slot (frozen, hash, seed);
+	if (slot >= frozen->size) {
+		slot = frozen->remap[slot - frozen->size];
+	}
+	const pfs_frozen_entry* entry = &frozen->entries[slot];
+	if (entry->hash != hash || entry->name_length != length
+		|| 0 != memcmp (frozen->names + entry->name, name, length)) {
+		return NULL;
+	}
+	return entry->file;
+}
+
+guint pfs_frozen_size (const pfs_frozen* frozen) {
+	return frozen->size;
+}
+
+const char* pfs_frozen_name (const pfs_frozen* frozen, guint index) {
+	return frozen->names + frozen->entries[index].name;
+}
+
+void pfs_frozen_free (pfs_frozen* frozen) {
+	g_free (frozen->names);
+	g_free (frozen->entries);
+	g_free (frozen->remap);
+	g_free (frozen->seeds);
+	g_free (frozen);
+}
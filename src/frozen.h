@@ -0,0 +1,58 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PLAYLISTFS_FROZEN_H
+#define PLAYLISTFS_FROZEN_H
+
+#include "files.h"
+#include "table.h"
+
+#include <glib.h>
+
+/*
+An immutable copy of the file table, for filesystems which never change.
+Files are placed in one array by a minimal perfect hash, with names stored together,
+so a lookup is one hash and one comparison, and listing is a linear scan.
+*/
+typedef struct pfs_frozen pfs_frozen;
+
+/*
+Freeze a file table. The table still owns the files and must outlive the frozen copy.
+Returns NULL if a perfect hash could not be found (practically, never).
+@parameter filetable: Table of name -> pfs_file*
+*/
+pfs_frozen* pfs_frozen_new (pfs_table* filetable);
+
+/*
+Find a file by name, or return NULL.
+*/
+pfs_file* pfs_frozen_lookup (const pfs_frozen* frozen, const char* name);
+
+/*
+Get number of files.
+*/
+guint pfs_frozen_size (const pfs_frozen* frozen);
+
+/*
+Get name of a file by its index, from 0 to pfs_frozen_size() - 1.
+*/
+const char* pfs_frozen_name (const pfs_frozen* frozen, guint index);
+
+void pfs_frozen_free (pfs_frozen* frozen);
+
+#endif // PLAYLISTFS_FROZEN_H
@@ -0,0 +1,929 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "lists.h"
+#include "pfs_libgen.h"
+#include "stats.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef PATH_MAX
+// For now, this will be a hard limit in case it is not defined.
+#define PATH_MAX 4096
+#endif
+
+// Directories are read in big chunks to need fewer syscalls on huge directories.
+#define PFS_SCAN_BUFFER_SIZE (256 * 1024)
+
+// Size of chunks XSPF playlists are fed to the parser in.
+#define PFS_XSPF_BUFFER_SIZE (64 * 1024)
+
+// UTF-8 byte order mark, which some players write at the start of playlists.
+#define PFS_LIST_BOM "\xEF\xBB\xBF"
+
+typedef enum {
+	PFS_LIST_FORMAT_NATIVE,
+	PFS_LIST_FORMAT_M3U, // Also M3U8, paths with "#" comments and extended info
+	PFS_LIST_FORMAT_PLS, // INI-like, paths in "FileN=" keys
+	PFS_LIST_FORMAT_XSPF, // XML, URIs in <location> of <track>
+} pfs_list_format;
+
+// Layout of records returned by getdents64(2).
+struct pfs_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+struct pfs_list_loader {
+	pfs_data* data;
+	GString* cwd;
+	GThreadPool* pool;
+	GThreadPool* scan_pool;
+	GMutex lock; // Protects everything below
+	GCond done;
+	GHashTable* lists; // "real_path\nrelative_base" -> pfs_list*
+	guint pending; // Lists and directories scheduled, but not yet read
+};
+
+static void pfs_list_loader_read (
+	gpointer list, gpointer loader
+);
+static void pfs_list_read (
+	pfs_list_loader* loader, pfs_list* list, FILE* file
+);
+static pfs_list* pfs_list_loader_request_include (
+	pfs_list_loader* loader, pfs_list* list, const char* path
+);
+static pfs_list_format pfs_list_format_from_name (
+	const char* path
+);
+static pfs_list_format pfs_list_format_from_content (
+	const char* line
+);
+static char* pfs_list_pls_file (
+	char* line
+);
+static void pfs_list_read_xspf (
+	pfs_list_loader* loader, pfs_list* list, FILE* file, const char* head, gint* lines, gint* skipped
+);
+static char* pfs_list_get_location_path (
+	pfs_data* data, GString* relative_base, const char* location, gboolean escaped
+);
+static pfs_scan* pfs_list_loader_request_scan (
+	pfs_list_loader* loader, pfs_list* list, const char* path, gboolean recursive
+);
+static void pfs_list_loader_schedule_scan (
+	pfs_list_loader* loader, pfs_scan_dir* dir
+);
+static void pfs_list_loader_scan (
+	gpointer dir, gpointer loader
+);
+static void pfs_scan_dir_read (
+	pfs_list_loader* loader, pfs_scan_dir* dir, int fd
+);
+static void pfs_list_loader_finish_task (
+	pfs_list_loader* loader
+);
+static gboolean pfs_list_expand_scan_dir (
+	pfs_list_loader* loader, pfs_scan_dir* dir, pfs_list_entry_func func, void* user_data
+);
+static pfs_scan_dir* pfs_scan_dir_new (
+	pfs_scan* scan, const char* path
+);
+static void pfs_scan_dir_free (
+	void* dir
+);
+static GString* pfs_list_get_relative_base (
+	pfs_data* data, GString* cwd, const char* listpath
+);
+static void pfs_list_free (
+	void* list
+);
+static void pfs_list_clear_entry (
+	void* entry
+);
+static char* pfs_list_get_full_path_from_absolute (
+	pfs_data* data, const char* path
+);
+static char* pfs_list_get_full_path_from_relative (
+	pfs_data* data, GString* relative_base, const char* path, size_t length
+);
+
+pfs_list_loader* pfs_list_loader_new (pfs_data* data, GString* cwd) {
+	pfs_list_loader* loader = g_malloc0 (sizeof (*loader));
+	loader->data = data;
+	loader->cwd = cwd;
+	g_mutex_init (&loader->lock);
+	g_cond_init (&loader->done);
+	loader->lists = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, pfs_list_free);
+
+	// FUSE forks when daemonizing, and the child would wait forever on threads
+	// that glib keeps around for reuse. Make sure none are kept.
+	g_thread_pool_set_max_unused_threads (0);
+	loader->pool = g_thread_pool_new (pfs_list_loader_read, loader, g_get_num_processors (), FALSE, NULL);
+	loader->scan_pool = g_thread_pool_new (pfs_list_loader_scan, loader, g_get_num_processors (), FALSE, NULL);
+	return loader;
+}
+
+pfs_list* pfs_list_loader_request (pfs_list_loader* loader, const char* path) {
+	pfs_data* data = loader->data;
+	GString* relative_base = NULL;
+	if (!data->opts.relative_disabled.paths) {
+		relative_base = pfs_list_get_relative_base (data, loader->cwd, path);
+	}
+
+	// Lists are identified by their real path and the real base for relative paths,
+	// as the same list reached through a symlink may point to different files.
+	char* real_path = realpath (path, NULL);
+	char* real_base = relative_base ? realpath (relative_base->str, NULL) : NULL;
+	char* key = g_strconcat (
+		real_path ? real_path : path, "\n", real_base ? real_base : "", NULL
+	);
+	free (real_base);
+
+	g_mutex_lock (&loader->lock);
+	pfs_list* list = g_hash_table_lookup (loader->lists, key);
+	if (list == NULL) {
+		list = g_malloc0 (sizeof (*list));
+		list->path = g_strdup (path);
+		list->real_path = real_path ? g_strdup (real_path) : NULL;
+		list->relative_base = relative_base;
+		list->entries = g_array_new (FALSE, FALSE, sizeof (pfs_list_entry));
+		g_array_set_clear_func (list->entries, pfs_list_clear_entry);
+		g_hash_table_insert (loader->lists, key, list);
+		loader->pending++;
+		g_thread_pool_push (loader->pool, list, NULL);
+	}
+	else {
+		g_free (key);
+		if (relative_base) {
+			g_string_free (relative_base, TRUE);
+		}
+	}
+	g_mutex_unlock (&loader->lock);
+
+	free (real_path);
+	return list;
+}
+
+void pfs_list_loader_wait (pfs_list_loader* loader) {
+	g_mutex_lock (&loader->lock);
+	while (loader->pending > 0) {
+		g_cond_wait (&loader->done, &loader->lock);
+	}
+	g_mutex_unlock (&loader->lock);
+}
+
+gboolean pfs_list_loader_expand (
+	pfs_list_loader* loader, pfs_list* list, pfs_list_entry_func func, void* user_data
+) {
+	pfs_data* data = loader->data;
+	if (!list->readable) {
+		// Warning was already printed when reading.
+		return TRUE;
+	}
+	printinfof ("Reading list '%s':", list->path);
+
+	gboolean result = TRUE;
+	list->expanding = TRUE;
+	for (size_t ientry = 0; ientry < list->entries->len; ientry++) {
+		pfs_list_entry* entry = &g_array_index (list->entries, pfs_list_entry, ientry);
+		if (entry->scan != NULL) {
+			if (!pfs_list_expand_scan_dir (loader, entry->scan->root, func, user_data)) {
+				result = FALSE;
+				break;
+			}
+		}
+		else if (entry->include == NULL) {
+			if (!func (data, entry, user_data)) {
+				result = FALSE;
+				break;
+			}
+		}
+		else if (entry->include->expanding) {
+			printwarnf ("list '%s' is included recursively from '%s', skipping", entry->include->path, list->path);
+			pfs_stats_count (PFS_COUNTER_ENTRIES_SKIPPED, 1);
+		}
+		else {
+			if (!pfs_list_loader_expand (loader, entry->include, func, user_data)) {
+				result = FALSE;
+				break;
+			}
+			printinfof ("Continuing list '%s':", list->path);
+		}
+	}
+	list->expanding = FALSE;
+	return result;
+}
+
+void pfs_list_loader_free (pfs_list_loader* loader) {
+	pfs_list_loader_wait (loader);
+	g_thread_pool_free (loader->pool, FALSE, TRUE);
+	g_thread_pool_free (loader->scan_pool, FALSE, TRUE);
+	g_hash_table_unref (loader->lists);
+	g_cond_clear (&loader->done);
+	g_mutex_clear (&loader->lock);
+	g_free (loader);
+}
+
+/*
+---- Reading ----
+*/
+
+// Runs on the thread pool.
+static void pfs_list_loader_read (
+	gpointer list_pointer, gpointer loader_pointer
+) {
+	pfs_list_loader* loader = (pfs_list_loader*) loader_pointer;
+	pfs_list* list = (pfs_list*) list_pointer;
+	pfs_data* data = loader->data;
+
+	FILE* file = fopen (list->path, "rt");
+	pfs_stats_count (PFS_COUNTER_SYSCALLS, 1);
+	if (!file) {
+		printwarnf ("list '%s' could not be opened, skipping", list->path);
+	}
+	else {
+		list->readable = TRUE;
+		pfs_list_read (loader, list, file);
+	}
+
+	pfs_list_loader_finish_task (loader);
+}
+
+static void pfs_list_loader_finish_task (
+	pfs_list_loader* loader
+) {
+	g_mutex_lock (&loader->lock);
+	if (--loader->pending == 0) {
+		g_cond_broadcast (&loader->done);
+	}
+	g_mutex_unlock (&loader->lock);
+}
+
+static void pfs_list_read (
+	pfs_list_loader* loader, pfs_list* list, FILE* file
+) {
+	pfs_data* data = loader->data;
+	const size_t include_length = strlen (PFS_LIST_DIRECTIVE_INCLUDE);
+	const size_t directory_length = strlen (PFS_LIST_DIRECTIVE_DIRECTORY);
+	const size_t recursive_length = strlen (PFS_LIST_DIRECTIVE_DIRECTORY_RECURSIVE);
+	pfs_list_format format = pfs_list_format_from_name (list->path);
+
+	// Counted locally, so that threads do not contend on every line.
+	gint lines = 0;
+	gint skipped = 0;
+	char buffer[PATH_MAX];
+	while (fgets (buffer, PATH_MAX, file)) {
+		char* path = buffer;
+		lines++;
+		if (lines == 1) {
+			if (0 == strncmp (path, PFS_LIST_BOM, strlen (PFS_LIST_BOM))) {
+				path += strlen (PFS_LIST_BOM);
+			}
+			if (format == PFS_LIST_FORMAT_NATIVE) {
+				format = pfs_list_format_from_content (path);
+			}
+			if (format == PFS_LIST_FORMAT_XSPF) {
+				pfs_list_read_xspf (loader, list, file, path, &lines, &skipped);
+				break;
+			}
+		}
+
+		size_t length = strlen (path);
+		if (path[0] == '\n' || length == 0) {
+			continue;
+		}
+		else if (path[length - 1] == '\n') {
+			path[--length] = '\0';
+		}
+		else if (path + length == buffer + PATH_MAX - 1) {
+			printwarn ("filename too long, ignoring");
+			skipped++;
+			while (fgetc(file) != '\n' && !feof(file) && !ferror(file)) {}
+			continue;
+		}
+		if (format != PFS_LIST_FORMAT_NATIVE) {
+			// Players often write playlists with Windows line endings.
+			if (length > 0 && path[length - 1] == '\r') {
+				path[--length] = '\0';
+			}
+			if (format == PFS_LIST_FORMAT_PLS) {
+				path = pfs_list_pls_file (path);
+			}
+			if (path == NULL || path[0] == '\0') {
+				continue;
+			}
+		}
+
+		pfs_list_entry entry = { .path = NULL, .type = S_IFREG, .checked = FALSE, .include = NULL, .scan = NULL };
+		if (format == PFS_LIST_FORMAT_PLS) {
+			entry.path = pfs_list_get_location_path (data, list->relative_base, path, FALSE);
+			if (entry.path == NULL) {
+				skipped++;
+				continue;
+			}
+		}
+		else if (0 == strncmp (path, PFS_LIST_DIRECTIVE_INCLUDE, include_length)) {
+			entry.include = pfs_list_loader_request_include (loader, list, path + include_length);
+			if (entry.include == NULL) {
+				skipped++;
+				continue;
+			}
+		}
+		else if (0 == strncmp (path, PFS_LIST_DIRECTIVE_DIRECTORY, directory_length)) {
+			entry.scan = pfs_list_loader_request_scan (loader, list, path + directory_length, FALSE);
+			if (entry.scan == NULL) {
+				skipped++;
+				continue;
+			}
+		}
+		else if (0 == strncmp (path, PFS_LIST_DIRECTIVE_DIRECTORY_RECURSIVE, recursive_length)) {
+			entry.scan = pfs_list_loader_request_scan (loader, list, path + recursive_length, TRUE);
+			if (entry.scan == NULL) {
+				skipped++;
+				continue;
+			}
+		}
+		else if (format == PFS_LIST_FORMAT_M3U) {
+			// Other lines starting with "#" are comments or extended info, like #EXTINF.
+			if (path[0] == '#') {
+				continue;
+			}
+			entry.path = pfs_list_get_location_path (data, list->relative_base, path, FALSE);
+			if (entry.path == NULL) {
+				skipped++;
+				continue;
+			}
+		}
+		else {
+			entry.path = pfs_list_get_full_path (data, list->relative_base, path);
+			if (entry.path == NULL) {
+				skipped++;
+				continue;
+			}
+		}
+		g_array_append_val (list->entries, entry);
+	}
+
+	if (ferror (file)) {
+		// Entries read so far are still used.
+		printwarnf ("error when reading list '%s'", list->path);
+	}
+	fclose (file);
+	pfs_stats_count (PFS_COUNTER_SYSCALLS, 1);
+	pfs_stats_count (PFS_COUNTER_LINES_READ, lines);
+	pfs_stats_count (PFS_COUNTER_ENTRIES_SKIPPED, skipped);
+}
+
+static pfs_list* pfs_list_loader_request_include (
+	pfs_list_loader* loader, pfs_list* list, const char* path
+) {
+	pfs_data* data = loader->data;
+	char* full_path = pfs_list_get_full_path (data, list->relative_base, path);
+	if (full_path == NULL) {
+		return NULL;
+	}
+	pfs_list* include = pfs_list_loader_request (loader, full_path);
+	g_free (full_path);
+	return include;
+}
+
+/*
+---- Playlist formats ----
+*/
+
+static pfs_list_format pfs_list_format_from_name (
+	const char* path
+) {
+	const char* extension = strrchr (path, '.');
+	if (extension == NULL || strchr (extension, '/') != NULL) {
+		return PFS_LIST_FORMAT_NATIVE;
+	}
+	if (0 == g_ascii_strcasecmp (extension, ".m3u") || 0 == g_ascii_strcasecmp (extension, ".m3u8")) {
+		return PFS_LIST_FORMAT_M3U;
+	}
+	if (0 == g_ascii_strcasecmp (extension, ".pls")) {
+		return PFS_LIST_FORMAT_PLS;
+	}
+	if (0 == g_ascii_strcasecmp (extension, ".xspf")) {
+		return PFS_LIST_FORMAT_XSPF;
+	}
+	return PFS_LIST_FORMAT_NATIVE;
+}
+
+// Used when the name does not tell the format, the first line of a playlist usually does.
+static pfs_list_format pfs_list_format_from_content (
+	const char* line
+) {
+	if (g_str_has_prefix (line, "#EXTM3U")) {
+		return PFS_LIST_FORMAT_M3U;
+	}
+	if (0 == g_ascii_strncasecmp (line, "[playlist]", strlen ("[playlist]"))) {
+		return PFS_LIST_FORMAT_PLS;
+	}
+	if (g_str_has_prefix (line, "<?xml") || g_str_has_prefix (line, "<playlist")) {
+		return PFS_LIST_FORMAT_XSPF;
+	}
+	return PFS_LIST_FORMAT_NATIVE;
+}
+
+// Get the value of a "FileN=" line, or NULL for other lines.
+static char* pfs_list_pls_file (
+	char* line
+) {
+	if (0 != g_ascii_strncasecmp (line, "File", 4) || !g_ascii_isdigit (line[4])) {
+		return NULL;
+	}
+	char* value = line + 4;
+	while (g_ascii_isdigit (*value)) {
+		value++;
+	}
+	return *value == '=' ? value + 1 : NULL;
+}
+
+typedef struct {
+	pfs_list_loader* loader;
+	pfs_list* list;
+	GString* location; // Text of the current <location>
+	gboolean in_location; // Whether inside <location> of a <track>
+	gboolean track_located; // Whether the current <track> already had a <location>
+	gint skipped;
+} pfs_xspf_state;
+
+static void pfs_xspf_start_element (
+	GMarkupParseContext* context, const gchar* element,
+	const gchar** attribute_names, const gchar** attribute_values, gpointer state_pointer, GError** error
+) {
+	pfs_xspf_state* state = (pfs_xspf_state*) state_pointer;
+	if (0 == strcmp (element, "track")) {
+		state->track_located = FALSE;
+	}
+	else if (0 == strcmp (element, "location") && !state->track_located) {
+		// Playlist itself can have a <location> too, which is not a track.
+		const GSList* stack = g_markup_parse_context_get_element_stack (context);
+		if (stack->next != NULL && 0 == strcmp (stack->next->data, "track")) {
+			state->in_location = TRUE;
+			g_string_truncate (state->location, 0);
+		}
+	}
+}
+
+static void pfs_xspf_text (
+	GMarkupParseContext* context, const gchar* text, gsize length, gpointer state_pointer, GError** error
+) {
+	pfs_xspf_state* state = (pfs_xspf_state*) state_pointer;
+	if (state->in_location) {
+		g_string_append_len (state->location, text, length);
+	}
+}
+
+static void pfs_xspf_end_element (
+	GMarkupParseContext* context, const gchar* element, gpointer state_pointer, GError** error
+) {
+	pfs_xspf_state* state = (pfs_xspf_state*) state_pointer;
+	if (!state->in_location) {
+		return;
+	}
+	pfs_data* data = state->loader->data;
+	state->in_location = FALSE;
+	// Only the first location is used, others are alternatives for the same track.
+	state->track_located = TRUE;
+
+	pfs_list_entry entry = { .path = NULL, .type = S_IFREG, .checked = FALSE, .include = NULL, .scan = NULL };
+	g_strstrip (state->location->str);
+	entry.path = pfs_list_get_location_path (data, state->list->relative_base, state->location->str, TRUE);
+	if (entry.path == NULL) {
+		state->skipped++;
+		return;
+	}
+	g_array_append_val (state->list->entries, entry);
+}
+
+// Parsed in a single pass over fixed-size chunks, so memory does not grow with size of the playlist.
+static void pfs_list_read_xspf (
+	pfs_list_loader* loader, pfs_list* list, FILE* file, const char* head, gint* lines, gint* skipped
+) {
+	pfs_data* data = loader->data;
+	static const GMarkupParser parser = {
+		.start_element = pfs_xspf_start_element,
+		.end_element = pfs_xspf_end_element,
+		.text = pfs_xspf_text,
+	};
+	pfs_xspf_state state = {
+		.loader = loader,
+		.list = list,
+		.location = g_string_new (NULL),
+	};
+	GMarkupParseContext* context = g_markup_parse_context_new (
+		&parser, G_MARKUP_TREAT_CDATA_AS_TEXT | G_MARKUP_PREFIX_ERROR_POSITION, &state, NULL
+	);
+
+	// First line was already read to detect the format.
+	GError* error = NULL;
+	gboolean parsed = g_markup_parse_context_parse (context, head, -1, &error);
+	char* buffer = g_malloc (PFS_XSPF_BUFFER_SIZE);
+	size_t length;
+	while (parsed && (length = fread (buffer, 1, PFS_XSPF_BUFFER_SIZE, file)) > 0) {
+		pfs_stats_count (PFS_COUNTER_SYSCALLS, 1);
+		for (const char* line = buffer; (line = memchr (line, '\n', buffer + length - line)) != NULL; line++) {
+			(*lines)++;
+		}
+		parsed = g_markup_parse_context_parse (context, buffer, length, &error);
+	}
+	g_free (buffer);
+	if (parsed && !ferror (file)) {
+		parsed = g_markup_parse_context_end_parse (context, &error);
+	}
+	if (!parsed) {
+		// Entries read so far are still used.
+		printwarnf ("error when parsing list '%s': %s", list->path, error->message);
+		g_error_free (error);
+	}
+
+	g_markup_parse_context_free (context);
+	g_string_free (state.location, TRUE);
+	*skipped += state.skipped;
+}
+
+/*
+---- Directory scanning ----
+*/
+
+static pfs_scan* pfs_list_loader_request_scan (
+	pfs_list_loader* loader, pfs_list* list, const char* path, gboolean recursive
+) {
+	pfs_data* data = loader->data;
+	char* full_path = pfs_list_get_full_path (data, list->relative_base, path);
+	if (full_path == NULL) {
+		return NULL;
+	}
+
+	pfs_scan* scan = g_malloc0 (sizeof (*scan));
+	scan->recursive = recursive;
+	// A pattern can only be in the last component, "dir/*/file" is not supported.
+	// Names like "Album [2001]" are common, so an existing path is never a pattern.
+	char* name = pfs_basename (full_path);
+	gboolean pattern = strpbrk (name, "*?[") != NULL;
+	if (pattern) {
+		pattern = access (full_path, F_OK) != 0;
+		pfs_stats_count (PFS_COUNTER_SYSCALLS, 1);
+	}
+	if (pattern) {
+		full_path[strlen (full_path) - strlen (name)] = '\0';
+		scan->pattern = name;
+	}
+	else {
+		g_free (name);
+	}
+	scan->root = pfs_scan_dir_new (scan, full_path);
+	g_free (full_path);
+
+	pfs_list_loader_schedule_scan (loader, scan->root);
+	return scan;
+}
+
+static void pfs_list_loader_schedule_scan (
+	pfs_list_loader* loader, pfs_scan_dir* dir
+) {
+	g_mutex_lock (&loader->lock);
+	loader->pending++;
+	g_thread_pool_push (loader->scan_pool, dir, NULL);
+	g_mutex_unlock (&loader->lock);
+}
+
+// Runs on the thread pool.
+static void pfs_list_loader_scan (
+	gpointer dir_pointer, gpointer loader_pointer
+) {
+	pfs_list_loader* loader = (pfs_list_loader*) loader_pointer;
+	pfs_scan_dir* dir = (pfs_scan_dir*) dir_pointer;
+	pfs_data* data = loader->data;
+
+	int fd = open (dir->path->str, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	pfs_stats_count (PFS_COUNTER_SYSCALLS, 1);
+	if (fd < 0) {
+		printwarnf ("directory '%s' could not be opened, skipping", dir->path->str);
+		pfs_stats_count (PFS_COUNTER_ENTRIES_INACCESSIBLE, 1);
+	}
+	else {
+		pfs_scan_dir_read (loader, dir, fd);
+		close (fd);
+		pfs_stats_count (PFS_COUNTER_SYSCALLS, 1);
+	}
+
+	pfs_list_loader_finish_task (loader);
+}
+
+static gint pfs_scan_compare_names (gconstpointer a, gconstpointer b) {
+	return strcmp (*(const char**) a, *(const char**) b);
+}
+
+static gint pfs_scan_compare_dirs (gconstpointer a, gconstpointer b) {
+	return strcmp ((*(pfs_scan_dir**) a)->path->str, (*(pfs_scan_dir**) b)->path->str);
+}
+
+static void pfs_scan_dir_read (
+	pfs_list_loader* loader, pfs_scan_dir* dir, int fd
+) {
+	pfs_data* data = loader->data;
+	pfs_scan* scan = dir->scan;
+	char* buffer = g_malloc (PFS_SCAN_BUFFER_SIZE);
+	gint syscalls = 1;
+
+	long length;
+	while ((length = syscall (SYS_getdents64, fd, buffer, PFS_SCAN_BUFFER_SIZE)) > 0) {
+		syscalls++;
+		for (long offset = 0; offset < length;) {
+			struct pfs_dirent64* dirent = (struct pfs_dirent64*) (buffer + offset);
+			offset += dirent->d_reclen;
+
+			const char* name = dirent->d_name;
+			if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+				continue;
+			}
+
+			// Most filesystems report the type, so stat is only needed as a fallback.
+			unsigned char type = dirent->d_type;
+			if (type == DT_UNKNOWN) {
+				struct stat filestat;
+				syscalls++;
+				if (0 != fstatat (fd, name, &filestat, AT_SYMLINK_NOFOLLOW)) {
+					continue;
+				}
+				type = S_ISDIR (filestat.st_mode) ? DT_DIR : DT_REG;
+			}
+
+			if (type == DT_DIR) {
+				if (scan->recursive) {
+					GString* subpath = g_string_new_len (dir->path->str, dir->path->len);
+					g_string_append (subpath, name);
+					pfs_scan_dir* subdir = pfs_scan_dir_new (scan, subpath->str);
+					g_string_free (subpath, TRUE);
+					g_ptr_array_add (dir->subdirs, subdir);
+					pfs_list_loader_schedule_scan (loader, subdir);
+				}
+			}
+			else if (scan->pattern == NULL || 0 == fnmatch (scan->pattern, name, FNM_PERIOD)) {
+				g_ptr_array_add (dir->files, g_strdup (name));
+			}
+		}
+	}
+	if (length < 0) {
+		printwarnf ("error when reading directory '%s'", dir->path->str);
+	}
+	g_free (buffer);
+	pfs_stats_count (PFS_COUNTER_SYSCALLS, syscalls);
+
+	// Sort to make the order (and so, overriding) independent of the filesystem.
+	g_ptr_array_sort (dir->files, pfs_scan_compare_names);
+	g_ptr_array_sort (dir->subdirs, pfs_scan_compare_dirs);
+}
+
+static gboolean pfs_list_expand_scan_dir (
+	pfs_list_loader* loader, pfs_scan_dir* dir, pfs_list_entry_func func, void* user_data
+) {
+	pfs_data* data = loader->data;
+	printinfof ("Adding directory '%s':", dir->path->str);
+
+	// Type was found out when scanning, no need to check files again.
+	pfs_list_entry entry = { .path = NULL, .type = S_IFREG, .checked = TRUE, .include = NULL, .scan = NULL };
+	GString* path = g_string_new_len (dir->path->str, dir->path->len);
+	gboolean result = TRUE;
+	for (size_t ifile = 0; ifile < dir->files->len && result; ifile++) {
+		g_string_truncate (path, dir->path->len);
+		g_string_append (path, g_ptr_array_index (dir->files, ifile));
+		entry.path = path->str;
+		result = func (data, &entry, user_data);
+	}
+	g_string_free (path, TRUE);
+
+	for (size_t idir = 0; idir < dir->subdirs->len && result; idir++) {
+		result = pfs_list_expand_scan_dir (loader, g_ptr_array_index (dir->subdirs, idir), func, user_data);
+	}
+	return result;
+}
+
+static pfs_scan_dir* pfs_scan_dir_new (
+	pfs_scan* scan, const char* path
+) {
+	pfs_scan_dir* dir = g_malloc0 (sizeof (*dir));
+	dir->scan = scan;
+	dir->path = g_string_new (path);
+	if (dir->path->len == 0 || dir->path->str[dir->path->len - 1] != '/') {
+		g_string_append_c (dir->path, '/');
+	}
+	dir->files = g_ptr_array_new_with_free_func (g_free);
+	dir->subdirs = g_ptr_array_new_with_free_func (pfs_scan_dir_free);
+	return dir;
+}
+
+static void pfs_scan_dir_free (
+	void* pointer
+) {
+	pfs_scan_dir* dir = (pfs_scan_dir*) pointer;
+	g_ptr_array_free (dir->subdirs, TRUE);
+	g_ptr_array_free (dir->files, TRUE);
+	g_string_free (dir->path, TRUE);
+	g_free (dir);
+}
+
+/*
+---- Other helpers ----
+*/
+
+static GString* pfs_list_get_relative_base (
+	pfs_data* data, GString* cwd, const char* listpath
+) {
+	GString* relative_base = NULL;
+	char* dirpath = pfs_dirname (listpath);
+	if (dirpath == NULL) {
+		printwarnf ("Could not determine directory for list '%s', relative paths will be ignored", listpath);
+	}
+	else {
+		if (dirpath[0] == '/') {
+			relative_base = g_string_new (dirpath);
+			g_string_append_c (relative_base, '/');
+		}
+		else if (cwd) {
+			relative_base = g_string_new_len (cwd->str, cwd->len);
+			g_string_append (relative_base, dirpath);
+			g_string_append_c (relative_base, '/');
+		}
+		else {
+			printwarnf ("relative paths will be ignored for list '%s'", listpath);
+		}
+		g_free (dirpath);
+	}
+	return relative_base;
+}
+
+static void pfs_list_free (
+	void* pointer
+) {
+	pfs_list* list = (pfs_list*) pointer;
+	g_array_free (list->entries, TRUE);
+	if (list->relative_base) {
+		g_string_free (list->relative_base, TRUE);
+	}
+	g_free (list->real_path);
+	g_free (list->path);
+	g_free (list);
+}
+
+static void pfs_list_clear_entry (
+	void* pointer
+) {
+	pfs_list_entry* entry = (pfs_list_entry*) pointer;
+	g_clear_pointer (&entry->path, g_free);
+	if (entry->scan) {
+		pfs_scan_dir_free (entry->scan->root);
+		g_free (entry->scan->pattern);
+		g_clear_pointer (&entry->scan, g_free);
+	}
+}
+
+/*
+---- Paths ----
+*/
+
+char* pfs_list_get_full_path (
+	pfs_data* data, GString* relative_base, const char* path
+) {
+	size_t length = strnlen (path, PATH_MAX);
+	if (length == 0) {
+		printwarn ("empty filename, ignoring");
+		return NULL;
+	}
+
+	if (path[0] == '/') {
+		return pfs_list_get_full_path_from_absolute (data, path);
+	}
+	else {
+		return pfs_list_get_full_path_from_relative (data, relative_base, path, length);
+	}
+}
+
+gboolean pfs_list_split_slice (
+	char* path, off_t* offset, off_t* length
+) {
+	char* separator = strrchr (path, PFS_LIST_SLICE_SEPARATOR);
+	if (separator == NULL || separator == path || separator[-1] == '/') {
+		return FALSE;
+	}
+	// Only digits are allowed, so that names which merely contain the separator are kept.
+	guint64 values[2];
+	const char* current = separator + 1;
+	for (int ivalue = 0; ivalue < 2; ivalue++) {
+		if (!g_ascii_isdigit (*current)) {
+			return FALSE;
+		}
+		char* end;
+		values[ivalue] = g_ascii_strtoull (current, &end, 10);
+		if (values[ivalue] > G_MAXINT64 || *end != (ivalue == 0 ? ',' : '\0')) {
+			return FALSE;
+		}
+		current = end + 1;
+	}
+	*offset = (off_t) values[0];
+	*length = (off_t) values[1];
+	*separator = '\0';
+	return TRUE;
+}
+
+// Playlists of players can contain URIs, which must be local files, and paths.
+// Paths in XSPF are URI references, so they are percent-encoded.
+static char* pfs_list_get_location_path (
+	pfs_data* data, GString* relative_base, const char* location, gboolean escaped
+) {
+	char* full_path = NULL;
+	char* scheme = g_uri_parse_scheme (location);
+	if (scheme != NULL && 0 == g_ascii_strcasecmp (scheme, "file")) {
+		char* path = g_filename_from_uri (location, NULL, NULL);
+		if (path == NULL) {
+			printwarnf ("invalid file URI '%s', ignoring", location);
+		}
+		else {
+			full_path = pfs_list_get_full_path (data, relative_base, path);
+			g_free (path);
+		}
+	}
+	else if (scheme != NULL) {
+		printinfof ("Ignoring non-local location '%s'", location);
+	}
+	else if (escaped) {
+		char* path = g_uri_unescape_string (location, NULL);
+		if (path == NULL) {
+			printwarnf ("invalid location '%s', ignoring", location);
+		}
+		else {
+			full_path = pfs_list_get_full_path (data, relative_base, path);
+			g_free (path);
+		}
+	}
+	else {
+		full_path = pfs_list_get_full_path (data, relative_base, location);
+	}
+	g_free (scheme);
+	return full_path;
+}
+
+static char* pfs_list_get_full_path_from_absolute (
+	pfs_data* data, const char* path
+) {
+	// Absolute paths are already complete, they only need to be normalized.
+	// We could call realpath(), but it can fail for overly long paths,
+	// and it would resolve symlinks, which should be kept as they are.
+	return pfs_normalize_path (path);
+}
+
+static char* pfs_list_get_full_path_from_relative (
+	pfs_data* data, GString* relative_base, const char* path, size_t length
+) {
+	char* full_path = NULL;
+
+	// Relative paths need more checks and handling.
+	if (relative_base == NULL) {
+		printinfof ("Ignoring relative path '%s'", path);
+	}
+	else if (relative_base->len + length >= PATH_MAX) {
+		printwarn ("filename too long, ignoring");
+	}
+	else {
+		char* joined_path = g_malloc (sizeof (*joined_path) * (relative_base->len + length + 1));
+		strcpy (joined_path, relative_base->str);
+		strcpy (joined_path + relative_base->len, path);
+		// Lists often refer to files with "../", which should not be walked every time.
+		full_path = pfs_normalize_path (joined_path);
+		g_free (joined_path);
+	}
+	return full_path;
+}
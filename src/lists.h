@@ -0,0 +1,144 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PLAYLISTFS_LISTS_H
+#define PLAYLISTFS_LISTS_H
+
+#include "playlistfs.h"
+
+#include <glib.h>
+
+/*
+Lines starting with this are not paths, but paths to other lists to include.
+*/
+#define PFS_LIST_DIRECTIVE_INCLUDE "#include "
+/*
+Lines starting with these are paths to directories, whose files are added.
+The last component of the path can be a glob pattern to filter files with.
+*/
+#define PFS_LIST_DIRECTIVE_DIRECTORY "#directory "
+#define PFS_LIST_DIRECTIVE_DIRECTORY_RECURSIVE "#directory-recursive "
+
+/*
+A path ending with this, followed by "OFFSET,LENGTH" in bytes, is a slice of the file.
+*/
+#define PFS_LIST_SLICE_SEPARATOR '#'
+
+/*
+Besides native lists, M3U/M3U8, PLS and XSPF playlists are read,
+detected by extension or by the first line.
+*/
+
+typedef struct pfs_list pfs_list;
+typedef struct pfs_list_loader pfs_list_loader;
+typedef struct pfs_scan pfs_scan;
+typedef struct pfs_scan_dir pfs_scan_dir;
+
+typedef struct {
+	char* path; // Full path to the file, NULL for includes and directories
+	mode_t type; // Type of record, as in pfs_file_entry
+	gboolean checked; // Whether the file is known to exist and not be a directory
+	pfs_list* include; // Included list, NULL for files
+	pfs_scan* scan; // Scanned directory, NULL for files
+} pfs_list_entry;
+
+struct pfs_scan {
+	char* pattern; // Glob pattern for file names, NULL to add everything
+	gboolean recursive; // Whether to descend into subdirectories
+	pfs_scan_dir* root;
+};
+
+struct pfs_scan_dir {
+	pfs_scan* scan;
+	GString* path; // Full path to the directory, with trailing "/"
+	GPtrArray* files; // Names of files, sorted once scanned
+	GPtrArray* subdirs; // pfs_scan_dir*, sorted by path once scanned
+};
+
+struct pfs_list {
+	char* path; // Path as it was specified, used in messages
+	char* real_path; // Canonical path, NULL if the list is inaccessible
+	GString* relative_base; // Base for relative paths, NULL if they are ignored
+	GArray* entries; // pfs_list_entry, in order of appearance
+	gboolean readable; // Whether the list could be opened
+	gboolean expanding; // Set while the list is being expanded, to detect cycles
+};
+
+/*
+Called for every file entry, in order, when expanding a list.
+Return FALSE to stop the expansion.
+*/
+typedef gboolean (*pfs_list_entry_func) (pfs_data* data, pfs_list_entry* entry, void* user_data);
+
+/*
+Create a loader, which reads lists in parallel on a thread pool.
+Lists are read once, no matter how many times they are included.
+@parameter data: Global data, used for options and messages
+@parameter cwd: Current working directory (with trailing "/"), or NULL
+*/
+pfs_list_loader* pfs_list_loader_new (pfs_data* data, GString* cwd);
+
+/*
+Schedule a list to be read, unless it was already requested.
+Returns the list, which will be filled by the time pfs_list_loader_wait() returns.
+@parameter loader: The loader
+@parameter path: Path to the list, relative paths are resolved against cwd
+*/
+pfs_list* pfs_list_loader_request (pfs_list_loader* loader, const char* path);
+
+/*
+Wait until all requested lists (including lists included by them) are read.
+*/
+void pfs_list_loader_wait (pfs_list_loader* loader);
+
+/*
+Walk a list in order, recursing into includes at their position.
+Includes which would form a cycle are skipped with a warning.
+Scanned directories produce their files in name order, followed by subdirectories.
+Returns FALSE if func returned FALSE.
+*/
+gboolean pfs_list_loader_expand (
+	pfs_list_loader* loader, pfs_list* list, pfs_list_entry_func func, void* user_data
+);
+
+/*
+Free the loader and all lists it has read.
+*/
+void pfs_list_loader_free (pfs_list_loader* loader);
+
+/*
+Make a full path for a file, taking into account whether it is relative.
+Returns NULL (after printing a message) if path should be ignored.
+Returned string must be g_free()'d by the caller.
+@parameter data: Global data, used for options and messages
+@parameter relative_base: Base for relative paths (with trailing "/"), or NULL
+@parameter path: Path to a file
+*/
+char* pfs_list_get_full_path (pfs_data* data, GString* relative_base, const char* path);
+
+/*
+Check if a path refers to a slice of a file, like "image.bin#1024,4096".
+If it does, the suffix is cut from path in place.
+Returns TRUE if path was a slice.
+@parameter path: Path to a file, changed if it is a slice
+@parameter offset: Where to put offset of the slice
+@parameter length: Where to put length of the slice
+*/
+gboolean pfs_list_split_slice (char* path, off_t* offset, off_t* length);
+
+#endif // PLAYLISTFS_LISTS_H
@@ -0,0 +1,311 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64 // Same off_t as in playlistfs.h
+
+#include "mapcache.h"
+
+#include <errno.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+typedef struct {
+	GList link; // In lru, data points to the window itself
+	pfs_diskcache_key key; // Key and index identify the window in windows
+	guint64 index; // Offset of the window in the file, in windows
+	char* address; // NULL if the file turned out to be truncated, then the window is never mapped again
+	size_t length;
+	guint users; // Reads copying from the window right now
+	gboolean evicted; // Removed from the cache while in use, unmapped by the last user
+} pfs_mapcache_window;
+
+struct pfs_mapcache {
+	guint64 budget;
+	GMutex lock; // Protects fields below
+	GHashTable* windows; // Set of pfs_mapcache_window*
+	GQueue lru; // Most recently used first
+	guint64 mapped; // Total length of windows in the cache
+	guint64 reads; // Reads served from windows only, each of them saves a pread()
+	guint64 bytes; // Bytes copied from windows
+	guint64 maps; // Windows mapped, each costs an mmap() and a munmap()
+	guint64 truncated; // Windows dropped after SIGBUS
+};
+
+// Set while a thread copies from a window, so that SIGBUS jumps back instead of killing the process.
+// Volatile, as the compiler does not know that memcpy() may jump to the handler, which reads it.
+static _Thread_local sigjmp_buf* volatile copy_jump = NULL;
+static struct sigaction previous_sigbus;
+static gsize sigbus_installed = 0;
+
+static void pfs_mapcache_sigbus (
+	int number, siginfo_t* info, void* context
+) {
+	if (copy_jump != NULL) {
+		siglongjmp (*copy_jump, 1);
+	}
+	// Not caused by copying from a window: the fault repeats with the previous handler.
+	sigaction (SIGBUS, &previous_sigbus, NULL);
+	if (info->si_code <= 0) {
+		// Sent by a process, not by a fault.
+		raise (number);
+	}
+}
+
+/*
+Copy from a window. Returns FALSE if the file was truncated and the window reaches past its end.
+SIGBUS is not blocked in the handler (SA_NODEFER), so the signal mask does not need restoring.
+*/
+static gboolean pfs_mapcache_copy (
+	char* buf, const char* source, size_t size
+) {
+	sigjmp_buf jump;
+	if (sigsetjmp (jump, 0) != 0) {
+		copy_jump = NULL;
+		return FALSE;
+	}
+	copy_jump = &jump;
+	memcpy (buf, source, size);
+	copy_jump = NULL;
+	return TRUE;
+}
+
+static guint pfs_mapcache_window_hash (
+	gconstpointer pointer
+) {
+	const pfs_mapcache_window* window = pointer;
+	guint64 hash = (guint64) window->key.ino * 0x9e3779b97f4a7c15ULL;
+	hash ^= (guint64) window->key.dev + (window->index << 32) + (guint64) window->key.mtime.tv_nsec;
+	return (guint) (hash ^ (hash >> 32));
+}
+
+static gboolean pfs_mapcache_window_equal (
+	gconstpointer a, gconstpointer b
+) {
+	const pfs_mapcache_window* window1 = a;
+	const pfs_mapcache_window* window2 = b;
+	return window1->index == window2->index
+		&& window1->key.ino == window2->key.ino
+		&& window1->key.dev == window2->key.dev
+		&& window1->key.size == window2->key.size
+		&& window1->key.mtime.tv_sec == window2->key.mtime.tv_sec
+		&& window1->key.mtime.tv_nsec == window2->key.mtime.tv_nsec;
+}
+
+static void pfs_mapcache_window_free (
+	pfs_mapcache_window* window
+) {
+	if (window->address != NULL)
+		munmap (window->address, window->length);
+	g_free (window);
+}
+
+/*
+Remove a window from the cache. Returns the window if it should be freed
+by the caller after unlocking, NULL if it is still in use.
+Must be called with the lock held.
+*/
+static pfs_mapcache_window* pfs_mapcache_remove_locked (
+	pfs_mapcache* cache, pfs_mapcache_window* window
+) {
+	g_queue_unlink (&cache->lru, &window->link);
+	g_hash_table_remove (cache->windows, window);
+	if (window->address != NULL)
+		cache->mapped -= window->length;
+	if (window->users > 0) {
+		window->evicted = TRUE;
+		return NULL;
+	}
+	return window;
+}
+
+/*
+Get a window for reading, mapping it if it is not mapped yet.
+Returns NULL if it can not be mapped, or the file was found to be truncated.
+*/
+static pfs_mapcache_window* pfs_mapcache_acquire (
+	pfs_mapcache* cache, const pfs_diskcache_key* key, int fd, guint64 index
+) {
+	pfs_mapcache_window lookup = { .key = *key, .index = index };
+	g_mutex_lock (&cache->lock);
+	pfs_mapcache_window* window = g_hash_table_lookup (cache->windows, &lookup);
+	if (window != NULL) {
+		g_queue_unlink (&cache->lru, &window->link);
+		g_queue_push_head_link (&cache->lru, &window->link);
+		if (window->address != NULL)
+			window->users++;
+		g_mutex_unlock (&cache->lock);
+		return window->address != NULL ? window : NULL;
+	}
+	g_mutex_unlock (&cache->lock);
+
+	// Mapped without the lock, so that other reads go on meanwhile.
+	off_t start = (off_t) index * PFS_MAPCACHE_WINDOW_SIZE;
+	size_t length = MIN ((off_t) PFS_MAPCACHE_WINDOW_SIZE, key->size - start);
+	void* address = mmap (NULL, length, PROT_READ, MAP_SHARED, fd, start);
+	if (address == MAP_FAILED) {
+		return NULL;
+	}
+	window = g_malloc0 (sizeof (*window));
+	window->link.data = window;
+	window->key = *key;
+	window->index = index;
+	window->address = address;
+	window->length = length;
+	window->users = 1;
+
+	GList* unused = NULL;
+	g_mutex_lock (&cache->lock);
+	pfs_mapcache_window* existing = g_hash_table_lookup (cache->windows, window);
+	if (existing != NULL) {
+		// Another thread has mapped the same window in the meantime.
+		unused = g_list_prepend (unused, window);
+		window = existing->address != NULL ? existing : NULL;
+		if (window != NULL)
+			window->users++;
+	}
+	else {
+		g_hash_table_add (cache->windows, window);
+		g_queue_push_head_link (&cache->lru, &window->link);
+		cache->mapped += length;
+		cache->maps++;
+		while (cache->mapped > cache->budget) {
+			pfs_mapcache_window* evicted = pfs_mapcache_remove_locked (cache, cache->lru.tail->data);
+			if (evicted != NULL)
+				unused = g_list_prepend (unused, evicted);
+		}
+	}
+	g_mutex_unlock (&cache->lock);
+	g_list_free_full (unused, (GDestroyNotify) pfs_mapcache_window_free);
+	return window;
+}
+
+/*
+Stop using a window.
+@parameter copied: Number of bytes copied from it, or -1 if copying hit the end of a truncated file
+@parameter completes: Whether this copy completed a read without touching the file
+*/
+static void pfs_mapcache_release (
+	pfs_mapcache* cache, pfs_mapcache_window* window, gssize copied, gboolean completes
+) {
+	pfs_mapcache_window* unused = NULL;
+	g_mutex_lock (&cache->lock);
+	window->users--;
+	if (copied < 0) {
+		cache->truncated++;
+		if (!window->evicted) {
+			// Kept in the cache unmapped, so that the file is read directly from now on.
+			g_hash_table_remove (cache->windows, window);
+			g_queue_unlink (&cache->lru, &window->link);
+			cache->mapped -= window->length;
+			pfs_mapcache_window* truncated = g_malloc0 (sizeof (*truncated));
+			truncated->link.data = truncated;
+			truncated->key = window->key;
+			truncated->index = window->index;
+			g_hash_table_add (cache->windows, truncated);
+			g_queue_push_head_link (&cache->lru, &truncated->link);
+			window->evicted = TRUE;
+		}
+	}
+	else {
+		cache->bytes += copied;
+		if (completes)
+			cache->reads++;
+	}
+	if (window->evicted && window->users == 0)
+		unused = window;
+	g_mutex_unlock (&cache->lock);
+	if (unused != NULL)
+		pfs_mapcache_window_free (unused);
+}
+
+pfs_mapcache* pfs_mapcache_new (guint64 budget) {
+	if (g_once_init_enter (&sigbus_installed)) {
+		struct sigaction action = { .sa_sigaction = pfs_mapcache_sigbus, .sa_flags = SA_SIGINFO | SA_NODEFER };
+		sigemptyset (&action.sa_mask);
+		sigaction (SIGBUS, &action, &previous_sigbus);
+		g_once_init_leave (&sigbus_installed, 1);
+	}
+	pfs_mapcache* cache = g_malloc0 (sizeof (*cache));
+	cache->budget = budget;
+	g_mutex_init (&cache->lock);
+	cache->windows = g_hash_table_new (pfs_mapcache_window_hash, pfs_mapcache_window_equal);
+	g_queue_init (&cache->lru);
+	return cache;
+}
+
+ssize_t pfs_mapcache_read (
+	pfs_mapcache* cache, const pfs_diskcache_key* key, int fd, char* buf, size_t size, off_t offset
+) {
+	size_t done = 0;
+	while (done < size && offset + (off_t) done < key->size) {
+		off_t position = offset + done;
+		guint64 index = position / PFS_MAPCACHE_WINDOW_SIZE;
+		pfs_mapcache_window* window = pfs_mapcache_acquire (cache, key, fd, index);
+		if (window == NULL) {
+			break;
+		}
+		size_t inside = position - (off_t) index * PFS_MAPCACHE_WINDOW_SIZE;
+		size_t length = MIN (size - done, window->length - inside);
+		gboolean copied = pfs_mapcache_copy (buf + done, window->address + inside, length);
+		pfs_mapcache_release (cache, window, copied ? (gssize) length : -1, copied && done + length == size);
+		if (!copied) {
+			break;
+		}
+		done += length;
+	}
+	if (done == size) {
+		return done;
+	}
+
+	// The rest is past the size the file had when it was opened, or could not be mapped.
+	ssize_t result = pread (fd, buf + done, size - done, offset + done);
+	if (result < 0) {
+		return done > 0 ? (ssize_t) done : -errno;
+	}
+	return done + result;
+}
+
+void pfs_mapcache_report (pfs_mapcache* cache, FILE* stream) {
+	g_mutex_lock (&cache->lock);
+	// Every window mapped is also unmapped at some point.
+	gint64 saved = (gint64) cache->reads - 2 * (gint64) cache->maps;
+	double gibibytes = cache->bytes / (1024.0 * 1024 * 1024);
+	fprintf (
+		stream, "Map cache: %" G_GUINT64_FORMAT " reads from %" G_GUINT64_FORMAT " MiB mapped in %" G_GUINT64_FORMAT
+		" windows, %" G_GUINT64_FORMAT " truncated; %" G_GINT64_FORMAT " syscalls saved (%.0f per GiB read)\n",
+		cache->reads, cache->bytes >> 20, cache->maps, cache->truncated,
+		saved, gibibytes > 0 ? saved / gibibytes : 0.0
+	);
+	g_mutex_unlock (&cache->lock);
+}
+
+void pfs_mapcache_free (pfs_mapcache* cache) {
+	for (GList* link = cache->lru.head; link != NULL; ) {
+		GList* next = link->next;
+		pfs_mapcache_window_free (link->data);
+		link = next;
+	}
+	g_hash_table_unref (cache->windows);
+	g_mutex_clear (&cache->lock);
+	g_free (cache);
+}
@@ -0,0 +1,74 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef PLAYLISTFS_MAPCACHE_H
+#define PLAYLISTFS_MAPCACHE_H
+
+#include "diskcache.h"
+
+#include <glib.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/*
+Memory mappings of big original files, so that reads are copied from them
+instead of calling pread() every time. Files are mapped in windows when they
+are first read, and least recently used windows are unmapped once mapped windows
+take more address space than the budget.
+Windows are tied to the version of a file when it is opened (same keys as in diskcache),
+so a changed file is mapped anew. If a file is truncated while it is open,
+copying from past its end raises SIGBUS, which is caught: the window is dropped
+and the read goes to the file. All functions except pfs_mapcache_new() and
+pfs_mapcache_free() can be called from any thread.
+*/
+typedef struct pfs_mapcache pfs_mapcache;
+
+// Size of a window, only the last window of a file is smaller.
+#define PFS_MAPCACHE_WINDOW_SIZE (16 * 1024 * 1024)
+// Smaller files are read with pread(), as mapping them costs more than it saves.
+#define PFS_MAPCACHE_MIN_FILE_SIZE (1024 * 1024)
+
+/*
+@parameter budget: Maximum total size of mapped windows, in bytes
+*/
+pfs_mapcache* pfs_mapcache_new (guint64 budget);
+
+/*
+Read from an original file through its mapped windows, mapping them as needed.
+Reads past the size in the key, or from a truncated file, go to the original file.
+Returns number of bytes read, or -errno.
+@parameter key: Key of the original file, from pfs_diskcache_key_from_fd()
+@parameter fd: Descriptor of the original file, opened for reading
+*/
+ssize_t pfs_mapcache_read (
+	pfs_mapcache* cache, const pfs_diskcache_key* key, int fd, char* buf, size_t size, off_t offset
+);
+
+/*
+Print reads served from mappings, windows mapped, and syscalls saved.
+@parameter stream: Stream to print to
+*/
+void pfs_mapcache_report (pfs_mapcache* cache, FILE* stream);
+
+/*
+Unmap all windows. Must not be called while reads are in progress.
+*/
+void pfs_mapcache_free (pfs_mapcache* cache);
+
+#endif // PLAYLISTFS_MAPCACHE_H
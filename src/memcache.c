@@ -0,0 +1,142 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64 // Same off_t as in playlistfs.h
+
+#include "memcache.h"
+
+typedef struct {
+	GList link; // In lru, data points to the entry itself
+	gint64 ino; // Key in entries
+	off_t size;
+	struct timespec mtime;
+	GBytes* contents;
+} pfs_memcache_entry;
+
+struct pfs_memcache {
+	guint64 budget;
+	GMutex lock; // Protects fields below
+	GHashTable* entries; // Inode number -> pfs_memcache_entry*
+	GQueue lru; // Most recently used first
+	guint64 used; // Total size of contents
+	guint64 hits;
+	guint64 misses;
+};
+
+static void pfs_memcache_entry_free (
+	void* pointer
+) {
+	pfs_memcache_entry* entry = pointer;
+	g_bytes_unref (entry->contents);
+	g_free (entry);
+}
+
+static inline gboolean pfs_memcache_entry_is_valid (
+	const pfs_memcache_entry* entry, const struct stat* filestat
+) {
+	return entry->size == filestat->st_size
+		&& entry->mtime.tv_sec == filestat->st_mtim.tv_sec
+		&& entry->mtime.tv_nsec == filestat->st_mtim.tv_nsec;
+}
+
+// Must be called with the lock held.
+static void pfs_memcache_remove_locked (
+	pfs_memcache* cache, pfs_memcache_entry* entry
+) {
+	g_queue_unlink (&cache->lru, &entry->link);
+	cache->used -= g_bytes_get_size (entry->contents);
+	g_hash_table_remove (cache->entries, &entry->ino);
+}
+
+pfs_memcache* pfs_memcache_new (guint64 budget) {
+	pfs_memcache* cache = g_malloc0 (sizeof (*cache));
+	cache->budget = budget;
+	g_mutex_init (&cache->lock);
+	cache->entries = g_hash_table_new_full (g_int64_hash, g_int64_equal, NULL, pfs_memcache_entry_free);
+	g_queue_init (&cache->lru);
+	return cache;
+}
+
+GBytes* pfs_memcache_lookup (pfs_memcache* cache, ino_t ino, const struct stat* filestat) {
+	gint64 key = ino;
+	GBytes* contents = NULL;
+	g_mutex_lock (&cache->lock);
+	pfs_memcache_entry* entry = g_hash_table_lookup (cache->entries, &key);
+	if (entry != NULL && pfs_memcache_entry_is_valid (entry, filestat)) {
+		g_queue_unlink (&cache->lru, &entry->link);
+		g_queue_push_head_link (&cache->lru, &entry->link);
+		contents = g_bytes_ref (entry->contents);
+		cache->hits++;
+	}
+	else {
+		if (entry != NULL) {
+			// The file has changed, its contents will be read again.
+			pfs_memcache_remove_locked (cache, entry);
+		}
+		cache->misses++;
+	}
+	g_mutex_unlock (&cache->lock);
+	return contents;
+}
+
+void pfs_memcache_insert (pfs_memcache* cache, ino_t ino, const struct stat* filestat, GBytes* contents) {
+	gsize size = g_bytes_get_size (contents);
+	if (size > cache->budget) {
+		return;
+	}
+	pfs_memcache_entry* entry = g_malloc0 (sizeof (*entry));
+	entry->link.data = entry;
+	entry->ino = ino;
+	entry->size = filestat->st_size;
+	entry->mtime = filestat->st_mtim;
+	entry->contents = g_bytes_ref (contents);
+
+	g_mutex_lock (&cache->lock);
+	// Another thread may have read the same file in the meantime.
+	pfs_memcache_entry* previous = g_hash_table_lookup (cache->entries, &entry->ino);
+	if (previous != NULL) {
+		pfs_memcache_remove_locked (cache, previous);
+	}
+	g_hash_table_insert (cache->entries, &entry->ino, entry);
+	g_queue_push_head_link (&cache->lru, &entry->link);
+	cache->used += size;
+	while (cache->used > cache->budget) {
+		// Contents still used by open files are freed when they are closed.
+		pfs_memcache_remove_locked (cache, cache->lru.tail->data);
+	}
+	g_mutex_unlock (&cache->lock);
+}
+
+void pfs_memcache_report (pfs_memcache* cache, FILE* stream) {
+	g_mutex_lock (&cache->lock);
+	guint64 lookups = cache->hits + cache->misses;
+	fprintf (
+		stream, "Memory cache: %" G_GUINT64_FORMAT " hits, %" G_GUINT64_FORMAT " misses (%.1f%% hit ratio), "
+		"%u files in %" G_GUINT64_FORMAT " KiB of %" G_GUINT64_FORMAT " KiB\n",
+		cache->hits, cache->misses, lookups > 0 ? 100.0 * cache->hits / lookups : 0.0,
+		g_hash_table_size (cache->entries), cache->used / 1024, cache->budget / 1024
+	);
+	g_mutex_unlock (&cache->lock);
+}
+
+void pfs_memcache_free (pfs_memcache* cache) {
+	g_hash_table_unref (cache->entries);
+	g_mutex_clear (&cache->lock);
+	g_free (cache);
+}
@@ -0,0 +1,69 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PLAYLISTFS_MEMCACHE_H
+#define PLAYLISTFS_MEMCACHE_H
+
+#include <glib.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+/*
+Cache of whole contents of small files in memory, so that opening and reading them
+again does not touch original files, besides checking that they have not changed.
+Entries are keyed by inode numbers of files inside the filesystem, and are valid
+while size and modification time of the original file stay the same.
+Least recently used entries are evicted over the budget. All functions except
+pfs_memcache_new() and pfs_memcache_free() can be called from any thread.
+*/
+typedef struct pfs_memcache pfs_memcache;
+
+// Only files up to this size are cached.
+#define PFS_MEMCACHE_MAX_FILE_SIZE (64 * 1024)
+
+/*
+@parameter budget: Maximum total size of cached contents, in bytes
+*/
+pfs_memcache* pfs_memcache_new (guint64 budget);
+
+/*
+Get contents of a file if they are cached and still valid. Counts a hit or a miss.
+Returns a new reference, or NULL.
+@parameter ino: Inode number of the file inside the filesystem
+@parameter filestat: Current status of the original file
+*/
+GBytes* pfs_memcache_lookup (pfs_memcache* cache, ino_t ino, const struct stat* filestat);
+
+/*
+Cache contents of a file, replacing older contents.
+@parameter ino: Inode number of the file inside the filesystem
+@parameter filestat: Status of the original file before contents were read
+@parameter contents: Contents, a new reference is taken
+*/
+void pfs_memcache_insert (pfs_memcache* cache, ino_t ino, const struct stat* filestat, GBytes* contents);
+
+/*
+Print hits, misses and memory used.
+@parameter stream: Stream to print to
+*/
+void pfs_memcache_report (pfs_memcache* cache, FILE* stream);
+
+void pfs_memcache_free (pfs_memcache* cache);
+
+#endif // PLAYLISTFS_MEMCACHE_H
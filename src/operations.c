@@ -17,14 +17,26 @@
  */
 
 #include "playlistfs.h"
+#include "concat.h"
+#include "control.h"
+#include "diskcache.h"
 #include "files.h"
+#include "frozen.h"
+#include "mapcache.h"
+#include "memcache.h"
+#include "probes.h"
+#include "watch.h"
+#include "xattrs.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/xattr.h>
+#include <stdint.h>
 #include <unistd.h>
 
 #if FUSE_USE_VERSION >= 30
@@ -56,8 +68,13 @@ static int pfs_truncate (const char *, off_t);
 static int pfs_open (const char *, struct fuse_file_info *);
 static int pfs_read (const char *, char *, size_t, off_t, struct fuse_file_info *);
 static int pfs_write (const char *, const char *, size_t, off_t, struct fuse_file_info *);
+static int pfs_flush (const char *, struct fuse_file_info *);
 static int pfs_release (const char *, struct fuse_file_info *);
 static int pfs_fsync (const char *, int, struct fuse_file_info *);
+static int pfs_setxattr (const char *, const char *, const char *, size_t, int);
+static int pfs_getxattr (const char *, const char *, char *, size_t);
+static int pfs_listxattr (const char *, char *, size_t);
+static int pfs_removexattr (const char *, const char *);
 static int pfs_opendir (const char *, struct fuse_file_info *);
 #if FUSE_USE_VERSION >= 30
 static int pfs_readdir (const char *, void *, fuse_fill_dir_t, off_t, struct fuse_file_info *, enum fuse_readdir_flags);
@@ -77,7 +94,172 @@ static int pfs_utimens (const char *, const struct timespec tv[2]);
 static int pfs_fallocate (const char *, int, off_t, off_t, struct fuse_file_info *);
 #if FUSE_USE_VERSION >= 30
 static off_t pfs_lseek (const char *, off_t, int, struct fuse_file_info *);
+static ssize_t pfs_copy_file_range (
+	const char *, struct fuse_file_info *, off_t, const char *, struct fuse_file_info *, off_t, size_t, int
+);
 #endif // pfs_lseek
+/*
+---- Tracing ----
+*/
+
+#ifdef PFS_SDT
+// Handlers are wrapped with entry and return probes. Being static, they are inlined into wrappers.
+#define PFS_OPERATION(name) pfs_traced_##name
+#define PFS_TRACED_CALL(name, type, path, size, offset, call) \
+	PFS_PROBE3 (name##_entry, path, (size_t) (size), (off_t) (offset)); \
+	type result = call; \
+	PFS_PROBE2 (name##_return, path, result); \
+	return result;
+
+#if FUSE_USE_VERSION >= 30
+static void* pfs_traced_init (struct fuse_conn_info* conn, struct fuse_config* cfg) {
+	PFS_PROBE0 (init_entry);
+	void* result = pfs_init (conn, cfg);
+	PFS_PROBE0 (init_return);
+	return result;
+}
+#else
+static void* pfs_traced_init (struct fuse_conn_info* conn) {
+	PFS_PROBE0 (init_entry);
+	void* result = pfs_init (conn);
+	PFS_PROBE0 (init_return);
+	return result;
+}
+#endif
+static void pfs_traced_destroy (void* private_data) {
+	PFS_PROBE0 (destroy_entry);
+	pfs_destroy (private_data);
+	PFS_PROBE0 (destroy_return);
+}
+static int pfs_traced_statfs (const char* path, struct statvfs* statbuf) {
+	PFS_TRACED_CALL (statfs, int, path, 0, 0, pfs_statfs (path, statbuf));
+}
+#if FUSE_USE_VERSION >= 30
+static int pfs_traced_getattr (const char* path, struct stat* statbuf, struct fuse_file_info* fi) {
+	PFS_TRACED_CALL (getattr, int, path, 0, 0, pfs_getattr (path, statbuf, fi));
+}
+#else
+static int pfs_traced_getattr (const char* path, struct stat* statbuf) {
+	PFS_TRACED_CALL (getattr, int, path, 0, 0, pfs_getattr (path, statbuf));
+}
+#endif
+static int pfs_traced_readlink (const char* path, char* buf, size_t size) {
+	PFS_TRACED_CALL (readlink, int, path, size, 0, pfs_readlink (path, buf, size));
+}
+static int pfs_traced_unlink (const char* path) {
+	PFS_TRACED_CALL (unlink, int, path, 0, 0, pfs_unlink (path));
+}
+static int pfs_traced_symlink (const char* path, const char* link) {
+	// The new name is the path in the filesystem, path is the target.
+	PFS_TRACED_CALL (symlink, int, link, 0, 0, pfs_symlink (path, link));
+}
+#if FUSE_USE_VERSION >= 30
+static int pfs_traced_rename (const char* path, const char* newpath, unsigned int flags) {
+	PFS_TRACED_CALL (rename, int, path, 0, 0, pfs_rename (path, newpath, flags));
+}
+#else
+static int pfs_traced_rename (const char* path, const char* newpath) {
+	PFS_TRACED_CALL (rename, int, path, 0, 0, pfs_rename (path, newpath));
+}
+#endif
+static int pfs_traced_link (const char* path, const char* newpath) {
+	PFS_TRACED_CALL (link, int, path, 0, 0, pfs_link (path, newpath));
+}
+#if FUSE_USE_VERSION >= 30
+static int pfs_traced_truncate (const char* path, off_t size, struct fuse_file_info* fi) {
+	PFS_TRACED_CALL (truncate, int, path, size, 0, pfs_truncate (path, size, fi));
+}
+#else
+static int pfs_traced_truncate (const char* path, off_t size) {
+	PFS_TRACED_CALL (truncate, int, path, size, 0, pfs_truncate (path, size));
+}
+#endif
+static int pfs_traced_open (const char* path, struct fuse_file_info* fi) {
+	PFS_TRACED_CALL (open, int, path, 0, 0, pfs_open (path, fi));
+}
+static int pfs_traced_read (const char* path, char* buf, size_t size, off_t offset, struct fuse_file_info* fi) {
+	PFS_TRACED_CALL (read, int, path, size, offset, pfs_read (path, buf, size, offset, fi));
+}
+static int pfs_traced_write (const char* path, const char* buf, size_t size, off_t offset, struct fuse_file_info* fi) {
+	PFS_TRACED_CALL (write, int, path, size, offset, pfs_write (path, buf, size, offset, fi));
+}
+static int pfs_traced_flush (const char* path, struct fuse_file_info* fi) {
+	PFS_TRACED_CALL (flush, int, path, 0, 0, pfs_flush (path, fi));
+}
+static int pfs_traced_release (const char* path, struct fuse_file_info* fi) {
+	PFS_TRACED_CALL (release, int, path, 0, 0, pfs_release (path, fi));
+}
+static int pfs_traced_fsync (const char* path, int datasync, struct fuse_file_info* fi) {
+	PFS_TRACED_CALL (fsync, int, path, 0, 0, pfs_fsync (path, datasync, fi));
+}
+static int pfs_traced_setxattr (const char* path, const char* name, const char* value, size_t size, int flags) {
+	PFS_TRACED_CALL (setxattr, int, path, size, 0, pfs_setxattr (path, name, value, size, flags));
+}
+static int pfs_traced_getxattr (const char* path, const char* name, char* value, size_t size) {
+	PFS_TRACED_CALL (getxattr, int, path, size, 0, pfs_getxattr (path, name, value, size));
+}
+static int pfs_traced_listxattr (const char* path, char* list, size_t size) {
+	PFS_TRACED_CALL (listxattr, int, path, size, 0, pfs_listxattr (path, list, size));
+}
+static int pfs_traced_removexattr (const char* path, const char* name) {
+	PFS_TRACED_CALL (removexattr, int, path, 0, 0, pfs_removexattr (path, name));
+}
+static int pfs_traced_opendir (const char* path, struct fuse_file_info* fi) {
+	PFS_TRACED_CALL (opendir, int, path, 0, 0, pfs_opendir (path, fi));
+}
+#if FUSE_USE_VERSION >= 30
+static int pfs_traced_readdir (
+	const char* path, void* buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info* fi, enum fuse_readdir_flags flags
+) {
+	PFS_TRACED_CALL (readdir, int, path, 0, offset, pfs_readdir (path, buf, filler, offset, fi, flags));
+}
+#else
+static int pfs_traced_readdir (const char* path, void* buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info* fi) {
+	PFS_TRACED_CALL (readdir, int, path, 0, offset, pfs_readdir (path, buf, filler, offset, fi));
+}
+#endif
+static int pfs_traced_releasedir (const char* path, struct fuse_file_info* fi) {
+	PFS_TRACED_CALL (releasedir, int, path, 0, 0, pfs_releasedir (path, fi));
+}
+static int pfs_traced_access (const char* path, int mode) {
+	PFS_TRACED_CALL (access, int, path, 0, 0, pfs_access (path, mode));
+}
+#if FUSE_USE_VERSION < 30
+static int pfs_traced_ftruncate (const char* path, off_t size, struct fuse_file_info* fi) {
+	PFS_TRACED_CALL (ftruncate, int, path, size, 0, pfs_ftruncate (path, size, fi));
+}
+static int pfs_traced_fgetattr (const char* path, struct stat* statbuf, struct fuse_file_info* fi) {
+	PFS_TRACED_CALL (fgetattr, int, path, 0, 0, pfs_fgetattr (path, statbuf, fi));
+}
+#endif
+#if FUSE_USE_VERSION >= 30
+static int pfs_traced_utimens (const char* path, const struct timespec tv[2], struct fuse_file_info* fi) {
+	PFS_TRACED_CALL (utimens, int, path, 0, 0, pfs_utimens (path, tv, fi));
+}
+#else
+static int pfs_traced_utimens (const char* path, const struct timespec tv[2]) {
+	PFS_TRACED_CALL (utimens, int, path, 0, 0, pfs_utimens (path, tv));
+}
+#endif
+static int pfs_traced_fallocate (const char* path, int mode, off_t offset, off_t length, struct fuse_file_info* fi) {
+	PFS_TRACED_CALL (fallocate, int, path, length, offset, pfs_fallocate (path, mode, offset, length, fi));
+}
+#if FUSE_USE_VERSION >= 30
+static off_t pfs_traced_lseek (const char* path, off_t offset, int whence, struct fuse_file_info* fi) {
+	PFS_TRACED_CALL (lseek, off_t, path, 0, offset, pfs_lseek (path, offset, whence, fi));
+}
+static ssize_t pfs_traced_copy_file_range (
+	const char* path_in, struct fuse_file_info* fi_in, off_t offset_in,
+	const char* path_out, struct fuse_file_info* fi_out, off_t offset_out, size_t size, int flags
+) {
+	PFS_TRACED_CALL (copy_file_range, ssize_t, path_in, size, offset_in,
+		pfs_copy_file_range (path_in, fi_in, offset_in, path_out, fi_out, offset_out, size, flags));
+}
+#endif
+#else
+#define PFS_OPERATION(name) pfs_##name
+#endif // PFS_SDT
+
 /*
 This struct is exported to playlistfs.c.
 
@@ -85,53 +267,53 @@ Allowed operations. Unused ones are commented out,
 deprecated are not listed at all.
 */
 struct fuse_operations pfs_operations = {
-	.init = pfs_init, // These two are not necessarily useful
-	.destroy = pfs_destroy,
-	.statfs = pfs_statfs, // = statvfs
-	.getattr = pfs_getattr,
-	.readlink = pfs_readlink,// For symlink mode and symlinks in general
+	.init = PFS_OPERATION (init), // These two are not necessarily useful
+	.destroy = PFS_OPERATION (destroy),
+	.statfs = PFS_OPERATION (statfs), // = statvfs
+	.getattr = PFS_OPERATION (getattr),
+	.readlink = PFS_OPERATION (readlink),// For symlink mode and symlinks in general
 	//.mknod = pfs_mknod, // No file creation. Regular files should use .create anyway
 	//.mkdir = pfs_mkdir,
 	//.rmdir = pfs_rmdir,
-	.unlink = pfs_unlink,
-	.symlink = pfs_symlink,
-	.rename = pfs_rename,
-	.link = pfs_link,
+	.unlink = PFS_OPERATION (unlink),
+	.symlink = PFS_OPERATION (symlink),
+	.rename = PFS_OPERATION (rename),
+	.link = PFS_OPERATION (link),
 	//.chmod = pfs_chmod, // Maybe these two should not actually be allowed?
 	//.chown = pfs_chown,
-	.truncate = pfs_truncate,
-	.open = pfs_open,
-	.read = pfs_read,
-	.write = pfs_write,
-	//.flush = pfs_flush,
-	.release = pfs_release, // Files need to be closed
-	.fsync = pfs_fsync,
-	//.setxatr = pfs_setxattr, // These four will not be defined for now
-	//.getxattr = pfs_getxattr,
-	//.listxattr = pfs_listxattr,
-	//.removexattr = pfs_removexattr,
-	.opendir = pfs_opendir,
-	.readdir = pfs_readdir,
-	.releasedir = pfs_releasedir, // Directories also need to be closed, or do they?
+	.truncate = PFS_OPERATION (truncate),
+	.open = PFS_OPERATION (open),
+	.read = PFS_OPERATION (read),
+	.write = PFS_OPERATION (write),
+	.flush = PFS_OPERATION (flush), // Reports delayed write errors on close()
+	.release = PFS_OPERATION (release), // Files need to be closed
+	.fsync = PFS_OPERATION (fsync),
+	.setxattr = PFS_OPERATION (setxattr), // Passed to original files
+	.getxattr = PFS_OPERATION (getxattr),
+	.listxattr = PFS_OPERATION (listxattr),
+	.removexattr = PFS_OPERATION (removexattr),
+	.opendir = PFS_OPERATION (opendir),
+	.readdir = PFS_OPERATION (readdir),
+	.releasedir = PFS_OPERATION (releasedir), // Directories also need to be closed, or do they?
 	//.fsyncdir = pfs_fsyncdir, //Can be called on root, probably
-	.access = pfs_access, // default_permissions negates the need for this
+	.access = PFS_OPERATION (access), // default_permissions negates the need for this
 	//.create = pfs_create, // No file creation
 	#if FUSE_USE_VERSION < 30
-	.ftruncate = pfs_ftruncate,
-	.fgetattr = pfs_fgetattr,
+	.ftruncate = PFS_OPERATION (ftruncate),
+	.fgetattr = PFS_OPERATION (fgetattr),
 	#endif
 	//.lock = pfs_lock, // Implemented by kernel (not needed for local FS)
-	.utimens = pfs_utimens, // Use utimensat
+	.utimens = PFS_OPERATION (utimens), // Use utimensat
 	//.bmap = pfs_bmap, // This FS is not backed by a device
 	//.ioctl = pfs_ioctl,
 	//.poll = pfs_poll,
 	//.write_buf = pfs_write_buf, // Unclear that these do
 	//.read_buf = pfs_read_buf,
 	//.flock = pfs_flock, //The same as lock()
-	.fallocate = pfs_fallocate,
+	.fallocate = PFS_OPERATION (fallocate),
 	#if FUSE_USE_VERSION >= 30
-	// .copy_file_range = pfs_copy_file_range,
-	.lseek = pfs_lseek,
+	.copy_file_range = PFS_OPERATION (copy_file_range), // Lets original file systems copy without reading
+	.lseek = PFS_OPERATION (lseek),
 	#endif
 	#if FUSE_USE_VERSION < 30
 	.flag_nullpath_ok = 0,
@@ -140,21 +322,226 @@ struct fuse_operations pfs_operations = {
 	#endif
 };
 
-static ino_t root_ino;
+// Shared by all filesystems in server mode.
+static gsize root_ino = 0;
+
+/*
+Start reading the file table. A frozen table is used without locking,
+otherwise filetable_lock is taken for reading.
+Returns the frozen table or NULL, which must then be passed to pfs_lookup() and pfs_read_end().
+*/
+static const pfs_frozen* pfs_read_begin (pfs_data* data) {
+	const pfs_frozen* frozen = g_atomic_pointer_get (&data->frozen);
+	if (frozen == NULL)
+		g_rw_lock_reader_lock (&data->filetable_lock);
+	return frozen;
+}
+
+static void pfs_read_end (pfs_data* data, const pfs_frozen* frozen) {
+	if (frozen == NULL)
+		g_rw_lock_reader_unlock (&data->filetable_lock);
+}
+
+/*
+With --fanout, the root only has subdirectories named by two hex digits, one for each part
+of the file table, and every file is in the subdirectory of its part.
+Directories get fixed inode numbers below those of files.
+*/
+#define PFS_PATH_ROOT -1
+#define PFS_PATH_NOT_DIR -2
+#define PFS_FANOUT_INO_BASE ((ino_t) 256)
+
+static inline int pfs_path_hex_digit (char digit) {
+	if (digit >= '0' && digit <= '9')
+		return digit - '0';
+	if (digit >= 'a' && digit <= 'f')
+		return digit - 'a' + 10;
+	return -1;
+}
+
+// Part of the file table named by two hex digits, or -1.
+static int pfs_path_part (const pfs_data* data, const char* digits) {
+	if (!data->opts.fanout || digits[0] == '\0')
+		return -1;
+	int high = pfs_path_hex_digit (digits[0]);
+	int low = pfs_path_hex_digit (digits[1]);
+	if (high < 0 || low < 0)
+		return -1;
+	return high * 16 + low;
+}
+
+/*
+Check whether a path is a directory. Returns PFS_PATH_ROOT for the root,
+the part of the file table listed by a subdirectory with --fanout, or PFS_PATH_NOT_DIR.
+*/
+static int pfs_path_dir (const pfs_data* data, const char* path) {
+	if (0 == strcmp (path, "/"))
+		return PFS_PATH_ROOT;
+	int part = pfs_path_part (data, path + 1);
+	if (part < 0 || path[3] != '\0')
+		return PFS_PATH_NOT_DIR;
+	return part;
+}
+
+static gboolean pfs_path_is_dir (const char* path) {
+	return pfs_path_dir (fuse_get_context ()->private_data, path) != PFS_PATH_NOT_DIR;
+}
+
+/*
+Get name of a file in the file table from its path inside the filesystem.
+Returns NULL if the path can not name a file: with --fanout, files are only in the subdirectory of their part.
+*/
+static const char* pfs_path_name (pfs_data* data, const char* path) {
+	// The path always starts with '/'
+	if (!data->opts.fanout)
+		return path + 1;
+	int part = pfs_path_part (data, path + 1);
+	if (part < 0 || path[3] != '/' || path[4] == '\0')
+		return NULL;
+	const char* name = path + 4;
+	if (pfs_table_part_of (data->filetable, name) != (guint) part)
+		return NULL;
+	return name;
+}
+
+/*
+Look up a file by its path inside the filesystem.
+If it is not there, but the playlist is still being loaded, wait for the loader.
+Must be called between pfs_read_begin() and pfs_read_end().
+*/
+static pfs_file* pfs_lookup (pfs_data* data, const pfs_frozen* frozen, const char* path) {
+	const char* name = pfs_path_name (data, path);
+	if (name == NULL)
+		return NULL;
+	if (frozen != NULL)
+		return pfs_frozen_lookup (frozen, name);
+	pfs_file* file = pfs_table_lookup (data->filetable, name);
+	if (file == NULL && g_atomic_int_get (&data->loader.running)) {
+		g_rw_lock_reader_unlock (&data->filetable_lock);
+		pfs_background_load_wait (data);
+		g_rw_lock_reader_lock (&data->filetable_lock);
+		file = pfs_table_lookup (data->filetable, name);
+	}
+	return file;
+}
+
+/*
+Lock the table for changing it. Changes are only made after the loader has finished,
+so that they are not overridden by files loaded later.
+Returns -EROFS without locking if the table is frozen.
+*/
+static int pfs_lock_for_change (pfs_data* data) {
+	pfs_background_load_wait (data);
+	if (g_atomic_pointer_get (&data->frozen) != NULL)
+		return -EROFS;
+	g_rw_lock_writer_lock (&data->filetable_lock);
+	return 0;
+}
+
+/*
+Handles of files which are not read from original files directly: slices, concatenated files
+and files read through --cache-dir, --memory-cache or --mmap-cache. They are opened read-only.
+*/
+typedef struct {
+	int fd; // Descriptor of original file, -1 for concatenated files and files read from memory
+	off_t offset; // Start of the slice in original file
+	off_t length; // Length of the slice, -1 for whole files
+	pfs_concat_reader* reader; // Reader of concatenated file, NULL for others
+	pfs_diskcache* diskcache; // Cache to read original file through, NULL if it is not cached
+	pfs_mapcache* mapcache; // Cache to read original file through mappings of, NULL if it is not mapped
+	pfs_diskcache_key key; // Version of original file when it was opened, for diskcache and mapcache
+	GBytes* contents; // Whole contents of a small file from memcache, NULL for others
+} pfs_handle;
+
+/*
+Pointers to pfs_handle are tagged with the top bit, which pointers never have in user space.
+Other handles are descriptors of original files.
+*/
+#define PFS_HANDLE_TAG ((uint64_t) 1 << 63)
+
+static inline pfs_handle* pfs_handle_get (const struct fuse_file_info* fi) {
+	if (!(fi->fh & PFS_HANDLE_TAG))
+		return NULL;
+	return (pfs_handle*) (uintptr_t) (fi->fh & ~PFS_HANDLE_TAG);
+}
+
+static inline void pfs_handle_set (struct fuse_file_info* fi, pfs_handle* handle) {
+	fi->fh = (uint64_t) (uintptr_t) handle | PFS_HANDLE_TAG;
+}
+
+// Descriptor of original file for a handle, -1 if there is no single one.
+static inline int pfs_handle_fd (const struct fuse_file_info* fi) {
+	pfs_handle* handle = pfs_handle_get (fi);
+	return handle == NULL ? (int) fi->fh : handle->fd;
+}
+
+// Concatenated files are read-only regular files owned by the user who mounted the filesystem.
+static void pfs_concat_getattr (const pfs_file* file, struct stat* statbuf) {
+	memset (statbuf, 0, sizeof (*statbuf));
+	statbuf->st_mode = S_IFREG | 0444;
+	statbuf->st_uid = getuid ();
+	statbuf->st_gid = getgid ();
+	statbuf->st_size = pfs_concat_size (file->concat);
+	statbuf->st_blksize = 4096;
+	statbuf->st_blocks = (statbuf->st_size + 511) / 512;
+	statbuf->st_atim = statbuf->st_ctim = statbuf->st_mtim = file->ts;
+}
 
 #if FUSE_USE_VERSION < 30
 static void* pfs_init (struct fuse_conn_info *conn) {
 #else
 static void* pfs_init (struct fuse_conn_info *conn, struct fuse_config *cfg) {
+#endif
+	if (g_once_init_enter (&root_ino)) {
+		g_once_init_leave (&root_ino, pfs_file_next_ino ());
+	}
+	pfs_data* data = fuse_get_context ()->private_data;
+	#if FUSE_USE_VERSION >= 30
 	// FUSE 2 uses options in argv for these, see playlistfs.c.
-	cfg->attr_timeout = 0.0;
+	if (data->opts.fuse.cache_timeout > 0) {
+		cfg->attr_timeout = data->opts.fuse.cache_timeout;
+		cfg->entry_timeout = data->opts.fuse.cache_timeout;
+	}
+	else {
+		cfg->attr_timeout = 0.0;
+	}
 	cfg->use_ino = 1;
-#endif
-	root_ino = pfs_file_next_ino ();
-	return fuse_get_context ()->private_data;
+	if (data->opts.fuse.writeback_cache) {
+		if (conn->capable & FUSE_CAP_WRITEBACK_CACHE) {
+			conn->want |= FUSE_CAP_WRITEBACK_CACHE;
+		}
+		else {
+			printwarn ("writeback cache is not supported by the kernel, ignoring");
+			data->opts.fuse.writeback_cache = FALSE;
+		}
+	}
+	// FUSE 2 gets these as options, see playlistfs.c.
+	if (data->opts.fuse.max_write > 0) {
+		conn->max_write = data->opts.fuse.max_write;
+	}
+	if (data->opts.fuse.max_background > 0) {
+		conn->max_background = data->opts.fuse.max_background;
+	}
+	if (data->opts.fuse.congestion_threshold > 0) {
+		conn->congestion_threshold = data->opts.fuse.congestion_threshold;
+	}
+	#endif
+	pfs_background_load_start (data);
+	pfs_watch_start (data, fuse_get_context ()->fuse);
+	pfs_control_start (data, fuse_get_context ()->fuse);
+	return data;
 }
 
 static void pfs_destroy (void* private_data) {
+	pfs_data* data = private_data;
+	if (data->memcache != NULL && data->opts.verbose)
+		pfs_memcache_report (data->memcache, pfs_messages (data));
+	if (data->mapcache != NULL && data->opts.verbose)
+		pfs_mapcache_report (data->mapcache, pfs_messages (data));
+	pfs_background_load_stop ((pfs_data*) private_data);
+	// Applying changes at --control may wake the watcher.
+	pfs_control_stop ((pfs_data*) private_data);
+	pfs_watch_stop ((pfs_data*) private_data);
 	pfs_free_pfs_data ((pfs_data*) private_data);
 }
 
@@ -174,23 +561,45 @@ static int pfs_getattr (const char* path, struct stat* statbuf, struct fuse_file
 		return pfs_fgetattr (path, statbuf, fi);
 	}
 #endif
-	if (0 == strcmp (path, "/")) {
+	struct fuse_context* context = fuse_get_context ();
+	pfs_data* data = context->private_data;
+	int dir = pfs_path_dir (data, path);
+	if (dir == PFS_PATH_ROOT) {
 		statbuf->st_mode = S_IFDIR | 0777;
-		statbuf->st_nlink = 2;
+		statbuf->st_nlink = data->opts.fanout ? 2 + pfs_table_parts (data->filetable) : 2;
 		statbuf->st_ino = root_ino;
 		return 0;
 	}
+	if (dir != PFS_PATH_NOT_DIR) {
+		statbuf->st_mode = S_IFDIR | 0777;
+		statbuf->st_nlink = 2;
+		statbuf->st_ino = PFS_FANOUT_INO_BASE + dir;
+		return 0;
+	}
 
-	struct fuse_context* context = fuse_get_context ();
-	pfs_data* data = context->private_data;
-	// The path always starts with '/'
-	pfs_file* file = g_hash_table_lookup (data->filetable, path + 1);
-	if (!file)
+	const pfs_frozen* frozen = pfs_read_begin (data);
+	pfs_file* file = pfs_lookup (data, frozen, path);
+	if (!file) {
+		pfs_read_end (data, frozen);
 		return -ENOENT;
-	if (!data->opts.symlinks && !S_ISLNK(file->type)) {
-		if (lstat (file->path->str, statbuf) < 0)
-			return -errno;
-		if (data->opts.fuse.ro)
+	}
+	if (file->concat != NULL) {
+		pfs_concat_getattr (file, statbuf);
+	}
+	else if (!S_ISLNK(file->type) && (!data->opts.symlinks || file->length >= 0)) {
+		int dirfd;
+		const char* name = pfs_file_at (file, &dirfd);
+		// Slices are only taken of regular files, but those can be behind symlinks.
+		if (fstatat (dirfd, name, statbuf, file->length >= 0 ? 0 : AT_SYMLINK_NOFOLLOW) < 0) {
+			int error = errno;
+			pfs_read_end (data, frozen);
+			return -error;
+		}
+		if (file->length >= 0) {
+			statbuf->st_size = file->length;
+			statbuf->st_blocks = (file->length + 511) / 512;
+		}
+		if (data->opts.fuse.ro || file->length >= 0)
 			statbuf->st_mode &= ~0222;
 		if (data->opts.fuse.noexec && S_ISREG(statbuf->st_mode))
 			statbuf->st_mode &= ~0111;
@@ -205,80 +614,110 @@ static int pfs_getattr (const char* path, struct stat* statbuf, struct fuse_file
 	}
 	statbuf->st_ino = file->ino;
 	statbuf->st_nlink = file->nlink;
+	pfs_read_end (data, frozen);
 	return 0;
 }
 
 static int pfs_readlink (const char* path, char* buf, size_t size) {
 	pfs_data* data = fuse_get_context ()->private_data;
-	pfs_file* file = g_hash_table_lookup (data->filetable, path + 1);
-	if (!file)
-		return -ENOENT;
-	if (S_ISLNK (file->type)) {
+	const pfs_frozen* frozen = pfs_read_begin (data);
+	pfs_file* file = pfs_lookup (data, frozen, path);
+	int result = 0;
+	if (!file) {
+		result = -ENOENT;
+	}
+	else if (file->concat != NULL) {
+		result = -EINVAL;
+	}
+	else if (S_ISLNK (file->type)) {
 		strncpy (buf, file->path->str, size);
 		buf[size - 1] = '\0';
 	}
 	else {
-		ssize_t length = readlink (file->path->str, buf, size-1);
+		int dirfd;
+		const char* name = pfs_file_at (file, &dirfd);
+		ssize_t length = readlinkat (dirfd, name, buf, size-1);
 		if (length < 0)
-			return -errno;
-		buf[length] = '\0';
+			result = -errno;
+		else
+			buf[length] = '\0';
 	}
-	return 0;
+	pfs_read_end (data, frozen);
+	return result;
 }
 
 static int pfs_unlink (const char* path) {
 	pfs_data* data = fuse_get_context ()->private_data;
 	pfs_file* file;
 	char* key;
-	if (!g_hash_table_lookup_extended (data->filetable, path + 1, (void**)&key, (void**) &file))
+	const char* name = pfs_path_name (data, path);
+	if (name == NULL)
+		return -ENOENT;
+	int locked = pfs_lock_for_change (data);
+	if (locked < 0)
+		return locked;
+	if (!pfs_table_lookup_extended (data->filetable, name, (void**) &key, (void**) &file)) {
+		g_rw_lock_writer_unlock (&data->filetable_lock);
 		return -ENOENT;
-	g_hash_table_steal (data->filetable, key);
+	}
+	pfs_table_steal (data->filetable, key);
 	g_free (key);
 	if (--file->nlink == 0) {
 		pfs_file_free (file);
 	}
+	g_rw_lock_writer_unlock (&data->filetable_lock);
 	return 0;
 }
 
 static int pfs_symlink (const char* path, const char* link) {
 	pfs_data* data = fuse_get_context ()->private_data;
-	if (g_hash_table_contains (data->filetable, link + 1))
-		return -EEXIST;
-	struct timespec now;
-	clock_gettime (CLOCK_REALTIME, &now);
-	pfs_file* file = pfs_file_create (path, S_IFLNK, &now);
-	if (file == NULL)
-		return -ENOSPC;
-	g_hash_table_insert (data->filetable, g_strdup(link + 1), file);
-	return 0;
+	// With --fanout, a name can only be created in the subdirectory of its part.
+	const char* name = pfs_path_name (data, link);
+	if (name == NULL)
+		return -EPERM;
+	int result = pfs_lock_for_change (data);
+	if (result < 0)
+		return result;
+	if (pfs_table_contains (data->filetable, name)) {
+		result = -EEXIST;
+	}
+	else {
+		struct timespec now;
+		clock_gettime (CLOCK_REALTIME, &now);
+		pfs_file* file = pfs_file_create (path, S_IFLNK, &now);
+		if (file == NULL)
+			result = -ENOSPC;
+		else
+			pfs_table_insert (data->filetable, g_strdup (name), file);
+	}
+	g_rw_lock_writer_unlock (&data->filetable_lock);
+	return result;
 }
 
 #if FUSE_USE_VERSION < 30
-static int pfs_rename (const char* path, const char* newpath) {
-	pfs_data* data = fuse_get_context ()->private_data;
+static int pfs_rename_locked (pfs_data* data, const char* name, const char* newname) {
 	pfs_file* file = NULL;
 	char* key = NULL;
 
-	if (!g_hash_table_lookup_extended (data->filetable, path + 1, (void**) &key, (void**) &file))
+	if (!pfs_table_lookup_extended (data->filetable, name, (void**) &key, (void**) &file))
 		return -ENOENT;
 
-	g_hash_table_steal (data->filetable, key);
+	pfs_table_steal (data->filetable, key);
 	g_free (key);
-	g_hash_table_insert (data->filetable, g_strdup (newpath+1), file);
+	pfs_table_insert (data->filetable, g_strdup (newname), file);
 	return 0;
 }
 #else
-static int pfs_rename (const char* path, const char* newpath, unsigned int flags) {
-	pfs_data* data = fuse_get_context ()->private_data;
+static int pfs_rename_locked (pfs_data* data, const char* name, const char* newname, unsigned int flags) {
 	pfs_file* file1 = NULL;
 	char* name1 = NULL;
 	pfs_file* file2 = NULL;
 	char* name2 = NULL;
 
-	if (!g_hash_table_lookup_extended (data->filetable, path + 1, (void**) &name1, (void**) &file1))
+	if (!pfs_table_lookup_extended (data->filetable, name, (void**) &name1, (void**) &file1))
 		return -ENOENT;
 	// All variants need to check the target in some way.
-	g_hash_table_lookup_extended (data->filetable, newpath + 1, (void**) &name2, (void**) &file2);
+	pfs_table_lookup_extended (data->filetable, newname, (void**) &name2, (void**) &file2);
 
 	// Rename should first replace the target, according to standards.
 	// From rename(2):
@@ -290,10 +729,10 @@ static int pfs_rename (const char* path, const char* newpath, unsigned int flags
 	case RENAME_EXCHANGE:
 		if (file2 == NULL)
 			return -ENOENT;
-		g_hash_table_steal (data->filetable, name2);
-		g_hash_table_insert (data->filetable, name2, file1);
-		g_hash_table_steal (data->filetable, name1);
-		g_hash_table_insert (data->filetable, name1, file2);
+		pfs_table_steal (data->filetable, name2);
+		pfs_table_insert (data->filetable, name2, file1);
+		pfs_table_steal (data->filetable, name1);
+		pfs_table_insert (data->filetable, name1, file2);
 		break;
 	case RENAME_NOREPLACE:
 		if (file2 != NULL)
@@ -305,22 +744,58 @@ static int pfs_rename (const char* path, const char* newpath, unsigned int flags
 		//   same file, then rename() does nothing, and returns a success status.
 		if (file2 != NULL && file1 == file2)
 			return 0;
-		g_hash_table_insert (data->filetable, g_strdup (newpath+1), file1);
-		g_hash_table_steal (data->filetable, name1);
+		pfs_table_insert (data->filetable, g_strdup (newname), file1);
+		pfs_table_steal (data->filetable, name1);
 		g_free (name1);
 	}
 	return 0;
 }
 #endif
 
+#if FUSE_USE_VERSION < 30
+static int pfs_rename (const char* path, const char* newpath) {
+#else
+static int pfs_rename (const char* path, const char* newpath, unsigned int flags) {
+#endif
+	pfs_data* data = fuse_get_context ()->private_data;
+	const char* name = pfs_path_name (data, path);
+	if (name == NULL)
+		return -ENOENT;
+	const char* newname = pfs_path_name (data, newpath);
+	if (newname == NULL)
+		return -EPERM;
+	int locked = pfs_lock_for_change (data);
+	if (locked < 0)
+		return locked;
+	#if FUSE_USE_VERSION < 30
+	int result = pfs_rename_locked (data, name, newname);
+	#else
+	int result = pfs_rename_locked (data, name, newname, flags);
+	#endif
+	g_rw_lock_writer_unlock (&data->filetable_lock);
+	return result;
+}
+
 static int pfs_link (const char* path, const char* newpath) {
 	pfs_data* data = fuse_get_context ()->private_data;
-	pfs_file* file = g_hash_table_lookup (data->filetable, path + 1);
-	if (!file || S_ISDIR(file->type))
+	const char* name = pfs_path_name (data, path);
+	if (name == NULL)
+		return -ENOENT;
+	const char* newname = pfs_path_name (data, newpath);
+	if (newname == NULL)
+		return -EPERM;
+	int locked = pfs_lock_for_change (data);
+	if (locked < 0)
+		return locked;
+	pfs_file* file = pfs_table_lookup (data->filetable, name);
+	if (!file || S_ISDIR(file->type)) {
+		g_rw_lock_writer_unlock (&data->filetable_lock);
 		return -ENOENT;
-	char* key = g_strdup (newpath + 1);
-	g_hash_table_insert (data->filetable, key, file);
+	}
+	char* key = g_strdup (newname);
+	pfs_table_insert (data->filetable, key, file);
 	file->nlink++;
+	g_rw_lock_writer_unlock (&data->filetable_lock);
 	return 0;
 }
 
@@ -333,49 +808,333 @@ static int pfs_truncate (const char* path, off_t size, struct fuse_file_info* fi
 	}
 #endif
 	pfs_data* data = fuse_get_context ()->private_data;
-	pfs_file* file = g_hash_table_lookup (data->filetable, path + 1);
-	if (!file)
+	const pfs_frozen* frozen = pfs_read_begin (data);
+	pfs_file* file = pfs_lookup (data, frozen, path);
+	if (!file) {
+		pfs_read_end (data, frozen);
 		return -ENOENT;
-	if (truncate (file->path->str, size) < 0)
-		return -errno;
+	}
+	if (file->concat != NULL || file->length >= 0) {
+		pfs_read_end (data, frozen);
+		return -EACCES;
+	}
+	// There is no truncateat(), but opening for writing needs the same permissions.
+	// O_NONBLOCK prevents hanging on FIFOs, which can't be truncated anyway.
+	int dirfd;
+	const char* name = pfs_file_at (file, &dirfd);
+	int fd = openat (dirfd, name, O_WRONLY | O_NONBLOCK | O_NOCTTY | O_CLOEXEC);
+	int error = errno;
+	pfs_read_end (data, frozen);
+	if (fd < 0)
+		return -error;
+	int result = 0;
+	if (ftruncate (fd, size) < 0)
+		result = -errno;
+	close (fd);
+	return result;
+}
+
+/*
+Read a small file from memory, or read it into memory. Returns FALSE if the file is not small,
+or anything fails, the file is then opened as usual.
+*/
+static gboolean pfs_open_memcache (pfs_data* data, pfs_file* file, int dirfd, const char* name, pfs_handle* handle) {
+	struct stat filestat;
+	if (fstatat (dirfd, name, &filestat, 0) < 0 || !S_ISREG (filestat.st_mode)
+		|| filestat.st_size > PFS_MEMCACHE_MAX_FILE_SIZE) {
+		return FALSE;
+	}
+	handle->contents = pfs_memcache_lookup (data->memcache, file->ino, &filestat);
+	if (handle->contents != NULL) {
+		return TRUE;
+	}
+
+	int fd = openat (dirfd, name, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return FALSE;
+	}
+	// One byte more shows whether the file has grown since it was checked.
+	char* contents = g_malloc (filestat.st_size + 1);
+	size_t filled = 0;
+	ssize_t result;
+	while ((result = pread (fd, contents + filled, filestat.st_size + 1 - filled, filled)) > 0) {
+		filled += result;
+	}
+	close (fd);
+	if (result < 0 || filled != (size_t) filestat.st_size) {
+		g_free (contents);
+		return FALSE;
+	}
+	handle->contents = g_bytes_new_take (contents, filled);
+	pfs_memcache_insert (data->memcache, file->ino, &filestat, handle->contents);
+	return TRUE;
+}
+
+static int pfs_open_handle (pfs_data* data, pfs_file* file, struct fuse_file_info* fi) {
+	if ((fi->flags & O_ACCMODE) != O_RDONLY || (fi->flags & O_TRUNC))
+		return -EACCES;
+	pfs_handle* handle = g_malloc0 (sizeof (*handle));
+	if (file->concat != NULL) {
+		handle->fd = -1;
+		handle->reader = pfs_concat_open (file->concat);
+	}
+	else {
+		int dirfd;
+		const char* name = pfs_file_at (file, &dirfd);
+		if (data->memcache != NULL && file->length < 0 && pfs_open_memcache (data, file, dirfd, name, handle)) {
+			handle->fd = -1;
+			handle->length = -1;
+			pfs_handle_set (fi, handle);
+			return 0;
+		}
+		handle->fd = openat (dirfd, name, fi->flags);
+		if (handle->fd < 0) {
+			int error = errno;
+			g_free (handle);
+			return -error;
+		}
+		handle->offset = file->offset;
+		handle->length = file->length;
+		if (data->diskcache != NULL && pfs_diskcache_key_from_fd (handle->fd, &handle->key)) {
+			handle->diskcache = data->diskcache;
+		}
+		else if (data->mapcache != NULL && pfs_diskcache_key_from_fd (handle->fd, &handle->key)
+			&& handle->key.size >= PFS_MAPCACHE_MIN_FILE_SIZE) {
+			handle->mapcache = data->mapcache;
+		}
+	}
+	pfs_handle_set (fi, handle);
 	return 0;
 }
 
 static int pfs_open (const char* path, struct fuse_file_info* fi) {
 	pfs_data* data = fuse_get_context ()->private_data;
-	pfs_file* file = g_hash_table_lookup (data->filetable, path + 1);
-	if (!file)
+	const pfs_frozen* frozen = pfs_read_begin (data);
+	pfs_file* file = pfs_lookup (data, frozen, path);
+	if (!file) {
+		pfs_read_end (data, frozen);
 		return -ENOENT;
-	int fd = open (file->path->str, fi->flags);
+	}
+	// Files opened for writing are not cached, their next versions are cached once they are read.
+	gboolean cached = (data->diskcache != NULL || data->memcache != NULL || data->mapcache != NULL)
+		&& (fi->flags & O_ACCMODE) == O_RDONLY && !(fi->flags & O_TRUNC);
+	if (file->concat != NULL || file->length >= 0 || cached) {
+		int result = pfs_open_handle (data, file, fi);
+		pfs_read_end (data, frozen);
+		return result;
+	}
+	int flags = fi->flags;
+	if (data->opts.fuse.writeback_cache) {
+		// With writeback cache, the kernel reads pages even from files opened only for writing,
+		// and it handles appending itself, sending writes with proper offsets.
+		flags &= ~O_APPEND;
+		if ((flags & O_ACCMODE) == O_WRONLY) {
+			flags = (flags & ~O_ACCMODE) | O_RDWR;
+		}
+	}
+	int dirfd;
+	const char* name = pfs_file_at (file, &dirfd);
+	int fd = openat (dirfd, name, flags);
+	if (fd < 0 && errno == EACCES && flags != fi->flags) {
+		// The file may be writable, but not readable. Partial page writes will fail then.
+		fd = openat (dirfd, name, fi->flags & ~O_APPEND);
+	}
+	int error = errno;
+	pfs_read_end (data, frozen);
 	if (fd < 0)
-		return -errno;
+		return -error;
 	fi->fh = fd;
 	return 0;
 }
 
 static int pfs_read (const char* path, char* buf, size_t size, off_t offset, struct fuse_file_info* fi) {
-	return pread (fi->fh, buf, size, offset);
+	pfs_handle* handle = pfs_handle_get (fi);
+	ssize_t result;
+	if (handle == NULL) {
+		result = pread (fi->fh, buf, size, offset);
+	}
+	else if (handle->contents != NULL) {
+		gsize length;
+		const char* contents = g_bytes_get_data (handle->contents, &length);
+		if (offset >= (off_t) length)
+			return 0;
+		size = MIN (size, length - offset);
+		memcpy (buf, contents + offset, size);
+		return size;
+	}
+	else if (handle->reader != NULL) {
+		return pfs_concat_read (handle->reader, buf, size, offset);
+	}
+	else {
+		// Reads are cut at the end of a slice, as if it was the end of file.
+		if (handle->length >= 0) {
+			if (offset >= handle->length)
+				return 0;
+			size = MIN ((off_t) size, handle->length - offset);
+		}
+		if (handle->diskcache != NULL)
+			return pfs_diskcache_read (handle->diskcache, &handle->key, handle->fd, buf, size, handle->offset + offset);
+		if (handle->mapcache != NULL)
+			return pfs_mapcache_read (handle->mapcache, &handle->key, handle->fd, buf, size, handle->offset + offset);
+		result = pread (handle->fd, buf, size, handle->offset + offset);
+	}
+	if (result < 0)
+		return -errno;
+	return result;
 }
 
 static int pfs_write (const char* path, const char* buf, size_t size, off_t offset, struct fuse_file_info* fi) {
-	return pwrite (fi->fh, buf, size, offset);
+	if (pfs_handle_get (fi) != NULL)
+		return -EBADF;
+	ssize_t result = pwrite (fi->fh, buf, size, offset);
+	if (result < 0)
+		return -errno;
+	return result;
+}
+
+static int pfs_flush (const char* path, struct fuse_file_info* fi) {
+	// Called on every close() of a descriptor, after the kernel has written back cached pages.
+	// Closing a duplicate reports errors the original file system may delay until close.
+	if (pfs_handle_get (fi) != NULL)
+		return 0;
+	int fd = dup (fi->fh);
+	if (fd < 0)
+		return -errno;
+	if (close (fd) < 0)
+		return -errno;
+	return 0;
 }
 
 static int pfs_release (const char* path, struct fuse_file_info* fi) {
-	return close (fi->fh);
+	pfs_handle* handle = pfs_handle_get (fi);
+	if (handle != NULL) {
+		if (handle->reader != NULL)
+			pfs_concat_close (handle->reader);
+		if (handle->contents != NULL)
+			g_bytes_unref (handle->contents);
+		if (handle->fd >= 0)
+			close (handle->fd);
+		g_free (handle);
+		return 0;
+	}
+	if (close (fi->fh) < 0)
+		return -errno;
+	return 0;
 }
 
 static int pfs_fsync (const char* path, int datasync, struct fuse_file_info* fi) {
-	if (datasync)
-		return fdatasync (fi->fh);
-	else
-		return fsync (fi->fh);
+	if (pfs_handle_get (fi) != NULL)
+		return 0;
+	int result = datasync ? fdatasync (fi->fh) : fsync (fi->fh);
+	if (result < 0)
+		return -errno;
+	return 0;
+}
+
+/*
+Extended attributes are passed to original files, without following symlinks, like stat.
+Files shown as symlinks and concatenated files do not have attributes of their own.
+*/
+static int pfs_setxattr (const char* path, const char* name, const char* value, size_t size, int flags) {
+	if (pfs_path_is_dir (path))
+		return -ENOTSUP;
+	pfs_data* data = fuse_get_context ()->private_data;
+	const pfs_frozen* frozen = pfs_read_begin (data);
+	pfs_file* file = pfs_lookup (data, frozen, path);
+	int result = 0;
+	if (!file) {
+		result = -ENOENT;
+	}
+	else if (data->opts.symlinks || S_ISLNK (file->type) || file->concat != NULL) {
+		result = -ENOTSUP;
+	}
+	else if (lsetxattr (file->path->str, name, value, size, flags) < 0) {
+		result = -errno;
+	}
+	else {
+		pfs_xattrs_forget (data->xattrs, file->ino, name);
+	}
+	pfs_read_end (data, frozen);
+	return result;
+}
+
+static int pfs_getxattr (const char* path, const char* name, char* value, size_t size) {
+	if (pfs_path_is_dir (path))
+		return -ENODATA;
+	pfs_data* data = fuse_get_context ()->private_data;
+	const pfs_frozen* frozen = pfs_read_begin (data);
+	pfs_file* file = pfs_lookup (data, frozen, path);
+	int result = 0;
+	if (!file) {
+		result = -ENOENT;
+	}
+	else if (data->opts.symlinks || S_ISLNK (file->type) || file->concat != NULL) {
+		result = -ENODATA;
+	}
+	else if (pfs_xattrs_is_missing (data->xattrs, file->ino, name)) {
+		// Most often security.capability, which the kernel checks before every write.
+		result = -ENODATA;
+	}
+	else {
+		ssize_t length = lgetxattr (file->path->str, name, value, size);
+		if (length < 0) {
+			result = -errno;
+			if (result == -ENODATA)
+				pfs_xattrs_set_missing (data->xattrs, file->ino, name);
+		}
+		else {
+			result = length;
+		}
+	}
+	pfs_read_end (data, frozen);
+	return result;
+}
+
+static int pfs_listxattr (const char* path, char* list, size_t size) {
+	if (pfs_path_is_dir (path))
+		return 0;
+	pfs_data* data = fuse_get_context ()->private_data;
+	const pfs_frozen* frozen = pfs_read_begin (data);
+	pfs_file* file = pfs_lookup (data, frozen, path);
+	int result = 0;
+	if (!file) {
+		result = -ENOENT;
+	}
+	else if (!data->opts.symlinks && !S_ISLNK (file->type) && file->concat == NULL) {
+		ssize_t length = llistxattr (file->path->str, list, size);
+		result = (length < 0) ? -errno : length;
+	}
+	pfs_read_end (data, frozen);
+	return result;
+}
+
+static int pfs_removexattr (const char* path, const char* name) {
+	if (pfs_path_is_dir (path))
+		return -ENODATA;
+	pfs_data* data = fuse_get_context ()->private_data;
+	const pfs_frozen* frozen = pfs_read_begin (data);
+	pfs_file* file = pfs_lookup (data, frozen, path);
+	int result = 0;
+	if (!file) {
+		result = -ENOENT;
+	}
+	else if (data->opts.symlinks || S_ISLNK (file->type) || file->concat != NULL) {
+		result = -ENODATA;
+	}
+	else {
+		if (lremovexattr (file->path->str, name) < 0)
+			result = -errno;
+		if (result == 0 || result == -ENODATA)
+			pfs_xattrs_set_missing (data->xattrs, file->ino, name);
+	}
+	pfs_read_end (data, frozen);
+	return result;
 }
 
 // TODO: handle all directories
 
 static int pfs_opendir (const char* path, struct fuse_file_info* fi) {
-	if (0 != strcmp (path, "/"))
+	if (!pfs_path_is_dir (path))
 		return -ENOENT;
 	// pfs_data* data = fuse_get_context ()->private_data;
 	return 0;
@@ -394,7 +1153,9 @@ static int pfs_readdir (const char* path, void* buf, fuse_fill_dir_t filler, off
 #else
 static int pfs_readdir (const char* path, void* buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info* fi, enum fuse_readdir_flags flags) {
 #endif
-	if (0 != strcmp (path, "/"))
+	pfs_data* data = fuse_get_context ()->private_data;
+	int dir = pfs_path_dir (data, path);
+	if (dir == PFS_PATH_NOT_DIR)
 		return -ENOENT;
 
 	if (0 != pfs_readdir_call_filler (filler, buf, ".")) {
@@ -403,47 +1164,111 @@ static int pfs_readdir (const char* path, void* buf, fuse_fill_dir_t filler, off
 	if (0 != pfs_readdir_call_filler (filler, buf, "..")) {
 		return -EIO;
 	}
-	
-	pfs_data* data = fuse_get_context ()->private_data;
-	unsigned int length;
-	char** paths = (char**) g_hash_table_get_keys_as_array (data->filetable, &length);
-	for (size_t i = 0; i < length; i++) {
-		if (0 != pfs_readdir_call_filler (filler, buf, paths[i])) {
-			g_free (paths);
-			return -EIO;
+	if (data->opts.fanout && dir == PFS_PATH_ROOT) {
+		// All subdirectories are always there, so that files can be linked into empty ones.
+		for (guint ipart = 0; ipart < pfs_table_parts (data->filetable); ipart++) {
+			char name[3];
+			snprintf (name, sizeof (name), "%02x", ipart);
+			if (0 != pfs_readdir_call_filler (filler, buf, name)) {
+				return -EIO;
+			}
 		}
+		return 0;
 	}
-	g_free (paths);
-	return 0;
+
+	// While loading in background, this lists files loaded so far.
+	int result = 0;
+	const pfs_frozen* frozen = pfs_read_begin (data);
+	if (data->opts.fanout) {
+		// Only names of one part are listed. A frozen table is used without locking,
+		// so the table it was made of does not change either.
+		pfs_table_iter iter;
+		gpointer name;
+		pfs_table_iter_init_part (&iter, data->filetable, dir);
+		while (pfs_table_iter_next (&iter, &name, NULL)) {
+			if (0 != pfs_readdir_call_filler (filler, buf, name)) {
+				result = -EIO;
+				break;
+			}
+		}
+		pfs_read_end (data, frozen);
+		return result;
+	}
+	if (frozen != NULL) {
+		guint length = pfs_frozen_size (frozen);
+		for (guint i = 0; i < length; i++) {
+			if (0 != pfs_readdir_call_filler (filler, buf, pfs_frozen_name (frozen, i))) {
+				return -EIO;
+			}
+		}
+		return 0;
+	}
+	// Names are passed straight from the table, which stays locked until the end.
+	pfs_table_iter iter;
+	gpointer name;
+	pfs_table_iter_init (&iter, data->filetable);
+	while (pfs_table_iter_next (&iter, &name, NULL)) {
+		if (0 != pfs_readdir_call_filler (filler, buf, name)) {
+			result = -EIO;
+			break;
+		}
+	}
+	pfs_read_end (data, frozen);
+	return result;
 }
 
 static int pfs_releasedir (const char* path, struct fuse_file_info* fi) {
-	if (0 != strcmp (path, "/"))
+	if (!pfs_path_is_dir (path))
 		return -ENOENT;
 	// pfs_data* data = fuse_get_context ()->private_data;
 	return 0;
 }
 
 static int pfs_access (const char* path, int mode) {
-	if (0 == strcmp(path, "/"))
+	if (pfs_path_is_dir (path))
 		return 0;
 	pfs_data* data = fuse_get_context ()->private_data;
-	pfs_file* file = g_hash_table_lookup (data->filetable, path + 1);
-	if (!file)
-		return -ENOENT;
-	if (access (file->path->str, mode) < 0)
-		return -errno;
-	return 0;
+	const pfs_frozen* frozen = pfs_read_begin (data);
+	pfs_file* file = pfs_lookup (data, frozen, path);
+	int result = 0;
+	if (!file) {
+		result = -ENOENT;
+	}
+	else if (file->concat != NULL) {
+		if (mode & (W_OK | X_OK))
+			result = -EACCES;
+	}
+	else if (file->length >= 0 && (mode & W_OK)) {
+		result = -EACCES;
+	}
+	else {
+		int dirfd;
+		const char* name = pfs_file_at (file, &dirfd);
+		if (faccessat (dirfd, name, mode, 0) < 0)
+			result = -errno;
+	}
+	pfs_read_end (data, frozen);
+	return result;
 }
 
 // These two are used in pfs_getattr and pfs_truncate if FUSE_USE_VERSION >= 30.
 static int pfs_fgetattr (const char* path, struct stat* statbuf, struct fuse_file_info* fi) {
+	if (pfs_handle_get (fi) != NULL) {
+		// Sizes of handles differ from sizes of original files.
+		#if FUSE_USE_VERSION < 30
+		return pfs_getattr (path, statbuf);
+		#else
+		return pfs_getattr (path, statbuf, NULL);
+		#endif
+	}
 	if (fstat (fi->fh, statbuf) < 0)
 		return -errno;
 	return 0;
 }
 
 static int pfs_ftruncate (const char* path, off_t size, struct fuse_file_info* fi) {
+	if (pfs_handle_get (fi) != NULL)
+		return -EBADF;
 	if (ftruncate (fi->fh, size) < 0)
 		return -errno;
 	return 0;
@@ -453,22 +1278,40 @@ static int pfs_ftruncate (const char* path, off_t size, struct fuse_file_info* f
 static int pfs_utimens (const char* path, const struct timespec tv[2]) {
 #else
 static int pfs_utimens (const char* path, const struct timespec tv[2], struct fuse_file_info* fi) {
-	if (fi != NULL) {
-		if (!futimens(fi->fh, tv))
+	// Slices are read-only, their times are those of the whole original file.
+	pfs_handle* handle = fi != NULL ? pfs_handle_get (fi) : NULL;
+	if (handle != NULL && handle->length >= 0)
+		return -EPERM;
+	// Handles without a descriptor of original file fall back to the path.
+	if (fi != NULL && pfs_handle_fd (fi) >= 0) {
+		if (futimens (pfs_handle_fd (fi), tv) < 0)
 			return -errno;
 		return 0;
 	}
 #endif
 	pfs_data* data = fuse_get_context ()->private_data;
-	pfs_file* file = g_hash_table_lookup (data->filetable, path + 1);
-	if (!file)
-		return -ENOENT;
-	if (utimensat (AT_FDCWD, file->path->str, tv, 0) < 0)
-		return -errno;
-	return 0;
+	const pfs_frozen* frozen = pfs_read_begin (data);
+	pfs_file* file = pfs_lookup (data, frozen, path);
+	int result = 0;
+	if (!file) {
+		result = -ENOENT;
+	}
+	else if (file->concat != NULL || file->length >= 0) {
+		result = -EPERM;
+	}
+	else {
+		int dirfd;
+		const char* name = pfs_file_at (file, &dirfd);
+		if (utimensat (dirfd, name, tv, 0) < 0)
+			result = -errno;
+	}
+	pfs_read_end (data, frozen);
+	return result;
 }
 
 static int pfs_fallocate (const char* path, int mode, off_t offset, off_t length, struct fuse_file_info* fi) {
+	if (pfs_handle_get (fi) != NULL)
+		return -EBADF;
 	if (fallocate (fi->fh, mode, offset, length) < 0)
 		return -errno;
 	return 0;
@@ -476,9 +1319,64 @@ static int pfs_fallocate (const char* path, int mode, off_t offset, off_t length
 
 #if FUSE_USE_VERSION >= 30
 static off_t pfs_lseek (const char* path, off_t offset, int whence, struct fuse_file_info *fi) {
-	off_t result = lseek (fi->fh, offset, whence);
+	pfs_handle* handle = pfs_handle_get (fi);
+	if (handle == NULL || (handle->fd >= 0 && handle->length < 0)) {
+		off_t result = lseek (pfs_handle_fd (fi), offset, whence);
+		if (result < 0)
+			return -errno;
+		return result;
+	}
+
+	off_t size = handle->length;
+	if (handle->reader != NULL)
+		size = pfs_concat_reader_size (handle->reader);
+	else if (handle->contents != NULL)
+		size = g_bytes_get_size (handle->contents);
+	if (whence != SEEK_DATA && whence != SEEK_HOLE)
+		return -EINVAL;
+	if (offset < 0 || offset >= size)
+		return -ENXIO;
+	if (handle->fd < 0) {
+		// The whole file is data, holes in original files are not looked for.
+		return whence == SEEK_DATA ? offset : size;
+	}
+	// Holes of a slice are holes of original file inside it, and the end of the slice.
+	off_t result = lseek (handle->fd, handle->offset + offset, whence);
 	if (result < 0)
 		return -errno;
+	result -= handle->offset;
+	if (result >= size)
+		return whence == SEEK_HOLE ? size : -ENXIO;
 	return result;
 }
 #endif // pfs_lseek
+
+#if FUSE_USE_VERSION >= 30
+static ssize_t pfs_copy_file_range (
+	const char* path_in, struct fuse_file_info* fi_in, off_t offset_in,
+	const char* path_out, struct fuse_file_info* fi_out, off_t offset_out, size_t size, int flags
+) {
+	if (pfs_handle_get (fi_out) != NULL)
+		return -EBADF;
+	int fd_in = fi_in->fh;
+	pfs_handle* handle = pfs_handle_get (fi_in);
+	if (handle != NULL) {
+		// The kernel falls back to reading and writing. Concatenated files and files in memory
+		// are read that way anyway, and cached files should be read through the cache.
+		if (handle->fd < 0 || handle->diskcache != NULL)
+			return -EOPNOTSUPP;
+		// Same as in pfs_read(), only slices have a length.
+		if (handle->length >= 0) {
+			if (offset_in >= handle->length)
+				return 0;
+			size = MIN ((off_t) size, handle->length - offset_in);
+		}
+		offset_in += handle->offset;
+		fd_in = handle->fd;
+	}
+	ssize_t result = copy_file_range (fd_in, &offset_in, fi_out->fh, &offset_out, size, flags);
+	if (result < 0)
+		return -errno;
+	return result;
+}
+#endif // pfs_copy_file_range
@@ -80,6 +80,61 @@ char* pfs_basename (const char* path) {
     return name;
 }
 
+char* pfs_normalize_path (const char* path) {
+    if (path == NULL) {
+        return NULL;
+    }
+
+    gboolean absolute = path[0] == '/';
+    GString* result = g_string_sized_new (strlen (path));
+    // Lengths of result before each component that can be removed by "..".
+    GArray* starts = g_array_new (FALSE, FALSE, sizeof (gsize));
+    if (absolute) {
+        g_string_append_c (result, '/');
+    }
+
+    const char* component = path;
+    while (*component != '\0') {
+        while (*component == '/') {
+            component++;
+        }
+        const char* end = component;
+        while (*end != '\0' && *end != '/') {
+            end++;
+        }
+        size_t length = end - component;
+
+        if (length == 0 || (length == 1 && component[0] == '.')) {
+            // Nothing to add.
+        }
+        else if (length == 2 && component[0] == '.' && component[1] == '.' && starts->len > 0) {
+            g_string_truncate (result, g_array_index (starts, gsize, starts->len - 1));
+            g_array_set_size (starts, starts->len - 1);
+        }
+        else if (length == 2 && component[0] == '.' && component[1] == '.' && absolute) {
+            // "/.." is "/".
+        }
+        else {
+            gboolean removable = !(length == 2 && component[0] == '.' && component[1] == '.');
+            if (removable) {
+                gsize start = result->len;
+                g_array_append_val (starts, start);
+            }
+            if (result->len > 0 && result->str[result->len - 1] != '/') {
+                g_string_append_c (result, '/');
+            }
+            g_string_append_len (result, component, length);
+        }
+        component = end;
+    }
+
+    g_array_free (starts, TRUE);
+    if (result->len == 0) {
+        g_string_append_c (result, '.');
+    }
+    return g_string_free (result, FALSE);
+}
+
 inline static ptrdiff_t last_slash_pos (const char* path) {
     char* pos = strrchr (path, '/');
     if (pos != NULL) {
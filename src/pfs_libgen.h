@@ -43,4 +43,19 @@ Returned string must be g_free()'d by the caller.
 */
 char* pfs_basename (const char* path);
 
+/*
+Return path with "." components and repeated "/" removed,
+and ".." components collapsed with the preceding component.
+
+This is done purely lexically, without looking at the filesystem,
+so ".." after a symbolic link to a directory is not handled as the kernel would.
+Leading ".." components of a relative path are kept, ".." at root is dropped.
+Trailing "/" is removed. If nothing is left, return "/" or "." respectively.
+If path is NULL, return NULL.
+Returned string must be g_free()'d by the caller.
+
+@parameter path: a Unix file path
+*/
+char* pfs_normalize_path (const char* path);
+
 #endif // PLAYLISTFS_LIBGEN_H
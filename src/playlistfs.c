@@ -18,13 +18,34 @@
 
 #include "playlistfs.h"
 #include "pfs_libgen.h"
+#include "concat.h"
+#include "control.h"
+#include "diskcache.h"
+#include "mapcache.h"
+#include "memcache.h"
+#include "xattrs.h"
 #include "files.h"
+#include "frozen.h"
+#include "lists.h"
+#include "server.h"
+#include "stats.h"
 
+#if FUSE_USE_VERSION >= 30
+#include <fuse_lowlevel.h> // fuse_session_exit()
+#endif
+#include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
 #include <locale.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #ifndef PATH_MAX
 // For now, this will be a hard limit in case it is not defined.
@@ -41,27 +62,41 @@
 #endif // FUSE_LIB_VERSION
 #define PLAYLISTFS_METADATA " (built " BUILD_DATE " with libfuse " FUSE_LIB_VERSION ")"
 
+// Budget of --cache-dir in MiB, if --cache-size is not given.
+#define PFS_DEFAULT_CACHE_SIZE 1024
+
 // Defined in operations.c.
 extern struct fuse_operations pfs_operations;
 
-#define printwarn(x) {if(!data->opts.quiet) fputs("warning: " x "\n", stderr);}
-#define printwarnf(x, ...) {if(!data->opts.quiet) fprintf(stderr, "warning: " x "\n", __VA_ARGS__);}
-#define printerr(x) fputs("error: " x "\n", stderr)
-#define printerrf(x, ...) fprintf(stderr, "error: " x "\n", __VA_ARGS__)
-#define printinfo(x) {if(data->opts.verbose) fputs(x "\n", stderr);}
-#define printinfof(x, ...) {if(data->opts.verbose) fprintf(stderr, x "\n", __VA_ARGS__);}
-
 static gboolean pfs_parse_options (
-	pfs_data* data, int argc, char* argv[]
+	pfs_data* data, int argc, char* argv[], gboolean served
+);
+static gboolean pfs_prepare (
+	pfs_data* data
 );
 static gboolean pfs_check_mount_point (
 	pfs_data* data
 );
-static gboolean pfs_build_playlist (
+static GString* pfs_build_playlist_get_cwd (
 	pfs_data* data
 );
+static gboolean pfs_build_playlist (
+	pfs_data* data, GString* cwd
+);
+static void pfs_background_load_prepare (
+	pfs_data* data, GString* cwd
+);
 static gboolean pfs_setup_fuse_arguments (
-	int* fuse_argc, char** fuse_argv[], char* pfs_name, pfs_data* data
+	int* fuse_argc, char** fuse_argv[], char* pfs_name, pfs_data* data, GPtrArray* strings
+);
+static int pfs_run_fuse (
+	int fuse_argc, char* fuse_argv[], pfs_data* data
+);
+static void pfs_raise_file_limit (
+	void
+);
+static int pfs_serve (
+	pfs_data* data
 );
 
 int main (int argc, char* argv[]) {
@@ -69,34 +104,117 @@ int main (int argc, char* argv[]) {
 
 	pfs_data* data = g_malloc0 (sizeof (*data));
 
-	if (!pfs_parse_options (data, argc, argv)) {
+	pfs_stats_phase_begin (PFS_PHASE_OPTIONS);
+	// Option parsing reorders argv, but --connect sends the command line as given.
+	char** arguments = g_new (char*, argc + 1);
+	memcpy (arguments, argv, sizeof (*argv) * (argc + 1));
+	gboolean parsed = pfs_parse_options (data, argc, arguments, FALSE);
+	g_free (arguments);
+	if (!parsed) {
 		exit (EXIT_FAILURE);
 	}
-	if (!pfs_check_mount_point (data)) {
-		exit (EXIT_FAILURE);
+	pfs_stats_phase_end (PFS_PHASE_OPTIONS);
+
+	if (data->opts.server != NULL) {
+		return pfs_serve (data);
+	}
+	if (data->opts.apply != NULL) {
+		return pfs_control_apply (data);
+	}
+	if (data->opts.connect != NULL) {
+		// The server parses the same command line again, and does everything else.
+		int status = pfs_server_request (data->opts.connect, argc, argv);
+		if (status == PFS_SERVER_UNREACHABLE) {
+			printerrf ("could not connect to server at '%s': %s", data->opts.connect, strerror (errno));
+		}
+		return status;
 	}
-	// When stdout/stderr is not a terminal, ensure output is actually outputted in time.
-	fflush(stdout);
-	fflush(stderr);
 
-	clock_gettime(CLOCK_REALTIME, &data->opts.started_at);
-	data->filetable = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, pfs_file_free_void);
-	if (!pfs_build_playlist (data)) {
+	if (!pfs_prepare (data)) {
 		exit (EXIT_FAILURE);
 	}
-	fflush(stderr);
 
 	int fuse_argc = 0;
 	char** fuse_argv = NULL;
-	if (!pfs_setup_fuse_arguments (&fuse_argc, &fuse_argv, argv[0], data)) {
+	pfs_stats_phase_begin (PFS_PHASE_FUSE_ARGUMENTS);
+	// Arguments are used until the process exits, so they are never freed.
+	if (!pfs_setup_fuse_arguments (&fuse_argc, &fuse_argv, argv[0], data, NULL)) {
 		exit (EXIT_FAILURE);
 	}
+	pfs_stats_phase_end (PFS_PHASE_FUSE_ARGUMENTS);
 	fflush(stderr);
 
-	return fuse_main (fuse_argc, fuse_argv, &pfs_operations, data);
+	return pfs_run_fuse (fuse_argc, fuse_argv, data);
+}
+
+/*
+Check the mount point and build the playlist, or prepare to load it in background.
+*/
+static gboolean pfs_prepare (
+	pfs_data* data
+) {
+	if (data->opts.timings) {
+		pfs_stats_enable ();
+	}
+	pfs_stats_phase_begin (PFS_PHASE_MOUNT_POINT);
+	if (!pfs_check_mount_point (data)) {
+		return FALSE;
+	}
+	pfs_stats_phase_end (PFS_PHASE_MOUNT_POINT);
+	// When stdout/stderr is not a terminal, ensure output is actually outputted in time.
+	fflush(stdout);
+	fflush(stderr);
+
+	pfs_raise_file_limit ();
+	if (data->opts.cache_dir != NULL) {
+		// Opened now, as FUSE changes the working directory when daemonizing.
+		guint64 budget = (guint64) (data->opts.cache_size > 0 ? data->opts.cache_size : PFS_DEFAULT_CACHE_SIZE) << 20;
+		data->diskcache = pfs_diskcache_new (data->opts.cache_dir, budget);
+		if (data->diskcache == NULL) {
+			printerrf ("could not use cache directory '%s': %s", data->opts.cache_dir, strerror (errno));
+			return FALSE;
+		}
+	}
+	if (data->opts.memory_cache > 0) {
+		data->memcache = pfs_memcache_new ((guint64) data->opts.memory_cache << 20);
+	}
+	if (data->opts.mmap_cache > 0) {
+		data->mapcache = pfs_mapcache_new ((guint64) data->opts.mmap_cache << 20);
+	}
+	if (!pfs_control_listen (data)) {
+		return FALSE;
+	}
+	clock_gettime(CLOCK_REALTIME, &data->opts.started_at);
+	data->xattrs = pfs_xattrs_new ();
+	data->filetable = pfs_table_new_with_parts (data->opts.fanout ? PFS_FANOUT_BITS : 0, g_free, pfs_file_free_void);
+	g_rw_lock_init (&data->filetable_lock);
+	g_mutex_init (&data->loader.lock);
+	g_cond_init (&data->loader.done);
+	GString* cwd = pfs_build_playlist_get_cwd (data);
+	if (data->opts.background_load) {
+		// Loading starts in pfs_init(), once the filesystem is mounted.
+		pfs_background_load_prepare (data, cwd);
+	}
+	else {
+		pfs_stats_phase_begin (PFS_PHASE_PLAYLIST);
+		if (!pfs_build_playlist (data, cwd)) {
+			return FALSE;
+		}
+		pfs_stats_phase_end (PFS_PHASE_PLAYLIST);
+	}
+	fflush(stderr);
+	return TRUE;
+}
+
+char* pfs_name_to_path (const pfs_data* data, const char* name) {
+	if (!data->opts.fanout)
+		return g_strconcat ("/", name, NULL);
+	return g_strdup_printf ("/%02x/%s", pfs_table_part_of (data->filetable, name), name);
 }
 
 void pfs_free_pfs_data (pfs_data* data) {
+	// Socket is opened before mounting, which may fail.
+	pfs_control_stop (data);
 	if (data->opts.files != NULL)
 		g_array_free (data->opts.files, TRUE);
 	if (data->opts.lists != NULL)
@@ -105,8 +223,40 @@ void pfs_free_pfs_data (pfs_data* data) {
 		g_free (data->opts.fuse.fsname);
 	if (data->opts.mount_point != NULL)
 		g_free (data->opts.mount_point);
+	if (data->opts.server != NULL)
+		g_free (data->opts.server);
+	if (data->opts.connect != NULL)
+		g_free (data->opts.connect);
+	if (data->opts.control != NULL)
+		g_free (data->opts.control);
+	if (data->opts.apply != NULL)
+		g_free (data->opts.apply);
+	if (data->opts.concat != NULL)
+		g_free (data->opts.concat);
+	if (data->opts.cache_dir != NULL)
+		g_free (data->opts.cache_dir);
+	// Frozen table only borrows files from filetable.
+	if (data->frozen != NULL)
+		pfs_frozen_free (data->frozen);
 	if (data->filetable != NULL)
-		g_hash_table_unref (data->filetable);
+		pfs_table_free (data->filetable);
+	if (data->concat != NULL)
+		pfs_concat_free (data->concat);
+	if (data->diskcache != NULL)
+		pfs_diskcache_free (data->diskcache);
+	if (data->memcache != NULL)
+		pfs_memcache_free (data->memcache);
+	if (data->mapcache != NULL)
+		pfs_mapcache_free (data->mapcache);
+	if (data->xattrs != NULL)
+		pfs_xattrs_free (data->xattrs);
+	if (data->loader.cwd != NULL)
+		g_string_free (data->loader.cwd, TRUE);
+	g_rw_lock_clear (&data->filetable_lock);
+	g_cond_clear (&data->loader.done);
+	g_mutex_clear (&data->loader.lock);
+	if (data->messages != NULL)
+		fclose (data->messages);
 	g_free (data);
 }
 
@@ -114,69 +264,138 @@ void pfs_free_pfs_data (pfs_data* data) {
 ---- Playlist building ----
 */
 
-static GString* pfs_build_playlist_get_cwd (
-	pfs_data* data
+// Every entry for a name, in order, before any of them is checked.
+typedef struct {
+	const char* path; // As specified, in strings
+	const char* name; // In strings
+	GString* relative_base; // Base for a relative path, NULL for paths from lists
+	mode_t type;
+	gboolean checked; // Whether the file is known to exist and not be a directory
+	guint previous; // Index + 1 of the previous candidate with the same name, 0 if none
+} pfs_build_candidate;
+
+typedef struct {
+	GArray* candidates; // pfs_build_candidate, in order of appearance
+	GHashTable* latest; // name -> index + 1 of its last candidate
+	GStringChunk* strings;
+} pfs_build_collection;
+
+// Names are checked in parallel in chunks of this many, and added to the table in order.
+#define PFS_BUILD_RESOLVE_CHUNK 256
+
+typedef struct {
+	guint last; // Index of the last candidate for the name
+	guint source; // Index of the candidate the file was created from
+	pfs_file* file; // NULL if no candidate is usable, or once the file is in the table
+} pfs_build_resolved;
+
+typedef struct {
+	pfs_data* data;
+	pfs_build_collection* collection;
+	GArray* resolved; // pfs_build_resolved, in order of last appearance of names
+	gint failed; // Set atomically on fatal errors
+	GMutex lock; // Protects chunks_done
+	GCond done;
+	gboolean* chunks_done;
+} pfs_build_resolver;
+
+static gboolean pfs_build_playlist_process_lists (
+	pfs_data* data, pfs_build_collection* collection, GString* cwd, char** lists
 );
-static gboolean pfs_build_playlist_process_list (
-	pfs_data* data, GHashTable* filetable, GString* cwd, char* listpath
+static gboolean pfs_build_playlist_process_list_entry (
+	pfs_data* data, pfs_list_entry* entry, void* collection
 );
-static gboolean pfs_build_playlist_process_path (
-	pfs_data* data, GHashTable* filetable, GString* relative_base, pfs_file_entry* entry
+static void pfs_build_playlist_collect (
+	pfs_data* data, pfs_build_collection* collection, GString* relative_base, pfs_file_entry* entry
 );
-static gboolean pfs_build_playlist_add_symlink (
-	pfs_data* data, GHashTable* filetable, GString* relative_base, pfs_file_entry* entry
+static gboolean pfs_build_playlist_resolve (
+	pfs_data* data, pfs_table* filetable, pfs_build_collection* collection
 );
-static gboolean pfs_build_playlist_add_regular (
-	pfs_data* data, GHashTable* filetable, GString* relative_base, pfs_file_entry* entry
+static void pfs_build_playlist_resolve_chunk (
+	gpointer chunk, gpointer resolver
 );
-static char* pfs_build_playlist_get_full_path (
-	pfs_data* data, GString* relative_base, char* path
+static void pfs_build_playlist_report_file (
+	pfs_data* data, const char* name, mode_t type, pfs_file* file
 );
-static char* pfs_build_playlist_get_full_path_from_absolute (
-	pfs_data* data, char* path
+static gboolean pfs_build_playlist_create_file (
+	pfs_data* data, pfs_build_candidate* candidate, pfs_file** file
 );
-static char* pfs_build_playlist_get_full_path_from_relative (
-	pfs_data* data, GString* relative_base, char* path, size_t length
+static void pfs_build_playlist_insert (
+	pfs_data* data, pfs_table* filetable, char* name, pfs_file* file
+);
+static void pfs_build_playlist_concat_append (
+	pfs_data* data, pfs_file* file
+);
+static gboolean pfs_build_playlist_concat_finish (
+	pfs_data* data, pfs_table* filetable
+);
+static void pfs_build_playlist_freeze (
+	pfs_data* data
 );
 
 static gboolean pfs_build_playlist (
-	pfs_data* data
+	pfs_data* data, GString* cwd
 ) {
 	char** lists = data->opts.lists;
 	GArray* files = data->opts.files;
-	GHashTable* table = data->filetable;
+	pfs_table* table = data->filetable;
 
-	GString* cwd = pfs_build_playlist_get_cwd(data);
 	if (!cwd && !data->opts.relative_disabled.all) {
 		printwarn("relative paths will be ignored");
 	}
 
+	// Entries are only collected at first. Later entries shadow earlier ones with the same name,
+	// so only the last usable one for each name needs to be checked and created.
+	pfs_build_collection collection = {
+		.candidates = g_array_new (FALSE, FALSE, sizeof (pfs_build_candidate)),
+		.latest = g_hash_table_new (g_str_hash, g_str_equal),
+		.strings = g_string_chunk_new (64 * 1024),
+	};
+	gboolean result = TRUE;
+	if (data->opts.concat != NULL) {
+		data->concat = pfs_concat_new ();
+	}
+
 	if (lists != NULL) {
-		for (size_t ilist = 0; lists[ilist]; ilist++) {
-			if (!pfs_build_playlist_process_list (data, table, cwd, lists[ilist])) {
-				return FALSE;
-			}
-		}
+		result = pfs_build_playlist_process_lists (data, &collection, cwd, lists);
 	}
 
-	if (files != NULL) {
+	if (files != NULL && result) {
+		pfs_stats_phase_begin (PFS_PHASE_FILES);
 		GString* files_relative_base = NULL;
 		pfs_file_entry* entry = NULL;
 		if (!data->opts.relative_disabled.files) {
 			files_relative_base = cwd;
 		}
-		printinfo ("Adding individual files:");
 		for (size_t ifile = 0; (entry = &g_array_index (files, pfs_file_entry, ifile)), ifile < files->len; ifile++) {
-			if (!pfs_build_playlist_process_path (data, table, files_relative_base, entry)) {
-				return FALSE;
+			if (g_atomic_int_get (&data->loader.cancelled)) {
+				result = FALSE;
+				break;
 			}
+			pfs_build_playlist_collect (data, &collection, files_relative_base, entry);
 		}
+		pfs_stats_phase_end (PFS_PHASE_FILES);
+	}
+
+	if (result) {
+		result = pfs_build_playlist_resolve (data, table, &collection);
+	}
+	if (result && data->concat != NULL) {
+		result = pfs_build_playlist_concat_finish (data, table);
+	}
+	g_string_chunk_free (collection.strings);
+	g_hash_table_unref (collection.latest);
+	g_array_free (collection.candidates, TRUE);
+	if (!result) {
+		return FALSE;
 	}
 
-	if (g_hash_table_size(table) == 0) {
+	if (pfs_table_size (table) == 0) {
 		printwarn("no lists or files specified, mounting empty filesystem");
 	}
 
+	pfs_build_playlist_freeze (data);
+
 	if (cwd) {
 		g_string_free (cwd, TRUE);
 		cwd = NULL;
@@ -190,6 +409,13 @@ static GString* pfs_build_playlist_get_cwd (
 ) {
 	if (data->opts.relative_disabled.all) return NULL;
 
+	if (data->opts.cwd != NULL) {
+		GString* cwd = g_string_new (data->opts.cwd);
+		if (cwd->str[cwd->len - 1] != '/') {
+			g_string_append_c (cwd, '/');
+		}
+		return cwd;
+	}
 	char string_cwd[PATH_MAX];
 	if (!getcwd(string_cwd, PATH_MAX)) {
 		printerr ("could not get current working directory");
@@ -203,202 +429,480 @@ static GString* pfs_build_playlist_get_cwd (
 	return cwd;
 }
 
-static gboolean pfs_build_playlist_process_list (
-	pfs_data* data, GHashTable* filetable, GString* cwd, char* listpath
+static gboolean pfs_build_playlist_process_lists (
+	pfs_data* data, pfs_build_collection* collection, GString* cwd, char** lists
 ) {
-	FILE* list = fopen (listpath, "rt");
-	if (!list) {
-		printwarnf ("list '%s' could not be opened, skipping", listpath);
-		return TRUE;
+	// All lists, including nested ones, are read in parallel first,
+	// then expanded in order, so that later definitions still win.
+	pfs_stats_phase_begin (PFS_PHASE_LISTS_READ);
+	pfs_list_loader* loader = pfs_list_loader_new (data, cwd);
+	GPtrArray* requested = g_ptr_array_new ();
+	for (size_t ilist = 0; lists[ilist]; ilist++) {
+		g_ptr_array_add (requested, pfs_list_loader_request (loader, lists[ilist]));
+	}
+	pfs_list_loader_wait (loader);
+	pfs_stats_phase_end (PFS_PHASE_LISTS_READ);
+
+	pfs_stats_phase_begin (PFS_PHASE_LISTS_EXPAND);
+	gboolean result = TRUE;
+	for (size_t ilist = 0; ilist < requested->len && result; ilist++) {
+		result = pfs_list_loader_expand (
+			loader, g_ptr_array_index (requested, ilist), pfs_build_playlist_process_list_entry, collection
+		);
+	}
+	pfs_stats_phase_end (PFS_PHASE_LISTS_EXPAND);
+
+	g_ptr_array_free (requested, TRUE);
+	pfs_list_loader_free (loader);
+	return result;
+}
+
+static gboolean pfs_build_playlist_process_list_entry (
+	pfs_data* data, pfs_list_entry* entry, void* collection
+) {
+	if (g_atomic_int_get (&data->loader.cancelled)) {
+		return FALSE;
+	}
+	// Paths from lists are already full, so no relative base is needed.
+	pfs_file_entry file_entry = { .path = entry->path, .type = entry->type, .checked = entry->checked };
+	pfs_build_playlist_collect (data, (pfs_build_collection*) collection, NULL, &file_entry);
+	return TRUE;
+}
+
+static void pfs_build_playlist_collect (
+	pfs_data* data, pfs_build_collection* collection, GString* relative_base, pfs_file_entry* entry
+) {
+	char* name = pfs_basename (entry->path);
+	if (strlen (name) > NAME_MAX) {
+		printwarnf ("filename '%s' is too long, ignoring", name);
+		pfs_stats_count (PFS_COUNTER_ENTRIES_SKIPPED, 1);
+		g_free (name);
+		return;
 	}
-	printinfof ("Reading list '%s':", listpath);
 
-	GString* relative_base = NULL;
-	
-	if (!data->opts.relative_disabled.paths) {
-		char* dirpath = NULL;
-		dirpath = pfs_dirname(listpath);
-		if (dirpath == NULL) {
-			printwarnf ("Could not determine directory for list '%s', relative paths will be ignored", listpath);
+	pfs_build_candidate candidate = {
+		.path = g_string_chunk_insert (collection->strings, entry->path),
+		.relative_base = relative_base,
+		.type = entry->type,
+		.checked = entry->checked,
+	};
+	gpointer previous_name, previous;
+	if (g_hash_table_lookup_extended (collection->latest, name, &previous_name, &previous)) {
+		candidate.name = previous_name;
+		candidate.previous = GPOINTER_TO_UINT (previous);
+	}
+	else {
+		candidate.name = g_string_chunk_insert (collection->strings, name);
+	}
+	g_free (name);
+	g_array_append_val (collection->candidates, candidate);
+	g_hash_table_insert (
+		collection->latest, (gpointer) candidate.name, GUINT_TO_POINTER (collection->candidates->len)
+	);
+}
+
+static gboolean pfs_build_playlist_resolve (
+	pfs_data* data, pfs_table* filetable, pfs_build_collection* collection
+) {
+	pfs_stats_phase_begin (PFS_PHASE_RESOLVE);
+	printinfo ("Adding files:");
+	pfs_build_resolver resolver = {
+		.data = data,
+		.collection = collection,
+		.resolved = g_array_new (FALSE, TRUE, sizeof (pfs_build_resolved)),
+	};
+	// Only the last candidate for each name is resolved, earlier ones are fallbacks.
+	for (guint icandidate = 0; icandidate < collection->candidates->len; icandidate++) {
+		pfs_build_candidate* candidate = &g_array_index (collection->candidates, pfs_build_candidate, icandidate);
+		if (GPOINTER_TO_UINT (g_hash_table_lookup (collection->latest, candidate->name)) == icandidate + 1) {
+			pfs_build_resolved resolved = { .last = icandidate };
+			g_array_append_val (resolver.resolved, resolved);
 		}
-		else {
-			if (dirpath[0] == '/') {
-				relative_base = g_string_new(dirpath);
-				g_string_append_c(relative_base, '/');
-			}
-			else if (cwd) {
-				relative_base = g_string_new_len(cwd->str, cwd->len);
-				g_string_append(relative_base, dirpath);
-				g_string_append_c(relative_base, '/');
-			}
-			else {
-				printwarnf ("relative paths will be ignored for list '%s'", listpath);
-			}
-			g_free (dirpath);
+	}
+
+	// Checking original files takes most of the time, and is done by a pool of threads.
+	// Files are added in order, so messages follow the lists and results do not depend on timing.
+	guint chunks = (resolver.resolved->len + PFS_BUILD_RESOLVE_CHUNK - 1) / PFS_BUILD_RESOLVE_CHUNK;
+	resolver.chunks_done = g_new0 (gboolean, chunks);
+	g_mutex_init (&resolver.lock);
+	g_cond_init (&resolver.done);
+	GThreadPool* pool = NULL;
+	guint threads = g_get_num_processors ();
+	if (chunks > 1 && threads > 1) {
+		// Threads must not be kept around, as FUSE forks when daemonizing.
+		g_thread_pool_set_max_unused_threads (0);
+		pool = g_thread_pool_new (pfs_build_playlist_resolve_chunk, &resolver, threads, FALSE, NULL);
+		for (guint ichunk = 0; ichunk < chunks; ichunk++) {
+			g_thread_pool_push (pool, GUINT_TO_POINTER (ichunk + 1), NULL);
 		}
 	}
 
-	char path[PATH_MAX];
-	while (fgets (path, PATH_MAX, list)) {
-		size_t length = strlen (path);
-		pfs_file_entry entry = { .path = path, .type = S_IFREG };
-		if (path[0] == '\n' || length == 0) {
-			continue;
+	gboolean result = TRUE;
+	for (guint ichunk = 0; ichunk < chunks && result; ichunk++) {
+		if (pool == NULL) {
+			pfs_build_playlist_resolve_chunk (GUINT_TO_POINTER (ichunk + 1), &resolver);
 		}
-		else if (path[length - 1] == '\n') {
-			path[length - 1] = '\0';
+		g_mutex_lock (&resolver.lock);
+		while (!resolver.chunks_done[ichunk]) {
+			g_cond_wait (&resolver.done, &resolver.lock);
 		}
-		else if (length == PATH_MAX - 1) {
-			printwarn ("filename too long, ignoring");
-			while (fgetc(list) != '\n' && !feof(list) && !ferror(list)) {}
-			continue;
+		g_mutex_unlock (&resolver.lock);
+		if (g_atomic_int_get (&resolver.failed) || g_atomic_int_get (&data->loader.cancelled)) {
+			result = FALSE;
+			break;
 		}
 
-		pfs_build_playlist_process_path (data, filetable, relative_base, &entry);
+		guint end = MIN ((ichunk + 1) * PFS_BUILD_RESOLVE_CHUNK, resolver.resolved->len);
+		for (guint iresolved = ichunk * PFS_BUILD_RESOLVE_CHUNK; iresolved < end; iresolved++) {
+			pfs_build_resolved* resolved = &g_array_index (resolver.resolved, pfs_build_resolved, iresolved);
+			if (resolved->file == NULL) {
+				continue;
+			}
+			pfs_build_candidate* candidate = &g_array_index (collection->candidates, pfs_build_candidate, resolved->last);
+			pfs_build_candidate* source = &g_array_index (collection->candidates, pfs_build_candidate, resolved->source);
+			pfs_build_playlist_report_file (data, candidate->name, source->type, resolved->file);
+			pfs_build_playlist_insert (data, filetable, g_strdup (candidate->name), resolved->file);
+			if (data->concat != NULL && !S_ISLNK (source->type)) {
+				pfs_build_playlist_concat_append (data, resolved->file);
+			}
+			resolved->file = NULL;
+
+			guint shadowed = 0;
+			for (guint index = source->previous; index != 0;
+				index = g_array_index (collection->candidates, pfs_build_candidate, index - 1).previous) {
+				shadowed++;
+			}
+			if (shadowed > 0) {
+				printinfof ("    Replaced previous definitions of '%s' (%u)", candidate->name, shadowed);
+				pfs_stats_count (PFS_COUNTER_ENTRIES_SHADOWED, shadowed);
+			}
+		}
 	}
 
-	if (feof (list)) {
-		fclose (list);
+	if (!result) {
+		// Remaining chunks are skipped quickly.
+		g_atomic_int_set (&resolver.failed, TRUE);
 	}
-	else {
-		printwarnf ("error when reading list '%s'", listpath);
+	if (pool != NULL) {
+		g_thread_pool_free (pool, FALSE, TRUE);
+	}
+	// Files which did not get into the table, if stopped early.
+	for (guint iresolved = 0; iresolved < resolver.resolved->len; iresolved++) {
+		pfs_build_resolved* resolved = &g_array_index (resolver.resolved, pfs_build_resolved, iresolved);
+		if (resolved->file != NULL) {
+			pfs_file_free (resolved->file);
+		}
 	}
+	g_cond_clear (&resolver.done);
+	g_mutex_clear (&resolver.lock);
+	g_free (resolver.chunks_done);
+	g_array_free (resolver.resolved, TRUE);
+	pfs_stats_phase_end (PFS_PHASE_RESOLVE);
+	return result;
+}
 
-	if (relative_base) {
-		g_string_free (relative_base, TRUE);
+/*
+Find a usable candidate for each name of a chunk, falling back to earlier candidates.
+Called from a pool of threads.
+*/
+static void pfs_build_playlist_resolve_chunk (
+	gpointer chunk, gpointer pointer
+) {
+	pfs_build_resolver* resolver = pointer;
+	pfs_data* data = resolver->data;
+	GArray* candidates = resolver->collection->candidates;
+	guint ichunk = GPOINTER_TO_UINT (chunk) - 1;
+	guint end = MIN ((ichunk + 1) * PFS_BUILD_RESOLVE_CHUNK, resolver->resolved->len);
+	for (guint iresolved = ichunk * PFS_BUILD_RESOLVE_CHUNK; iresolved < end; iresolved++) {
+		if (g_atomic_int_get (&resolver->failed) || g_atomic_int_get (&data->loader.cancelled)) {
+			break;
+		}
+		pfs_build_resolved* resolved = &g_array_index (resolver->resolved, pfs_build_resolved, iresolved);
+		gboolean result = TRUE;
+		guint index = resolved->last + 1;
+		while (index != 0 && resolved->file == NULL && result) {
+			pfs_build_candidate* current = &g_array_index (candidates, pfs_build_candidate, index - 1);
+			resolved->source = index - 1;
+			result = pfs_build_playlist_create_file (data, current, &resolved->file);
+			index = current->previous;
+		}
+		if (!result) {
+			g_atomic_int_set (&resolver->failed, TRUE);
+		}
 	}
 
-	return TRUE;
+	g_mutex_lock (&resolver->lock);
+	resolver->chunks_done[ichunk] = TRUE;
+	g_cond_broadcast (&resolver->done);
+	g_mutex_unlock (&resolver->lock);
 }
 
-static gboolean pfs_build_playlist_process_path (
-	pfs_data* data, GHashTable* filetable, GString* relative_base, pfs_file_entry* entry
+static void pfs_build_playlist_report_file (
+	pfs_data* data, const char* name, mode_t type, pfs_file* file
 ) {
-	mode_t type = entry->type;
-
-	if (S_ISLNK(type)) {
-		return pfs_build_playlist_add_symlink(data, filetable, relative_base, entry);
+	if (S_ISLNK (type)) {
+		printinfof ("  %s -> %s", name, file->path->str);
+	}
+	else {
+		printinfof ("  %s : %s", name, file->path->str);
 	}
-	
-	return pfs_build_playlist_add_regular(data, filetable, relative_base, entry);
 }
 
-static gboolean pfs_build_playlist_add_symlink (
-	pfs_data* data, GHashTable* filetable, GString* relative_base, pfs_file_entry* entry
+// Sets file to NULL if the candidate is not usable. Returns FALSE on fatal errors only.
+static gboolean pfs_build_playlist_create_file (
+	pfs_data* data, pfs_build_candidate* candidate, pfs_file** file
 ) {
-	char* path = entry->path;
-	// name is used as the key, do not free it here!
-	char* name = pfs_basename (path);
-	if (strlen (name) <= NAME_MAX) {
-		pfs_file* file = pfs_file_create (path, S_IFLNK, &data->opts.started_at);
-		if (!file) {
+	*file = NULL;
+	if (S_ISLNK (candidate->type)) {
+		*file = pfs_file_create (candidate->path, S_IFLNK, &data->opts.started_at);
+		if (!*file) {
 			printerr ("could not create new file");
 			return FALSE;
 		}
-		
-		printinfof("  %s -> %s", name, path);
-		// Replace in case we encountered the name already.
-		if (!g_hash_table_replace (filetable, name, file)) {
-			printinfof ("    Replaced previous definition of '%s'", name);
+		return TRUE;
+	}
+
+	char* full_path = pfs_list_get_full_path (data, candidate->relative_base, candidate->path);
+	if (full_path == NULL) {
+		// Something happened, warning was already printed, skip file.
+		pfs_stats_count (PFS_COUNTER_ENTRIES_SKIPPED, 1);
+		return TRUE;
+	}
+
+	gboolean usable = TRUE;
+	off_t slice_offset = 0;
+	off_t slice_length = -1;
+	// Entries from scanned directories are already known to be fine, and are named as they are.
+	if (!candidate->checked) {
+		pfs_stats_phase_begin (PFS_PHASE_FILES_CHECK);
+		struct stat filestat;
+		pfs_stats_count (PFS_COUNTER_SYSCALLS, 1);
+		int result = lstat (full_path, &filestat);
+		// Same as with #directory, a file which exists is never a slice, even if it is named like one.
+		gboolean slice = result != 0 && pfs_list_split_slice (full_path, &slice_offset, &slice_length);
+		if (slice) {
+			// Slices can only be taken of regular files, which may be behind symlinks.
+			pfs_stats_count (PFS_COUNTER_SYSCALLS, 1);
+			result = stat (full_path, &filestat);
+		}
+		if (0 != result) {
+			printwarnf ("file '%s' is inaccessible, ignoring", candidate->path);
+			pfs_stats_count (PFS_COUNTER_ENTRIES_INACCESSIBLE, 1);
+			usable = FALSE;
+		}
+		else if (S_ISDIR (filestat.st_mode)) {
+			printwarnf ("file '%s' is a directory, ignoring", candidate->path);
+			pfs_stats_count (PFS_COUNTER_ENTRIES_SKIPPED, 1);
+			usable = FALSE;
 		}
+		else if (slice && (!S_ISREG (filestat.st_mode) || slice_offset > filestat.st_size
+			|| slice_length > filestat.st_size - slice_offset)) {
+			printwarnf ("slice '%s' is not inside a regular file, ignoring", candidate->path);
+			pfs_stats_count (PFS_COUNTER_ENTRIES_SKIPPED, 1);
+			usable = FALSE;
+		}
+		pfs_stats_phase_end (PFS_PHASE_FILES_CHECK);
 	}
-	else {
-		printwarnf ("filename '%s' is too long, ignoring", name);
-		g_free (name);
+
+	if (usable) {
+		// Set type to symlink/regular based on what we need, not what the file is.
+		// A symlink can not point to a slice, so slices are always regular.
+		mode_t type = (!data->opts.symlinks || slice_length >= 0) ? S_IFREG : S_IFLNK;
+		*file = pfs_file_create (full_path, type, &data->opts.started_at);
+		if (!*file) {
+			printerr ("could not create new file");
+			g_free (full_path);
+			return FALSE;
+		}
+		(*file)->offset = slice_offset;
+		(*file)->length = slice_length;
 	}
+	g_free (full_path);
 
 	return TRUE;
 }
 
-static gboolean pfs_build_playlist_add_regular (
-	pfs_data* data, GHashTable* filetable, GString* relative_base, pfs_file_entry* entry
+pfs_file* pfs_build_playlist_resolve_entry (
+	pfs_data* data, GString* relative_base, const pfs_file_entry* entry, char** name
 ) {
-	char* path = entry->path;
-	char* full_path = pfs_build_playlist_get_full_path(data, relative_base, path);
-	if (full_path == NULL) {
-		// Something happened, warning was already printed, skip file. 
-		return TRUE;
+	*name = pfs_basename (entry->path);
+	if (strlen (*name) > NAME_MAX) {
+		printwarnf ("filename '%s' is too long, ignoring", *name);
+		g_clear_pointer (name, g_free);
+		return NULL;
 	}
+	pfs_build_candidate candidate = {
+		.path = entry->path,
+		.name = *name,
+		.relative_base = relative_base,
+		.type = entry->type,
+		.checked = entry->checked,
+	};
+	pfs_file* file = NULL;
+	pfs_build_playlist_create_file (data, &candidate, &file);
+	if (file == NULL) {
+		g_clear_pointer (name, g_free);
+	}
+	else {
+		pfs_build_playlist_report_file (data, *name, entry->type, file);
+	}
+	return file;
+}
 
+static void pfs_build_playlist_insert (
+	pfs_data* data, pfs_table* filetable, char* name, pfs_file* file
+) {
+	pfs_stats_phase_begin (PFS_PHASE_FILES_TABLE);
+	// Operations may already be reading the table if it is loaded in background.
+	g_rw_lock_writer_lock (&data->filetable_lock);
+	// Only one candidate wins for each name, so nothing is replaced here.
+	pfs_table_insert (filetable, name, file);
+	g_rw_lock_writer_unlock (&data->filetable_lock);
+	pfs_stats_count (PFS_COUNTER_ENTRIES_ADDED, 1);
+	pfs_stats_phase_end (PFS_PHASE_FILES_TABLE);
+}
+
+// Files are concatenated in order they are resolved, which is the order of their last entries.
+static void pfs_build_playlist_concat_append (
+	pfs_data* data, pfs_file* file
+) {
+	if (file->length >= 0) {
+		// Slices are already checked to be inside regular files.
+		pfs_concat_append (data->concat, file->path->str, file->offset, file->length);
+		return;
+	}
 	struct stat filestat;
-	if (0 != lstat (full_path, &filestat)) {
-		printwarnf ("file '%s' is inaccessible, ignoring", path);
+	pfs_stats_count (PFS_COUNTER_SYSCALLS, 1);
+	if (0 != stat (file->path->str, &filestat) || !S_ISREG (filestat.st_mode)) {
+		printwarnf ("file '%s' is not a regular file, not adding it to '%s'", file->path->str, data->opts.concat);
+		return;
+	}
+	pfs_concat_append (data->concat, file->path->str, 0, filestat.st_size);
+}
+
+static gboolean pfs_build_playlist_concat_finish (
+	pfs_data* data, pfs_table* filetable
+) {
+	// Record has no original file, path is left empty so that nothing is accessed by accident.
+	pfs_file* file = pfs_file_create ("", S_IFREG, &data->opts.started_at);
+	if (!file) {
+		printerr ("could not create new file");
+		return FALSE;
+	}
+	file->concat = data->concat;
+	printinfof ("Concatenating %u files into '%s'", pfs_concat_count (data->concat), data->opts.concat);
+	g_rw_lock_writer_lock (&data->filetable_lock);
+	if (!pfs_table_replace (filetable, g_strdup (data->opts.concat), file)) {
+		printwarnf ("'%s' replaces a file with the same name", data->opts.concat);
+	}
+	g_rw_lock_writer_unlock (&data->filetable_lock);
+	return TRUE;
+}
+
+static void pfs_build_playlist_freeze (
+	pfs_data* data
+) {
+	// Read-only mounts never change the table, so lookups can skip locking and chaining.
+	// Watching original files and accepting changes at --control change it though.
+	if (!data->opts.fuse.ro || data->opts.watch || data->opts.control != NULL) {
+		return;
 	}
-	else if (S_ISDIR (filestat.st_mode)) {
-		printwarnf ("file '%s' is a directory, ignoring", path);
+	pfs_stats_phase_begin (PFS_PHASE_FREEZE);
+	pfs_frozen* frozen = pfs_frozen_new (data->filetable);
+	if (frozen == NULL) {
+		printwarn ("could not freeze file table, using a regular one");
 	}
 	else {
-		// name is used as the key, do not free it here!
-		char* name = pfs_basename (path);
-		if (strlen (name) <= NAME_MAX) {
-			// Set type to symlink/regular based on what we need, not what the file is.
-			mode_t type = !data->opts.symlinks ? S_IFREG : S_IFLNK;
-			pfs_file* file = pfs_file_create (full_path, type, &data->opts.started_at);
-			if (!file) {
-				printerr ("could not create new file");
-				return FALSE;
-			}
-			
-			printinfof("  %s : %s", name, full_path);
-			// Replace in case we encountered the name already.
-			if (!g_hash_table_replace (filetable, name, file)) {
-				printinfof ("    Replaced previous definition of '%s'", name);
+		// Operations may already be running if the table is loaded in background.
+		g_atomic_pointer_set (&data->frozen, frozen);
+	}
+	pfs_stats_phase_end (PFS_PHASE_FREEZE);
+}
+
+/*
+---- Background loading ----
+*/
+
+static gpointer pfs_background_load (
+	gpointer data
+);
+
+static void pfs_background_load_prepare (
+	pfs_data* data, GString* cwd
+) {
+	// FUSE changes working directory to "/" when daemonizing,
+	// so lists have to be found before that.
+	if (data->opts.lists != NULL) {
+		char* current_dir = g_get_current_dir ();
+		for (size_t ilist = 0; data->opts.lists[ilist]; ilist++) {
+			if (!g_path_is_absolute (data->opts.lists[ilist])) {
+				// This is never freed, same as argv.
+				data->opts.lists[ilist] = g_build_filename (current_dir, data->opts.lists[ilist], NULL);
 			}
 		}
-		else {
-			printwarnf ("filename '%s' is too long, ignoring", name);
-			g_free (name);
-		}
+		g_free (current_dir);
 	}
-	g_free (full_path);
-
-	return TRUE;
+	data->loader.cwd = cwd;
+	// Set now, so that operations wait even if they come before the thread starts.
+	g_atomic_int_set (&data->loader.running, TRUE);
 }
 
-static char* pfs_build_playlist_get_full_path (
-	pfs_data* data, GString* relative_base, char* path
+void pfs_background_load_start (
+	pfs_data* data
 ) {
-	size_t length = strnlen (path, PATH_MAX);
-	if (length == 0) {
-		printwarn ("empty filename, ignoring");
-		return NULL;
+	if (!data->opts.background_load || data->loader.thread != NULL) {
+		return;
 	}
+	data->loader.thread = g_thread_new ("loader", pfs_background_load, data);
+}
 
-	if (path[0] == '/') {
-		return pfs_build_playlist_get_full_path_from_absolute(data, path);
+void pfs_background_load_wait (
+	pfs_data* data
+) {
+	if (!g_atomic_int_get (&data->loader.running)) {
+		return;
 	}
-	else {
-		return pfs_build_playlist_get_full_path_from_relative(data, relative_base, path, length);
+	g_mutex_lock (&data->loader.lock);
+	while (g_atomic_int_get (&data->loader.running)) {
+		g_cond_wait (&data->loader.done, &data->loader.lock);
 	}
+	g_mutex_unlock (&data->loader.lock);
 }
 
-static char* pfs_build_playlist_get_full_path_from_absolute (
-	pfs_data* data, char* path
+void pfs_background_load_stop (
+	pfs_data* data
 ) {
-	// Absolute paths are already complete, no additional processing needed.
-	// We could call realpath(), but it can fail for overly long paths.
-	// In this case, we trust that the user knows what they are doing.
-	return g_strdup (path);
+	if (data->loader.thread == NULL) {
+		return;
+	}
+	g_atomic_int_set (&data->loader.cancelled, TRUE);
+	g_thread_join (data->loader.thread);
+	data->loader.thread = NULL;
 }
 
-static char* pfs_build_playlist_get_full_path_from_relative (
-	pfs_data* data, GString* relative_base, char* path, size_t length
+static gpointer pfs_background_load (
+	gpointer pointer
 ) {
-	char* full_path = NULL;
-	
-	// Relative paths need more checks and handling.
-	if (relative_base == NULL) {
-		printinfof ("Ignoring relative path '%s'", path);
+	pfs_data* data = (pfs_data*) pointer;
+	GString* cwd = data->loader.cwd;
+	data->loader.cwd = NULL;
+
+	pfs_stats_phase_begin (PFS_PHASE_PLAYLIST);
+	// The mount is already there, so the best we can do on errors is to keep what was loaded.
+	if (!pfs_build_playlist (data, cwd) && !g_atomic_int_get (&data->loader.cancelled)) {
+		printerr ("could not load the whole playlist");
 	}
-	else if (relative_base->len + length >= PATH_MAX) {
-		printwarn ("filename too long, ignoring");
+	pfs_stats_phase_end (PFS_PHASE_PLAYLIST);
+	if (data->opts.timings) {
+		pfs_stats_report (stderr);
 	}
-	else {
-		full_path = g_malloc (sizeof (*full_path) * (relative_base->len + length + 1));
-		strcpy (full_path, relative_base->str);
-		strcpy (full_path + relative_base->len, path);
-	}
-	return full_path;
+	fflush (stderr);
+
+	g_mutex_lock (&data->loader.lock);
+	g_atomic_int_set (&data->loader.running, FALSE);
+	g_cond_broadcast (&data->loader.done);
+	g_mutex_unlock (&data->loader.lock);
+	return NULL;
 }
 
 /*
@@ -428,15 +932,19 @@ static gboolean pfs_option_callback_relative (
 // 	return TRUE;
 // }
 
+/*
+@parameter served: Whether options come from a client of --server, which must never exit the process
+*/
 static GOptionContext* pfs_setup_options (
-	pfs_data* data
+	pfs_data* data, gboolean served
 ) {
 	GOptionContext* optionContext = g_option_context_new ("[LIST...] [MOUNT_DIR]");
 
 	g_option_context_set_summary (
 		optionContext, "PlaylistFS mounts a FUSE filesystem with files taken from user-supplied list(s) or specified on command line."
 	);
-	g_option_context_set_help_enabled (optionContext, TRUE);
+	// GOption exits after printing help.
+	g_option_context_set_help_enabled (optionContext, !served);
 
 	GOptionGroup* mainGroup = g_option_group_new (
 		NULL, NULL, NULL, data, NULL
@@ -446,6 +954,7 @@ static GOptionContext* pfs_setup_options (
 		{ "file", 'f', G_OPTION_FLAG_FILENAME, G_OPTION_ARG_CALLBACK, pfs_option_callback_add_file, "Add a single FILE, overriding any lists", "FILE" },
 		{ "symlink", 's', G_OPTION_FLAG_FILENAME, G_OPTION_ARG_CALLBACK, pfs_option_callback_add_symlink, "Add a single symlink to FILE, overriding any lists", "FILE" },
 		{ "symlinks", 'S', G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &data->opts.symlinks, "Display all files as symlinks to originals", NULL },
+		{ "fanout", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &data->opts.fanout, "Spread files into 256 subdirectories by hash of their names", NULL },
 		{ "no-relative", 'N', G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, pfs_option_callback_no_relative, "Combine --no-relative-files and --no-relative-paths", NULL },
 		{ "relative", 0, G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, pfs_option_callback_relative, "Enable all relative path handling", NULL },
 		{ "no-relative-files", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &data->opts.relative_disabled.files, "Disable relative path handling for files added with --file", NULL },
@@ -454,6 +963,18 @@ static GOptionContext* pfs_setup_options (
 		{ "relative-paths", 0, G_OPTION_FLAG_REVERSE, G_OPTION_ARG_NONE, &data->opts.relative_disabled.paths, "Reverse effect of --no-relative-paths", NULL },
 		{ "verbose", 'v', G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &data->opts.verbose, "Describe what is happening", NULL },
 		{ "quiet", 'q', G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &data->opts.quiet, "Suppress warnings", NULL },
+		{ "concat", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, &data->opts.concat, "Add a read-only file NAME, concatenating all files in order", "NAME" },
+		{ "cache-dir", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, &data->opts.cache_dir, "Cache original files in DIR on fast storage while reading them", "DIR" },
+		{ "cache-size", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &data->opts.cache_size, "Limit size of --cache-dir to MIB mebibytes (default: 1024)", "MIB" },
+		{ "memory-cache", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &data->opts.memory_cache, "Keep up to MIB mebibytes of small files in memory", "MIB" },
+		{ "mmap-cache", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &data->opts.mmap_cache, "Read big files through memory mappings, using up to MIB mebibytes of address space (at least 16)", "MIB" },
+		{ "background-load", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &data->opts.background_load, "Mount immediately and load LISTs in background", NULL },
+		{ "watch", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &data->opts.watch, "Follow original files when they are moved, deleted or changed", NULL },
+		{ "server", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, &data->opts.server, "Serve mounts requested with --connect from one process", "SOCKET" },
+		{ "connect", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, &data->opts.connect, "Ask a server started with --server to mount", "SOCKET" },
+		{ "control", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, &data->opts.control, "Accept batches of changes at SOCKET", "SOCKET" },
+		{ "apply", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_FILENAME, &data->opts.apply, "Apply changes from standard input to a filesystem mounted with --control", "SOCKET" },
+		{ "timings", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &data->opts.timings, "Report time and resources spent on startup", NULL },
 		{ "version", 'V', G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &data->opts.show_version, "Display version information", NULL },
 		{}
 	};
@@ -470,6 +991,16 @@ static GOptionContext* pfs_setup_options (
 		{ "fsname", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING, &data->opts.fuse.fsname, "Set filesystem name", "NAME" },
 		{ "nonempty", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &data->opts.fuse.nonempty, "Allow mounts over non-empty targets (ignored on FUSE 3)", NULL },
 		{ "debug", 'd', G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &data->opts.fuse.debug, "Enable debugging mode", NULL },
+		{ "writeback-cache", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &data->opts.fuse.writeback_cache, "Cache writes in kernel and pass them in batches (FUSE 3 only)", NULL },
+		{ "max-write", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &data->opts.fuse.max_write, "Set maximum size of a single write request", "BYTES" },
+		{ "big-writes", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &data->opts.fuse.big_writes, "Allow write requests bigger than 4 KiB (always on with FUSE 3)", NULL },
+		{ "max-read", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &data->opts.fuse.max_read, "Set maximum size of a single read request", "BYTES" },
+		{ "max-threads", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &data->opts.fuse.max_threads, "Set maximum number of worker threads (libfuse 3.12+)", "N" },
+		{ "max-idle-threads", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &data->opts.fuse.max_idle_threads, "Set maximum number of idle worker threads (FUSE 3 only)", "N" },
+		{ "clone-fd", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE, &data->opts.fuse.clone_fd, "Use a separate FUSE device descriptor for each worker thread (FUSE 3 only)", NULL },
+		{ "max-background", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &data->opts.fuse.max_background, "Set maximum number of pending background requests", "N" },
+		{ "congestion-threshold", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &data->opts.fuse.congestion_threshold, "Set number of background requests considered a congestion", "N" },
+		{ "cache-timeout", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT, &data->opts.fuse.cache_timeout, "Let kernel cache names and attributes for SECONDS", "SECONDS" },
 		// { "fuse-help", 0, G_OPTION_FLAG_HIDDEN|G_OPTION_FLAG_NO_ARG, G_OPTION_ARG_CALLBACK, pfs_show_fuse_help_callback, NULL, NULL},
 		{}
 	};
@@ -480,19 +1011,27 @@ static GOptionContext* pfs_setup_options (
 }
 
 static gboolean pfs_parse_options (
-	pfs_data* data, int argc, char* argv[]
+	pfs_data* data, int argc, char* argv[], gboolean served
 ) {
-	GOptionContext* optionContext = pfs_setup_options (data);
+	GOptionContext* optionContext = pfs_setup_options (data, served);
 
 	GError* optionError = NULL;
 	if (!g_option_context_parse (optionContext, &argc, &argv, &optionError)) {
 		printerrf ("%s", optionError->message);
-		fputs (g_option_context_get_help (optionContext, TRUE, NULL), stderr);
+		if (!served) {
+			fputs (g_option_context_get_help (optionContext, TRUE, NULL), stderr);
+		}
+		g_error_free (optionError);
+		g_option_context_free (optionContext);
 		return FALSE;
 	}
 	g_option_context_free (optionContext);
 	optionContext = NULL;
 
+	if (data->opts.show_version && served) {
+		printerr ("--version can not be passed to a server");
+		return FALSE;
+	}
 	if (data->opts.show_version) {
 		puts (
 			"PlaylistFS " PLAYLISTFS_VERSION PLAYLISTFS_METADATA "\n"
@@ -505,6 +1044,40 @@ static gboolean pfs_parse_options (
 		}
 	}
 
+	// Numeric options use 0 for "not set".
+	const struct { const char* name; gint value; } numeric_options[] = {
+		{ "cache-size", data->opts.cache_size },
+		{ "memory-cache", data->opts.memory_cache },
+		{ "mmap-cache", data->opts.mmap_cache },
+		{ "max-write", data->opts.fuse.max_write },
+		{ "max-read", data->opts.fuse.max_read },
+		{ "max-threads", data->opts.fuse.max_threads },
+		{ "max-idle-threads", data->opts.fuse.max_idle_threads },
+		{ "max-background", data->opts.fuse.max_background },
+		{ "congestion-threshold", data->opts.fuse.congestion_threshold },
+		{ "cache-timeout", data->opts.fuse.cache_timeout },
+	};
+	for (size_t ioption = 0; ioption < G_N_ELEMENTS (numeric_options); ioption++) {
+		if (numeric_options[ioption].value < 0) {
+			printerrf ("--%s can not be negative", numeric_options[ioption].name);
+			return FALSE;
+		}
+	}
+	// A smaller budget would unmap every window right after mapping it.
+	if (data->opts.mmap_cache > 0 && data->opts.mmap_cache < PFS_MAPCACHE_WINDOW_SIZE >> 20) {
+		printerrf ("--mmap-cache can not be less than %d", PFS_MAPCACHE_WINDOW_SIZE >> 20);
+		return FALSE;
+	}
+
+	if (data->opts.concat != NULL) {
+		size_t length = strlen (data->opts.concat);
+		if (length == 0 || length > NAME_MAX || strchr (data->opts.concat, '/') != NULL
+			|| 0 == strcmp (data->opts.concat, ".") || 0 == strcmp (data->opts.concat, "..")) {
+			printerrf ("'%s' is not a valid name for --concat", data->opts.concat);
+			return FALSE;
+		}
+	}
+
 	if (!data->opts.relative_disabled.files || !data->opts.relative_disabled.paths) {
 		data->opts.relative_disabled.all = FALSE;
 	}
@@ -512,7 +1085,8 @@ static gboolean pfs_parse_options (
 		data->opts.relative_disabled.all = TRUE;
 	}
 
-	if (data->opts.mount_point == NULL) {
+	// Server only mounts what is requested later, and changes are applied to a mounted filesystem.
+	if (data->opts.mount_point == NULL && data->opts.server == NULL && data->opts.apply == NULL) {
 		if (argc == 1) {
 			printerr ("no target mount point");
 			return FALSE;
@@ -618,23 +1192,40 @@ static gboolean pfs_check_mount_point (
 	}
 }
 
+// Directories of all files are kept open (see files.c), which can use a lot of descriptors.
+static void pfs_raise_file_limit (
+	void
+) {
+	struct rlimit limit;
+	if (0 == getrlimit (RLIMIT_NOFILE, &limit) && limit.rlim_cur < limit.rlim_max) {
+		limit.rlim_cur = limit.rlim_max;
+		setrlimit (RLIMIT_NOFILE, &limit);
+	}
+}
+
 /*
 ---- Arguments to FUSE ----
 */
 static char* pfs_setup_fuse_fsname (
 	pfs_data* data
 );
+static char* pfs_setup_fuse_allocated (
+	GPtrArray* strings, char* argument
+);
 
 static gboolean pfs_setup_fuse_arguments (
-	int* argc, char** argv[], char* pfs_name, pfs_data* data
+	int* argc, char** argv[], char* pfs_name, pfs_data* data, GPtrArray* strings
 ) {
 	int fuse_argc = 0;
-	char** fuse_argv = g_new (char*, 16);
+	char** fuse_argv = g_new (char*, 32);
 
 	fuse_argv[fuse_argc++] = pfs_name;
+	// FUSE 3 gets the mount point in fuse_mount(), see pfs_run_fuse().
+	#if FUSE_USE_VERSION < 30
 	fuse_argv[fuse_argc++] = data->opts.mount_point;
+	#endif
 
-	fuse_argv[fuse_argc] = pfs_setup_fuse_fsname(data);
+	fuse_argv[fuse_argc] = pfs_setup_fuse_allocated (strings, pfs_setup_fuse_fsname (data));
 	printinfo ("Passing options to FUSE:");
 	printinfof ("  %s (set filesystem name)", fuse_argv[fuse_argc]);
 	fuse_argc++;
@@ -666,9 +1257,62 @@ static gboolean pfs_setup_fuse_arguments (
 	}
 	#endif
 
+	// FUSE 3 has these in struct fuse_conn_info, see operations.c.
+	#if FUSE_USE_VERSION < 30
+	if (data->opts.fuse.big_writes) {
+		fuse_argv[fuse_argc++] = "-obig_writes";
+		printinfo ("  -obig_writes (allow big write requests)");
+	}
+	if (data->opts.fuse.max_write > 0) {
+		fuse_argv[fuse_argc] = pfs_setup_fuse_allocated (strings, g_strdup_printf ("-omax_write=%d", data->opts.fuse.max_write));
+		printinfof ("  %s (set maximum size of write requests)", fuse_argv[fuse_argc]);
+		fuse_argc++;
+	}
+	if (data->opts.fuse.max_background > 0) {
+		fuse_argv[fuse_argc] = pfs_setup_fuse_allocated (strings, g_strdup_printf ("-omax_background=%d", data->opts.fuse.max_background));
+		printinfof ("  %s (set maximum number of background requests)", fuse_argv[fuse_argc]);
+		fuse_argc++;
+	}
+	if (data->opts.fuse.congestion_threshold > 0) {
+		fuse_argv[fuse_argc] = pfs_setup_fuse_allocated (strings, g_strdup_printf ("-ocongestion_threshold=%d", data->opts.fuse.congestion_threshold));
+		printinfof ("  %s (set congestion threshold)", fuse_argv[fuse_argc]);
+		fuse_argc++;
+	}
+	if (data->opts.fuse.writeback_cache) {
+		printwarn ("writeback cache requires FUSE 3, ignoring");
+		data->opts.fuse.writeback_cache = FALSE;
+	}
+	if (data->opts.fuse.clone_fd || data->opts.fuse.max_idle_threads > 0) {
+		printwarn ("worker thread options require FUSE 3, ignoring");
+	}
+	#endif
+	#if FUSE_USE_VERSION < 312
+	if (data->opts.fuse.max_threads > 0) {
+		printwarn ("maximum number of threads can only be set with libfuse 3.12 or newer, ignoring");
+	}
+	#endif
+	if (data->opts.fuse.max_read > 0) {
+		fuse_argv[fuse_argc] = pfs_setup_fuse_allocated (strings, g_strdup_printf ("-omax_read=%d", data->opts.fuse.max_read));
+		printinfof ("  %s (set maximum size of read requests)", fuse_argv[fuse_argc]);
+		fuse_argc++;
+	}
+
 	// FUSE 3 has these in struct fuse_config, see operations.c.
 	#if FUSE_USE_VERSION < 30
-	fuse_argv[fuse_argc++] = "-oattr_timeout=0";
+	if (data->opts.fuse.cache_timeout > 0) {
+		fuse_argv[fuse_argc] = pfs_setup_fuse_allocated (strings, g_strdup_printf ("-oattr_timeout=%d", data->opts.fuse.cache_timeout));
+		printinfof ("  %s (cache attributes in kernel)", fuse_argv[fuse_argc]);
+		fuse_argc++;
+		fuse_argv[fuse_argc] = pfs_setup_fuse_allocated (strings, g_strdup_printf ("-oentry_timeout=%d", data->opts.fuse.cache_timeout));
+		printinfof ("  %s (cache names in kernel)", fuse_argv[fuse_argc]);
+		fuse_argc++;
+		if (data->opts.watch) {
+			printwarn ("kernel caches can only be invalidated on changes with FUSE 3");
+		}
+	}
+	else {
+		fuse_argv[fuse_argc++] = "-oattr_timeout=0";
+	}
 	fuse_argv[fuse_argc++] = "-ouse_ino";
 	#endif
 
@@ -677,6 +1321,16 @@ static gboolean pfs_setup_fuse_arguments (
 	return TRUE;
 }
 
+// Served mounts free allocated arguments when they are unmounted, see pfs_serve_mount().
+static char* pfs_setup_fuse_allocated (
+	GPtrArray* strings, char* argument
+) {
+	if (strings != NULL) {
+		g_ptr_array_add (strings, argument);
+	}
+	return argument;
+}
+
 static char* pfs_setup_fuse_fsname (
 	pfs_data* data
 ) {
@@ -699,3 +1353,430 @@ static char* pfs_setup_fuse_fsname (
 	}
 	return fuse_fsname;
 }
+
+/*
+---- Running FUSE ----
+*/
+static void pfs_report_startup (
+	pfs_data* data
+);
+#if FUSE_USE_VERSION >= 30
+static struct fuse* pfs_mount_fuse (
+	struct fuse_args* args, pfs_data* data
+);
+static int pfs_run_fuse_loop (
+	struct fuse* fuse, pfs_data* data
+);
+#endif
+
+static int pfs_run_fuse (
+	int fuse_argc, char* fuse_argv[], pfs_data* data
+) {
+	#if FUSE_USE_VERSION < 30
+	// Setup and mounting happen inside fuse_main(), so they are not included in timings.
+	pfs_report_startup (data);
+	return fuse_main (fuse_argc, fuse_argv, &pfs_operations, data);
+	#else
+	// This is what fuse_main() does, but with control over the loop.
+	struct fuse_args args = FUSE_ARGS_INIT (fuse_argc, fuse_argv);
+	struct fuse* fuse = pfs_mount_fuse (&args, data);
+	if (fuse == NULL) {
+		fuse_opt_free_args (&args);
+		return EXIT_FAILURE;
+	}
+
+	int result = EXIT_FAILURE;
+	pfs_report_startup (data);
+	struct fuse_session* session = fuse_get_session (fuse);
+	// Debug mode implies staying in foreground, same as in fuse_main().
+	if (0 == fuse_daemonize (data->opts.fuse.debug)) {
+		if (0 == fuse_set_signal_handlers (session)) {
+			if (0 == pfs_run_fuse_loop (fuse, data)) {
+				result = EXIT_SUCCESS;
+			}
+			fuse_remove_signal_handlers (session);
+		}
+	}
+	fuse_unmount (fuse);
+	// This calls pfs_destroy(), freeing data.
+	fuse_destroy (fuse);
+	fuse_opt_free_args (&args);
+	return result;
+	#endif
+}
+
+#if FUSE_USE_VERSION >= 30
+/*
+Create a FUSE instance and mount it. On failure, data is freed.
+*/
+static struct fuse* pfs_mount_fuse (
+	struct fuse_args* args, pfs_data* data
+) {
+	pfs_stats_phase_begin (PFS_PHASE_FUSE_NEW);
+	struct fuse* fuse = fuse_new (args, &pfs_operations, sizeof (pfs_operations), data);
+	pfs_stats_phase_end (PFS_PHASE_FUSE_NEW);
+	if (fuse == NULL) {
+		// libfuse has already printed the reason.
+		pfs_free_pfs_data (data);
+		return NULL;
+	}
+
+	pfs_stats_phase_begin (PFS_PHASE_FUSE_MOUNT);
+	gboolean mounted = (0 == fuse_mount (fuse, data->opts.mount_point));
+	pfs_stats_phase_end (PFS_PHASE_FUSE_MOUNT);
+	if (!mounted) {
+		// This calls pfs_destroy(), freeing data.
+		fuse_destroy (fuse);
+		return NULL;
+	}
+	return fuse;
+}
+#endif
+
+static void pfs_report_startup (
+	pfs_data* data
+) {
+	// With background loading, the report is printed once loading finishes.
+	if (data->opts.timings && !data->opts.background_load) {
+		pfs_stats_report (pfs_messages (data));
+	}
+	fflush (pfs_messages (data));
+}
+
+#if FUSE_USE_VERSION >= 30
+static int pfs_run_fuse_loop (
+	struct fuse* fuse, pfs_data* data
+) {
+	#if FUSE_USE_VERSION >= 312
+	struct fuse_loop_config* config = fuse_loop_cfg_create ();
+	fuse_loop_cfg_set_clone_fd (config, data->opts.fuse.clone_fd);
+	if (data->opts.fuse.max_idle_threads > 0) {
+		fuse_loop_cfg_set_idle_threads (config, data->opts.fuse.max_idle_threads);
+	}
+	if (data->opts.fuse.max_threads > 0) {
+		fuse_loop_cfg_set_max_threads (config, data->opts.fuse.max_threads);
+	}
+	int result = fuse_loop_mt (fuse, config);
+	fuse_loop_cfg_destroy (config);
+	return result;
+	#else
+	struct fuse_loop_config config = {
+		.clone_fd = data->opts.fuse.clone_fd,
+		// Default of libfuse.
+		.max_idle_threads = data->opts.fuse.max_idle_threads > 0 ? data->opts.fuse.max_idle_threads : 10,
+	};
+	return fuse_loop_mt (fuse, &config);
+	#endif
+}
+#endif
+
+/*
+---- Server mode ----
+*/
+
+#if FUSE_USE_VERSION >= 30
+typedef struct {
+	int client; // Connection of the client, closed once it gets a reply
+	struct fuse* fuse; // Set once started
+	pfs_data* data; // Freed by FUSE on unmounting
+	struct fuse_args args;
+	char** request; // Working directory and command line, which options point into
+	GPtrArray* strings; // Paths made absolute and FUSE arguments, which options point into
+	char** fuse_argv;
+	GThread* thread; // Mounts the filesystem and runs its loop
+	pthread_t loop_thread; // Set once started, to interrupt the loop
+	gint started; // Set once the filesystem is mounted and its loop is about to run
+	gint stopping; // Set when the server stops, so that a filesystem being built is not mounted
+	gint finished;
+} pfs_mount;
+
+static int pfs_serve_signal_pipe[2] = { -1, -1 };
+
+static void pfs_serve_signal (
+	int signal
+);
+static void pfs_serve_interrupt (
+	int signal
+);
+static int pfs_serve_mount (
+	pfs_mount* mount
+);
+static gpointer pfs_serve_thread (
+	gpointer pointer
+);
+static void pfs_serve_reap (
+	GPtrArray* mounts, gboolean stop
+);
+#endif
+
+/*
+Serve mounts requested by clients from one process, until interrupted.
+All mounts share the directory pool and other global state, but have their own file tables.
+*/
+static int pfs_serve (
+	pfs_data* data
+) {
+	#if FUSE_USE_VERSION < 30
+	printerr ("server mode requires FUSE 3");
+	return EXIT_FAILURE;
+	#else
+	int listen_fd = pfs_server_listen (data->opts.server);
+	if (listen_fd == -EADDRINUSE) {
+		printerrf ("a server is already running at '%s'", data->opts.server);
+		return EXIT_FAILURE;
+	}
+	if (listen_fd < 0) {
+		printerrf ("could not listen at '%s': %s", data->opts.server, strerror (-listen_fd));
+		return EXIT_FAILURE;
+	}
+	if (pipe2 (pfs_serve_signal_pipe, O_CLOEXEC | O_NONBLOCK) < 0) {
+		printerrf ("could not set up signal handling: %s", strerror (errno));
+		return EXIT_FAILURE;
+	}
+	// Not restarting interrupted calls is the point of these.
+	struct sigaction action = { .sa_handler = pfs_serve_signal };
+	sigemptyset (&action.sa_mask);
+	sigaction (SIGINT, &action, NULL);
+	sigaction (SIGTERM, &action, NULL);
+	sigaction (SIGHUP, &action, NULL);
+	action.sa_handler = pfs_serve_interrupt;
+	sigaction (SIGUSR1, &action, NULL);
+	action.sa_handler = SIG_IGN;
+	// Clients may disconnect before getting a reply.
+	sigaction (SIGPIPE, &action, NULL);
+	pfs_raise_file_limit ();
+	printinfof ("Serving mounts at '%s'", data->opts.server);
+	fflush (stderr);
+
+	GPtrArray* mounts = g_ptr_array_new ();
+	struct pollfd fds[2] = {
+		{ .fd = listen_fd, .events = POLLIN },
+		{ .fd = pfs_serve_signal_pipe[0], .events = POLLIN },
+	};
+	while (TRUE) {
+		// Wake up once in a while to clean up after unmounted filesystems.
+		int ready = poll (fds, G_N_ELEMENTS (fds), 1000);
+		pfs_serve_reap (mounts, FALSE);
+		if (ready < 0 && errno != EINTR) {
+			printerrf ("could not wait for clients: %s", strerror (errno));
+			break;
+		}
+		if (ready <= 0) {
+			continue;
+		}
+		if (fds[1].revents != 0) {
+			break;
+		}
+		if (!(fds[0].revents & POLLIN)) {
+			continue;
+		}
+		int client = accept4 (listen_fd, NULL, NULL, SOCK_CLOEXEC);
+		if (client < 0) {
+			continue;
+		}
+		// Building a playlist may take a while, so every mount is built on its own thread,
+		// and other clients and signals are not kept waiting.
+		pfs_mount* mount = g_malloc0 (sizeof (*mount));
+		mount->client = client;
+		mount->strings = g_ptr_array_new_with_free_func (g_free);
+		mount->thread = g_thread_new ("mount", pfs_serve_thread, mount);
+		g_ptr_array_add (mounts, mount);
+	}
+
+	printinfo ("Unmounting all filesystems");
+	pfs_serve_reap (mounts, TRUE);
+	g_ptr_array_unref (mounts);
+	close (listen_fd);
+	unlink (data->opts.server);
+	pfs_free_pfs_data (data);
+	return EXIT_SUCCESS;
+	#endif
+}
+
+#if FUSE_USE_VERSION >= 30
+static void pfs_serve_signal (
+	int signal
+) {
+	char byte = (char) signal;
+	// Nothing to do if it fails, as the pipe already has something in it.
+	if (write (pfs_serve_signal_pipe[1], &byte, 1) < 0) {}
+}
+
+static void pfs_serve_interrupt (
+	int signal
+) {
+	// Only interrupts whatever the thread is waiting for.
+}
+
+/*
+Make a relative path of a client absolute, as the working directory is shared by all mounts.
+@parameter path: Path to replace, freed with g_free()
+*/
+static void pfs_serve_make_absolute (
+	char** path, const char* cwd
+) {
+	if (*path != NULL && !g_path_is_absolute (*path)) {
+		char* absolute = g_build_filename (cwd, *path, NULL);
+		g_free (*path);
+		*path = absolute;
+	}
+}
+
+static void pfs_serve_mount_free (
+	pfs_mount* mount
+) {
+	fuse_opt_free_args (&mount->args);
+	g_free (mount->fuse_argv);
+	g_ptr_array_unref (mount->strings);
+	g_strfreev (mount->request);
+	g_free (mount);
+}
+
+/*
+Mount a filesystem for a client, on the thread of the mount. This repeats main(), but nothing may
+exit the process, or change anything shared with other mounts, like standard error or the working
+directory. Messages go to the client until the filesystem is mounted, and to standard error afterwards.
+*/
+static int pfs_serve_mount (
+	pfs_mount* mount
+) {
+	char** request = mount->request;
+	int argc = g_strv_length (request) - 1;
+	char** argv = request + 1;
+
+	pfs_data* data = g_malloc0 (sizeof (*data));
+	int messages_fd = dup (mount->client);
+	data->messages = messages_fd >= 0 ? fdopen (messages_fd, "w") : NULL;
+	if (data->messages == NULL) {
+		if (messages_fd >= 0)
+			close (messages_fd);
+		pfs_free_pfs_data (data);
+		return EXIT_FAILURE;
+	}
+	// Same as stderr.
+	setvbuf (data->messages, NULL, _IONBF, 0);
+	// Relative paths of the client are resolved against its directory.
+	data->opts.cwd = request[0];
+	if (!g_path_is_absolute (data->opts.cwd)) {
+		printerrf ("could not use directory '%s'", data->opts.cwd);
+		pfs_free_pfs_data (data);
+		return EXIT_FAILURE;
+	}
+
+	// Option parsing reorders argv, so the array itself is freed with the mount.
+	char** arguments = g_new (char*, argc + 1);
+	memcpy (arguments, argv, sizeof (*argv) * (argc + 1));
+	gboolean parsed = pfs_parse_options (data, argc, arguments, TRUE);
+	g_free (arguments);
+	if (parsed && data->opts.timings) {
+		// Timings are collected for the whole process.
+		printerr ("--timings can not be passed to a server");
+		parsed = FALSE;
+	}
+	if (!parsed) {
+		pfs_free_pfs_data (data);
+		return EXIT_FAILURE;
+	}
+	pfs_serve_make_absolute (&data->opts.mount_point, data->opts.cwd);
+	pfs_serve_make_absolute (&data->opts.cache_dir, data->opts.cwd);
+	pfs_serve_make_absolute (&data->opts.control, data->opts.cwd);
+	for (char** list = data->opts.lists; *list != NULL; list++) {
+		if (!g_path_is_absolute (*list)) {
+			*list = g_build_filename (data->opts.cwd, *list, NULL);
+			g_ptr_array_add (mount->strings, *list);
+		}
+	}
+	if (!pfs_prepare (data)) {
+		pfs_free_pfs_data (data);
+		return EXIT_FAILURE;
+	}
+	if (g_atomic_int_get (&mount->stopping)) {
+		printerr ("server is stopping");
+		pfs_free_pfs_data (data);
+		return EXIT_FAILURE;
+	}
+
+	int fuse_argc = 0;
+	pfs_stats_phase_begin (PFS_PHASE_FUSE_ARGUMENTS);
+	gboolean prepared = pfs_setup_fuse_arguments (&fuse_argc, &mount->fuse_argv, argv[0], data, mount->strings);
+	pfs_stats_phase_end (PFS_PHASE_FUSE_ARGUMENTS);
+	if (!prepared) {
+		pfs_free_pfs_data (data);
+		return EXIT_FAILURE;
+	}
+	mount->args = (struct fuse_args) FUSE_ARGS_INIT (fuse_argc, mount->fuse_argv);
+	mount->fuse = pfs_mount_fuse (&mount->args, data);
+	if (mount->fuse == NULL) {
+		return EXIT_FAILURE;
+	}
+	mount->data = data;
+	pfs_report_startup (data);
+	// The client is about to be disconnected, later messages of this filesystem go to stderr.
+	// Its other threads are only started once the loop runs.
+	fclose (data->messages);
+	data->messages = NULL;
+	return EXIT_SUCCESS;
+}
+
+static gpointer pfs_serve_thread (
+	gpointer pointer
+) {
+	pfs_mount* mount = (pfs_mount*) pointer;
+	// Signals stopping the server are for the main thread, they would only interrupt building here.
+	sigset_t signals;
+	sigemptyset (&signals);
+	sigaddset (&signals, SIGINT);
+	sigaddset (&signals, SIGTERM);
+	sigaddset (&signals, SIGHUP);
+	pthread_sigmask (SIG_BLOCK, &signals, NULL);
+
+	int status = EXIT_FAILURE;
+	mount->request = pfs_server_read_request (mount->client, PFS_SERVER_MAX_REQUEST);
+	if (mount->request != NULL) {
+		status = pfs_serve_mount (mount);
+	}
+	pfs_server_reply (mount->client, status);
+	close (mount->client);
+	if (status == EXIT_SUCCESS) {
+		mount->loop_thread = pthread_self ();
+		g_atomic_int_set (&mount->started, TRUE);
+		// Worker threads of FUSE block all signals, so only this one gets interrupted.
+		pfs_run_fuse_loop (mount->fuse, mount->data);
+		fuse_unmount (mount->fuse);
+		// This calls pfs_destroy(), freeing data.
+		fuse_destroy (mount->fuse);
+	}
+	g_atomic_int_set (&mount->finished, TRUE);
+	return NULL;
+}
+
+/*
+Clean up after filesystems which were unmounted. If stop is set, unmount all of them first.
+*/
+static void pfs_serve_reap (
+	GPtrArray* mounts, gboolean stop
+) {
+	for (guint imount = 0; imount < mounts->len; ) {
+		pfs_mount* mount = g_ptr_array_index (mounts, imount);
+		if (stop) {
+			// Filesystems being built are not mounted, but building them is waited for.
+			g_atomic_int_set (&mount->stopping, TRUE);
+			// The loop only checks for exit when interrupted, and the signal may come too early.
+			while (!g_atomic_int_get (&mount->finished)) {
+				if (g_atomic_int_get (&mount->started)) {
+					fuse_session_exit (fuse_get_session (mount->fuse));
+					pthread_kill (mount->loop_thread, SIGUSR1);
+				}
+				g_usleep (10000);
+			}
+		}
+		if (!g_atomic_int_get (&mount->finished)) {
+			imount++;
+			continue;
+		}
+		g_thread_join (mount->thread);
+		pfs_serve_mount_free (mount);
+		g_ptr_array_remove_index_fast (mounts, imount);
+	}
+}
+#endif
@@ -28,24 +28,43 @@
 #define _GNU_SOURCE // _XOPEN_SOURCE & GNU fallocate(), pread(), pwrite() and other
 #define _FILE_OFFSET_BITS 64 // FUSE requires 64-bit off_t
 
+#include "files.h"
+#include "table.h"
+
 #include <fuse.h>
 #include <glib.h>
+#include <stdio.h>
 #include <time.h>
 
 typedef struct {
 	char* path;
 	mode_t type;
+	gboolean checked; // Whether the file is known to exist and not be a directory
 } pfs_file_entry;
 
 typedef struct {
 	char** lists;
 	GArray* files;
 	char* mount_point;
+	char* server; // Socket to serve mounts at
+	char* connect; // Socket of a server to ask for mounting
+	char* control; // Socket to accept changes at
+	char* apply; // Socket of a filesystem to send changes to
+	char* concat; // Name of the file concatenating all others
+	const char* cwd; // Directory of the client of --server to resolve relative paths against, NULL for the current one
+	char* cache_dir; // Directory on fast storage to cache original files in
+	gint cache_size; // Budget of cache_dir, in MiB
+	gint memory_cache; // Budget for contents of small files kept in memory, in MiB, 0 if not used
+	gint mmap_cache; // Budget of address space for mapped windows of big files, in MiB, 0 if not used
 	struct timespec started_at;
 	gboolean symlinks;
+	gboolean fanout; // Spread files into subdirectories by parts of filetable
 	gboolean verbose;
 	gboolean show_version;
 	gboolean quiet;
+	gboolean timings;
+	gboolean background_load;
+	gboolean watch;
 	struct {
 		gboolean all;
 		gboolean files;
@@ -58,14 +77,97 @@ typedef struct {
 		gboolean noatime;
 		gboolean nonempty;
 		gboolean debug;
+		gboolean writeback_cache;
+		gboolean big_writes;
+		gint max_write;
+		gint max_read;
+		gint max_threads;
+		gint max_idle_threads;
+		gboolean clone_fd;
+		gint max_background;
+		gint congestion_threshold;
+		gint cache_timeout;
 	} fuse;
 } pfs_options;
 
 typedef struct {
 	pfs_options opts;
-	GHashTable* filetable;
+	pfs_table* filetable;
+	GRWLock filetable_lock; // Protects filetable, which is changed by operations and the loader
+	struct pfs_frozen* frozen; // Immutable copy of filetable for read-only mounts, used without locking
+	struct pfs_concat* concat; // Backing files of --concat, in playlist order
+	struct pfs_diskcache* diskcache; // Cache in --cache-dir, NULL if not used
+	struct pfs_memcache* memcache; // Cache of --memory-cache, NULL if not used
+	struct pfs_mapcache* mapcache; // Mapped windows of --mmap-cache, NULL if not used
+	struct pfs_xattrs* xattrs; // Extended attributes known to be missing
+	FILE* messages; // Where messages are printed, NULL for stderr, see pfs_serve_mount()
+	struct {
+		GThread* thread; // Set if the playlist is loaded in background
+		GString* cwd; // Working directory at startup, as FUSE changes it when daemonizing
+		GMutex lock; // Protects fields below
+		GCond done;
+		gint running; // Also read atomically without the lock
+		gint cancelled;
+	} loader;
+	struct {
+		GThread* thread; // Set if original files are watched
+		int wake_fd; // Signalled to stop the thread or to watch added files
+		gint stopping; // Set before signalling wake_fd to stop
+	} watcher;
+	struct {
+		GThread* thread; // Set if changes are accepted at --control
+		char* path; // Absolute path of the socket, set once listening
+		int listen_fd;
+		int wake_fd; // Signalled to stop the thread
+	} control;
 } pfs_data;
 
+// Number of bits of name hashes selecting the subdirectory of a file with --fanout.
+#define PFS_FANOUT_BITS 8
+
 void pfs_free_pfs_data (pfs_data* data);
 
+/*
+Get path of a file inside the filesystem from its name in filetable,
+to be freed with g_free(). With --fanout, it includes the subdirectory.
+*/
+char* pfs_name_to_path (const pfs_data* data, const char* name);
+
+/*
+Start building the playlist on a background thread, if --background-load was given.
+Must be called after FUSE has daemonized, as threads do not survive fork().
+*/
+void pfs_background_load_start (pfs_data* data);
+
+/*
+Wait until the background loader finishes. Returns immediately if it is not running.
+*/
+void pfs_background_load_wait (pfs_data* data);
+
+/*
+Stop the background loader as soon as possible and wait for it.
+*/
+void pfs_background_load_stop (pfs_data* data);
+
+/*
+Check a single entry and create a file for it, the same way as for entries of lists and --file.
+Returns NULL if the entry is not usable, warnings are printed.
+@parameter relative_base: Base for a relative path, ending with '/', or NULL to ignore relative paths
+@parameter entry: Path and type of the entry, S_IFREG or S_IFLNK
+@parameter name: Where to store name of the file, to be freed with g_free()
+*/
+pfs_file* pfs_build_playlist_resolve_entry (pfs_data* data, GString* relative_base, const pfs_file_entry* entry, char** name);
+
+static inline FILE* pfs_messages (const pfs_data* data) {
+	return data->messages != NULL ? data->messages : stderr;
+}
+
+// Message helpers. These expect a pfs_data* named `data` to be in scope.
+#define printwarn(x) {if(!data->opts.quiet) fputs("warning: " x "\n", pfs_messages (data));}
+#define printwarnf(x, ...) {if(!data->opts.quiet) fprintf(pfs_messages (data), "warning: " x "\n", __VA_ARGS__);}
+#define printerr(x) fputs("error: " x "\n", pfs_messages (data))
+#define printerrf(x, ...) fprintf(pfs_messages (data), "error: " x "\n", __VA_ARGS__)
+#define printinfo(x) {if(data->opts.verbose) fputs(x "\n", pfs_messages (data));}
+#define printinfof(x, ...) {if(data->opts.verbose) fprintf(pfs_messages (data), x "\n", __VA_ARGS__);}
+
 #endif // PLAYLISTFS_H
@@ -0,0 +1,47 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PLAYLISTFS_PROBES_H
+#define PLAYLISTFS_PROBES_H
+
+/*
+Static tracepoints for perf, bpftrace and SystemTap, all under the "playlistfs" provider.
+They are only compiled in with PFS_SDT (make SDT=1), and are a single nop
+in place until a tracer attaches to them.
+
+Filesystem operations have NAME_entry (path, size, offset) and NAME_return (path, result) probes,
+with 0 for size and offset where they do not apply. init and destroy have no arguments.
+Startup phases have phase_begin (name) and phase_end (name, wall nanoseconds) probes,
+per-entry phases are only timed with --timings and report 0 otherwise.
+*/
+
+#ifdef PFS_SDT
+#include <sys/sdt.h>
+
+#define PFS_PROBE0(name) DTRACE_PROBE (playlistfs, name)
+#define PFS_PROBE1(name, a1) DTRACE_PROBE1 (playlistfs, name, a1)
+#define PFS_PROBE2(name, a1, a2) DTRACE_PROBE2 (playlistfs, name, a1, a2)
+#define PFS_PROBE3(name, a1, a2, a3) DTRACE_PROBE3 (playlistfs, name, a1, a2, a3)
+#else
+#define PFS_PROBE0(name) ((void) 0)
+#define PFS_PROBE1(name, a1) ((void) 0)
+#define PFS_PROBE2(name, a1, a2) ((void) 0)
+#define PFS_PROBE3(name, a1, a2, a3) ((void) 0)
+#endif
+
+#endif // PLAYLISTFS_PROBES_H
@@ -0,0 +1,239 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include "server.h"
+
+#include <errno.h>
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Clients send requests right after connecting, so a stuck one should not hold the server for long.
+#define PFS_SERVER_READ_TIMEOUT 5
+
+static int pfs_server_socket (
+	const char* path, struct sockaddr_un* address
+);
+static gboolean pfs_server_write_all (
+	int fd, const void* buffer, size_t length
+);
+
+static int pfs_server_socket (
+	const char* path, struct sockaddr_un* address
+) {
+	if (strlen (path) >= sizeof (address->sun_path)) {
+		return -ENAMETOOLONG;
+	}
+	memset (address, 0, sizeof (*address));
+	address->sun_family = AF_UNIX;
+	strcpy (address->sun_path, path);
+	int fd = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		return -errno;
+	}
+	return fd;
+}
+
+int pfs_server_listen (
+	const char* path
+) {
+	struct sockaddr_un address;
+	int fd = pfs_server_socket (path, &address);
+	if (fd < 0) {
+		return fd;
+	}
+	if (bind (fd, (struct sockaddr*) &address, sizeof (address)) < 0) {
+		int error = errno;
+		if (error == EADDRINUSE) {
+			// Either a server is running, or it has died without removing the socket.
+			int probe = pfs_server_socket (path, &address);
+			if (probe >= 0) {
+				gboolean running = (0 == connect (probe, (struct sockaddr*) &address, sizeof (address)));
+				close (probe);
+				if (running) {
+					close (fd);
+					return -EADDRINUSE;
+				}
+			}
+			struct stat info;
+			if (0 == lstat (path, &info) && S_ISSOCK (info.st_mode)) {
+				unlink (path);
+			}
+			error = (0 == bind (fd, (struct sockaddr*) &address, sizeof (address))) ? 0 : errno;
+		}
+		if (error != 0) {
+			close (fd);
+			return -error;
+		}
+	}
+	// Only the user running the server can ask it to mount.
+	chmod (path, 0600);
+	if (listen (fd, 16) < 0) {
+		int error = errno;
+		close (fd);
+		unlink (path);
+		return -error;
+	}
+	return fd;
+}
+
+char** pfs_server_read_request (
+	int fd, size_t max_size
+) {
+	struct timeval timeout = { .tv_sec = PFS_SERVER_READ_TIMEOUT };
+	setsockopt (fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout));
+
+	guint32 count;
+	size_t received = 0;
+	while (received < sizeof (count)) {
+		ssize_t length = read (fd, (char*) &count + received, sizeof (count) - received);
+		if (length <= 0) {
+			return NULL;
+		}
+		received += length;
+	}
+	if (count < 2 || count > max_size / 2) {
+		return NULL;
+	}
+
+	GString* buffer = g_string_new (NULL);
+	guint32 strings = 0;
+	char chunk[4096];
+	while (strings < count) {
+		ssize_t length = read (fd, chunk, sizeof (chunk));
+		if (length <= 0 || buffer->len + length > max_size) {
+			g_string_free (buffer, TRUE);
+			return NULL;
+		}
+		for (ssize_t i = 0; i < length; i++) {
+			if (chunk[i] == '\0')
+				strings++;
+		}
+		g_string_append_len (buffer, chunk, length);
+	}
+	if (strings != count || buffer->str[buffer->len - 1] != '\0') {
+		g_string_free (buffer, TRUE);
+		return NULL;
+	}
+
+	char** request = g_new (char*, count + 1);
+	const char* string = buffer->str;
+	for (guint32 istring = 0; istring < count; istring++) {
+		request[istring] = g_strdup (string);
+		string += strlen (string) + 1;
+	}
+	request[count] = NULL;
+	g_string_free (buffer, TRUE);
+	return request;
+}
+
+void pfs_server_send (
+	int fd, const char* messages
+) {
+	// Nothing to be done if the client is gone.
+	pfs_server_write_all (fd, messages, strlen (messages));
+}
+
+void pfs_server_reply (
+	int fd, int status
+) {
+	char reply[2] = { '\0', (char) status };
+	// Nothing to be done if the client is gone.
+	pfs_server_write_all (fd, reply, sizeof (reply));
+}
+
+int pfs_server_request (
+	const char* path, int argc, char* argv[]
+) {
+	struct sockaddr_un address;
+	int fd = pfs_server_socket (path, &address);
+	if (fd < 0) {
+		errno = -fd;
+		return PFS_SERVER_UNREACHABLE;
+	}
+	if (connect (fd, (struct sockaddr*) &address, sizeof (address)) < 0) {
+		int error = errno;
+		close (fd);
+		errno = error;
+		return PFS_SERVER_UNREACHABLE;
+	}
+
+	// Relative paths are resolved by the server against the directory of the client.
+	char* cwd = g_get_current_dir ();
+	guint32 count = argc + 1;
+	gboolean sent = pfs_server_write_all (fd, &count, sizeof (count))
+		&& pfs_server_write_all (fd, cwd, strlen (cwd) + 1);
+	for (int iarg = 0; iarg < argc && sent; iarg++) {
+		sent = pfs_server_write_all (fd, argv[iarg], strlen (argv[iarg]) + 1);
+	}
+	g_free (cwd);
+	if (!sent) {
+		int error = errno;
+		close (fd);
+		errno = error;
+		return PFS_SERVER_UNREACHABLE;
+	}
+
+	// Mounting may take a while with big playlists, so there is no timeout here.
+	int status = EXIT_FAILURE;
+	gboolean finished = FALSE;
+	char chunk[4096];
+	ssize_t length;
+	while (!finished && (length = read (fd, chunk, sizeof (chunk))) > 0) {
+		char* end = memchr (chunk, '\0', length);
+		fwrite (chunk, 1, end != NULL ? end - chunk : length, stderr);
+		if (end != NULL) {
+			finished = TRUE;
+			if (end + 1 < chunk + length) {
+				status = (unsigned char) end[1];
+			}
+			else if (read (fd, chunk, 1) == 1) {
+				status = (unsigned char) chunk[0];
+			}
+		}
+	}
+	fflush (stderr);
+	close (fd);
+	return status;
+}
+
+static gboolean pfs_server_write_all (
+	int fd, const void* buffer, size_t length
+) {
+	const char* data = buffer;
+	while (length > 0) {
+		// Clients may be gone, and mounted filesystems do not always ignore SIGPIPE.
+		ssize_t written = send (fd, data, length, MSG_NOSIGNAL);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			return FALSE;
+		}
+		data += written;
+		length -= written;
+	}
+	return TRUE;
+}
@@ -0,0 +1,77 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PLAYLISTFS_SERVER_H
+#define PLAYLISTFS_SERVER_H
+
+#include <stddef.h>
+
+/*
+Local socket protocol between a server started with --server and clients started with --connect.
+
+A request is a 32-bit count of strings, followed by that many NUL-terminated strings:
+working directory of the client and its command line, including argv[0].
+A response is anything the server printed to stderr while handling the request,
+then a NUL byte and a byte with exit status.
+*/
+
+// Exit status of a client which could not reach the server.
+#define PFS_SERVER_UNREACHABLE 2
+
+/*
+Create a listening socket. A socket left by a server which is not running anymore is replaced.
+Returns the descriptor or -errno, with -EADDRINUSE meaning that a server is already running.
+@parameter path: Path of the socket
+*/
+int pfs_server_listen (const char* path);
+
+// Limit for mount requests, which are command lines, anything bigger is certainly not one.
+#define PFS_SERVER_MAX_REQUEST (1 << 20)
+
+/*
+Read a request from a client.
+Returns a NULL-terminated array with working directory and command line, or NULL on errors.
+@parameter fd: Descriptor of a connected client
+@parameter max_size: Maximum total size of strings in the request
+*/
+char** pfs_server_read_request (int fd, size_t max_size);
+
+/*
+Send messages to a client before replying.
+@parameter fd: Descriptor of a connected client
+@parameter messages: Text to send, without a NUL byte
+*/
+void pfs_server_send (int fd, const char* messages);
+
+/*
+Finish handling a request by sending exit status. Messages are sent to the same descriptor before.
+@parameter fd: Descriptor of a connected client
+@parameter status: Exit status for the client
+*/
+void pfs_server_reply (int fd, int status);
+
+/*
+Send a command line to a server, printing messages it sends back.
+Returns exit status from the server, or PFS_SERVER_UNREACHABLE with errno set.
+@parameter path: Path of the socket
+@parameter argc: Number of arguments
+@parameter argv: Command line, sent as is
+*/
+int pfs_server_request (const char* path, int argc, char* argv[]);
+
+#endif // PLAYLISTFS_SERVER_H
@@ -0,0 +1,156 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include "stats.h"
+#include "probes.h"
+
+#include <sys/resource.h>
+#include <time.h>
+
+typedef struct {
+	const char* name;
+	int depth; // Nesting level in the report
+	gboolean fine; // Entered per entry: only timed when enabled, and only wall time is measured
+	gint64 wall; // Accumulated time, in nanoseconds
+	gint64 cpu;
+	gint64 wall_started; // Not used for fine phases, which can be timed by several threads at once
+	gint64 cpu_started;
+	guint entered; // How many times the phase was entered
+} pfs_stats_phase_record;
+
+static pfs_stats_phase_record phases[PFS_PHASE_COUNT] = {
+	[PFS_PHASE_OPTIONS] = { "parse options", 0, FALSE },
+	[PFS_PHASE_MOUNT_POINT] = { "check mount point", 0, FALSE },
+	[PFS_PHASE_PLAYLIST] = { "build playlist", 0, FALSE },
+	[PFS_PHASE_LISTS_READ] = { "read lists", 1, FALSE },
+	[PFS_PHASE_LISTS_EXPAND] = { "expand lists", 1, FALSE },
+	[PFS_PHASE_FILES] = { "collect individual files", 1, FALSE },
+	[PFS_PHASE_RESOLVE] = { "resolve files", 1, FALSE },
+	[PFS_PHASE_FILES_CHECK] = { "check files", 2, TRUE },
+	[PFS_PHASE_FILES_TABLE] = { "add to table", 2, TRUE },
+	[PFS_PHASE_FREEZE] = { "freeze table", 1, FALSE },
+	[PFS_PHASE_FUSE_ARGUMENTS] = { "setup FUSE arguments", 0, FALSE },
+	[PFS_PHASE_FUSE_NEW] = { "create FUSE session", 0, FALSE },
+	[PFS_PHASE_FUSE_MOUNT] = { "mount", 0, FALSE },
+};
+
+static const char* counter_names[PFS_COUNTER_COUNT] = {
+	[PFS_COUNTER_LINES_READ] = "lines read",
+	[PFS_COUNTER_ENTRIES_ADDED] = "entries added",
+	[PFS_COUNTER_ENTRIES_SHADOWED] = "entries shadowed",
+	[PFS_COUNTER_ENTRIES_SKIPPED] = "entries skipped",
+	[PFS_COUNTER_ENTRIES_INACCESSIBLE] = "entries inaccessible",
+	[PFS_COUNTER_SYSCALLS] = "filesystem syscalls",
+};
+static gint counters[PFS_COUNTER_COUNT];
+
+static gboolean enabled = FALSE;
+// Fine phases are entered by threads resolving files, so each thread times them on its own.
+static _Thread_local gint64 fine_started[PFS_PHASE_COUNT];
+static GMutex fine_lock; // Protects wall and entered of fine phases
+
+static inline gint64 pfs_stats_clock (
+	clockid_t clock
+) {
+	struct timespec ts;
+	clock_gettime (clock, &ts);
+	return (gint64) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void pfs_stats_enable (void) {
+	enabled = TRUE;
+}
+
+void pfs_stats_phase_begin (
+	pfs_stats_phase phase
+) {
+	pfs_stats_phase_record* record = &phases[phase];
+	PFS_PROBE1 (phase_begin, record->name);
+	if (record->fine) {
+		if (enabled) {
+			fine_started[phase] = pfs_stats_clock (CLOCK_MONOTONIC);
+		}
+		return;
+	}
+
+	record->entered++;
+	record->cpu_started = pfs_stats_clock (CLOCK_PROCESS_CPUTIME_ID);
+	record->wall_started = pfs_stats_clock (CLOCK_MONOTONIC);
+}
+
+void pfs_stats_phase_end (
+	pfs_stats_phase phase
+) {
+	pfs_stats_phase_record* record = &phases[phase];
+	if (record->fine && !enabled) {
+		PFS_PROBE2 (phase_end, record->name, (gint64) 0);
+		return;
+	}
+
+	if (record->fine) {
+		gint64 wall = pfs_stats_clock (CLOCK_MONOTONIC) - fine_started[phase];
+		g_mutex_lock (&fine_lock);
+		record->wall += wall;
+		record->entered++;
+		g_mutex_unlock (&fine_lock);
+		PFS_PROBE2 (phase_end, record->name, wall);
+		return;
+	}
+
+	gint64 wall = pfs_stats_clock (CLOCK_MONOTONIC) - record->wall_started;
+	record->wall += wall;
+	record->cpu += pfs_stats_clock (CLOCK_PROCESS_CPUTIME_ID) - record->cpu_started;
+	PFS_PROBE2 (phase_end, record->name, wall);
+}
+
+void pfs_stats_count (
+	pfs_stats_counter counter, gint amount
+) {
+	g_atomic_int_add (&counters[counter], amount);
+}
+
+void pfs_stats_report (
+	FILE* stream
+) {
+	fprintf (stream, "%-28s%10s%13s\n", "Startup timings:", "wall", "CPU");
+	for (int iphase = 0; iphase < PFS_PHASE_COUNT; iphase++) {
+		pfs_stats_phase_record* record = &phases[iphase];
+		if (record->entered == 0) continue;
+
+		int indent = 2 + 2 * record->depth;
+		fprintf (stream, "%*s%-*s %9.3f ms", indent, "", 28 - indent, record->name, record->wall / 1e6);
+		if (record->fine) {
+			fprintf (stream, " %9s    (%u times)\n", "-", record->entered);
+		}
+		else {
+			fprintf (stream, " %9.3f ms\n", record->cpu / 1e6);
+		}
+	}
+
+	fputs ("Startup counters:\n", stream);
+	for (int icounter = 0; icounter < PFS_COUNTER_COUNT; icounter++) {
+		fprintf (stream, "  %-26s%10d\n", counter_names[icounter], g_atomic_int_get (&counters[icounter]));
+	}
+
+	struct rusage usage;
+	if (0 == getrusage (RUSAGE_SELF, &usage)) {
+		fprintf (stream, "  %-26s%10ld KiB\n", "peak RSS", usage.ru_maxrss);
+	}
+}
@@ -0,0 +1,89 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PLAYLISTFS_STATS_H
+#define PLAYLISTFS_STATS_H
+
+#include <glib.h>
+#include <stdio.h>
+
+/*
+Phases of startup. Time spent in a phase is accumulated, so a phase can be entered many times.
+Order matters: phases are reported in this order, nested under their parent.
+*/
+typedef enum {
+	PFS_PHASE_OPTIONS,
+	PFS_PHASE_MOUNT_POINT,
+	PFS_PHASE_PLAYLIST,
+	PFS_PHASE_LISTS_READ,
+	PFS_PHASE_LISTS_EXPAND,
+	PFS_PHASE_FILES,
+	PFS_PHASE_RESOLVE,
+	PFS_PHASE_FILES_CHECK, // Per entry, nested in PFS_PHASE_RESOLVE
+	PFS_PHASE_FILES_TABLE, // Per entry, nested in PFS_PHASE_RESOLVE
+	PFS_PHASE_FREEZE,
+	PFS_PHASE_FUSE_ARGUMENTS,
+	PFS_PHASE_FUSE_NEW,
+	PFS_PHASE_FUSE_MOUNT,
+	PFS_PHASE_COUNT
+} pfs_stats_phase;
+
+/*
+Counters, which can be incremented from any thread.
+*/
+typedef enum {
+	PFS_COUNTER_LINES_READ,
+	PFS_COUNTER_ENTRIES_ADDED,
+	PFS_COUNTER_ENTRIES_SHADOWED,
+	PFS_COUNTER_ENTRIES_SKIPPED,
+	PFS_COUNTER_ENTRIES_INACCESSIBLE,
+	PFS_COUNTER_SYSCALLS,
+	PFS_COUNTER_COUNT
+} pfs_stats_counter;
+
+/*
+Enable collection of per-entry phases, which are too costly to time otherwise.
+Other phases and counters are always collected.
+*/
+void pfs_stats_enable (void);
+
+/*
+Start timing a phase. Phases should only be timed by one thread at a time,
+except per-entry ones, whose time is summed over all threads timing them.
+*/
+void pfs_stats_phase_begin (pfs_stats_phase phase);
+
+/*
+Stop timing a phase, adding elapsed time to it.
+*/
+void pfs_stats_phase_end (pfs_stats_phase phase);
+
+/*
+Add to a counter atomically.
+@parameter counter: Counter to add to
+@parameter amount: Value to add
+*/
+void pfs_stats_count (pfs_stats_counter counter, gint amount);
+
+/*
+Print a report of phases, counters and peak memory usage.
+@parameter stream: Stream to print to
+*/
+void pfs_stats_report (FILE* stream);
+
+#endif // PLAYLISTFS_STATS_H
@@ -0,0 +1,466 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE
+
+#include "table.h"
+
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define PFS_TABLE_GROUP_SIZE 16
+// Control bytes of free slots have the high bit set, used ones hold 7 bits of the hash.
+#define PFS_TABLE_EMPTY ((gint8) -128)
+#define PFS_TABLE_DELETED ((gint8) -2)
+// At most 7/8 of slots are used or deleted, so that probing stays short.
+#define PFS_TABLE_MAX_LOAD(capacity) ((capacity) - (capacity) / 8)
+
+// Constants and mixing of wyhash, which reads names 8 bytes at a time.
+#define PFS_TABLE_SECRET0 0xa0761d6478bd642fULL
+#define PFS_TABLE_SECRET1 0xe7037ed1a0b428dbULL
+
+typedef struct {
+	guint64 hash;
+	char* key;
+	gpointer value;
+} pfs_table_slot;
+
+typedef struct {
+	gint8* control; // One byte for each slot
+	pfs_table_slot* slots;
+	gsize capacity; // Number of slots, a power of 2, split into groups
+	gsize size; // Number of names
+	gsize growth_left; // Empty slots which can be used before the part is rebuilt
+} pfs_table_part;
+
+struct pfs_table {
+	pfs_table_part* parts;
+	guint part_bits; // Parts are chosen by top bits of hashes, 0 for a single part
+	gsize size; // Number of names in all parts
+	GDestroyNotify key_destroy;
+	GDestroyNotify value_destroy;
+};
+
+static inline guint64 pfs_table_mum (
+	guint64 a, guint64 b
+) {
+	#ifdef __SIZEOF_INT128__
+	unsigned __int128 product = (unsigned __int128) a * b;
+	return (guint64) product ^ (guint64) (product >> 64);
+	#else
+	guint64 ha = a >> 32, la = (guint32) a, hb = b >> 32, lb = (guint32) b;
+	guint64 high = ha * hb, middle1 = ha * lb, middle2 = la * hb, low = la * lb;
+	guint64 carry = ((low >> 32) + (guint32) middle1 + (guint32) middle2) >> 32;
+	return (low + (middle1 << 32) + (middle2 << 32)) ^ (high + (middle1 >> 32) + (middle2 >> 32) + carry);
+	#endif
+}
+
+static inline guint64 pfs_table_read64 (
+	const unsigned char* pointer
+) {
+	guint64 value;
+	memcpy (&value, pointer, sizeof (value));
+	return value;
+}
+
+static inline guint64 pfs_table_read32 (
+	const unsigned char* pointer
+) {
+	guint32 value;
+	memcpy (&value, pointer, sizeof (value));
+	return value;
+}
+
+// Bit for each slot of the group whose control byte is the given one.
+static inline guint32 pfs_table_match (
+	const gint8* group, gint8 control
+) {
+	#ifdef __SSE2__
+	__m128i bytes = _mm_loadu_si128 ((const __m128i*) group);
+	return (guint32) _mm_movemask_epi8 (_mm_cmpeq_epi8 (bytes, _mm_set1_epi8 (control)));
+	#else
+	guint32 mask = 0;
+	for (int islot = 0; islot < PFS_TABLE_GROUP_SIZE; islot++) {
+		if (group[islot] == control)
+			mask |= 1u << islot;
+	}
+	return mask;
+	#endif
+}
+
+// Bit for each empty or deleted slot of the group.
+static inline guint32 pfs_table_match_free (
+	const gint8* group
+) {
+	#ifdef __SSE2__
+	return (guint32) _mm_movemask_epi8 (_mm_loadu_si128 ((const __m128i*) group));
+	#else
+	guint32 mask = 0;
+	for (int islot = 0; islot < PFS_TABLE_GROUP_SIZE; islot++) {
+		if (group[islot] < 0)
+			mask |= 1u << islot;
+	}
+	return mask;
+	#endif
+}
+
+static inline pfs_table_part* pfs_table_part_for (
+	const pfs_table* table, guint64 hash
+) {
+	return table->part_bits == 0 ? table->parts : &table->parts[hash >> (64 - table->part_bits)];
+}
+
+static gssize pfs_table_find (
+	const pfs_table_part* part, const char* key, guint64 hash
+);
+static gsize pfs_table_find_free (
+	const pfs_table_part* part, guint64 hash
+);
+static void pfs_table_allocate (
+	pfs_table_part* part, gsize capacity
+);
+static void pfs_table_rebuild (
+	pfs_table_part* part
+);
+static void pfs_table_add (
+	pfs_table* table, pfs_table_part* part, char* key, gpointer value, guint64 hash
+);
+static void pfs_table_erase (
+	pfs_table* table, pfs_table_part* part, gsize index
+);
+
+guint64 pfs_table_hash (const char* name, gsize length) {
+	const unsigned char* bytes = (const unsigned char*) name;
+	guint64 seed = PFS_TABLE_SECRET0;
+	guint64 a = 0, b = 0;
+	if (length <= 16) {
+		// Short names are read with two overlapping pairs of loads, without branching on every byte.
+		if (length >= 4) {
+			gsize middle = (length >> 3) << 2;
+			a = (pfs_table_read32 (bytes) << 32) | pfs_table_read32 (bytes + middle);
+			b = (pfs_table_read32 (bytes + length - 4) << 32) | pfs_table_read32 (bytes + length - 4 - middle);
+		}
+		else if (length > 0) {
+			a = ((guint64) bytes[0] << 16) | ((guint64) bytes[length >> 1] << 8) | bytes[length - 1];
+		}
+	}
+	else {
+		gsize left = length;
+		for (; left > 16; left -= 16, bytes += 16) {
+			seed = pfs_table_mum (pfs_table_read64 (bytes) ^ PFS_TABLE_SECRET1, pfs_table_read64 (bytes + 8) ^ seed);
+		}
+		// The last 16 bytes, overlapping with ones already hashed.
+		a = pfs_table_read64 (bytes + left - 16);
+		b = pfs_table_read64 (bytes + left - 8);
+	}
+	return pfs_table_mum (PFS_TABLE_SECRET1 ^ length, pfs_table_mum (a ^ PFS_TABLE_SECRET1, b ^ seed));
+}
+
+pfs_table* pfs_table_new (GDestroyNotify key_destroy, GDestroyNotify value_destroy) {
+	return pfs_table_new_with_parts (0, key_destroy, value_destroy);
+}
+
+pfs_table* pfs_table_new_with_parts (guint part_bits, GDestroyNotify key_destroy, GDestroyNotify value_destroy) {
+	pfs_table* table = g_malloc0 (sizeof (*table));
+	table->part_bits = part_bits;
+	table->parts = g_new0 (pfs_table_part, 1u << part_bits);
+	table->key_destroy = key_destroy;
+	table->value_destroy = value_destroy;
+	for (guint ipart = 0; ipart < 1u << part_bits; ipart++) {
+		pfs_table_allocate (&table->parts[ipart], PFS_TABLE_GROUP_SIZE);
+	}
+	return table;
+}
+
+gpointer pfs_table_lookup (pfs_table* table, const char* key) {
+	guint64 hash = pfs_table_hash (key, strlen (key));
+	pfs_table_part* part = pfs_table_part_for (table, hash);
+	gssize index = pfs_table_find (part, key, hash);
+	return index < 0 ? NULL : part->slots[index].value;
+}
+
+gboolean pfs_table_lookup_extended (pfs_table* table, const char* key, gpointer* orig_key, gpointer* value) {
+	guint64 hash = pfs_table_hash (key, strlen (key));
+	pfs_table_part* part = pfs_table_part_for (table, hash);
+	gssize index = pfs_table_find (part, key, hash);
+	if (index < 0) {
+		return FALSE;
+	}
+	if (orig_key != NULL)
+		*orig_key = part->slots[index].key;
+	if (value != NULL)
+		*value = part->slots[index].value;
+	return TRUE;
+}
+
+gboolean pfs_table_contains (pfs_table* table, const char* key) {
+	guint64 hash = pfs_table_hash (key, strlen (key));
+	return pfs_table_find (pfs_table_part_for (table, hash), key, hash) >= 0;
+}
+
+gboolean pfs_table_insert (pfs_table* table, char* key, gpointer value) {
+	guint64 hash = pfs_table_hash (key, strlen (key));
+	pfs_table_part* part = pfs_table_part_for (table, hash);
+	gssize index = pfs_table_find (part, key, hash);
+	if (index < 0) {
+		pfs_table_add (table, part, key, value, hash);
+		return TRUE;
+	}
+	pfs_table_slot* slot = &part->slots[index];
+	if (table->key_destroy != NULL)
+		table->key_destroy (key);
+	if (table->value_destroy != NULL)
+		table->value_destroy (slot->value);
+	slot->value = value;
+	return FALSE;
+}
+
+gboolean pfs_table_replace (pfs_table* table, char* key, gpointer value) {
+	guint64 hash = pfs_table_hash (key, strlen (key));
+	pfs_table_part* part = pfs_table_part_for (table, hash);
+	gssize index = pfs_table_find (part, key, hash);
+	if (index < 0) {
+		pfs_table_add (table, part, key, value, hash);
+		return TRUE;
+	}
+	pfs_table_slot* slot = &part->slots[index];
+	if (table->key_destroy != NULL)
+		table->key_destroy (slot->key);
+	if (table->value_destroy != NULL)
+		table->value_destroy (slot->value);
+	slot->key = key;
+	slot->value = value;
+	return FALSE;
+}
+
+gboolean pfs_table_steal (pfs_table* table, const char* key) {
+	guint64 hash = pfs_table_hash (key, strlen (key));
+	pfs_table_part* part = pfs_table_part_for (table, hash);
+	gssize index = pfs_table_find (part, key, hash);
+	if (index < 0) {
+		return FALSE;
+	}
+	pfs_table_erase (table, part, index);
+	return TRUE;
+}
+
+gboolean pfs_table_remove (pfs_table* table, const char* key) {
+	guint64 hash = pfs_table_hash (key, strlen (key));
+	pfs_table_part* part = pfs_table_part_for (table, hash);
+	gssize index = pfs_table_find (part, key, hash);
+	if (index < 0) {
+		return FALSE;
+	}
+	pfs_table_slot slot = part->slots[index];
+	pfs_table_erase (table, part, index);
+	if (table->key_destroy != NULL)
+		table->key_destroy (slot.key);
+	if (table->value_destroy != NULL)
+		table->value_destroy (slot.value);
+	return TRUE;
+}
+
+guint pfs_table_size (pfs_table* table) {
+	return table->size;
+}
+
+guint pfs_table_parts (pfs_table* table) {
+	return 1u << table->part_bits;
+}
+
+guint pfs_table_part_of (pfs_table* table, const char* key) {
+	return pfs_table_part_for (table, pfs_table_hash (key, strlen (key))) - table->parts;
+}
+
+void pfs_table_iter_init (pfs_table_iter* iter, pfs_table* table) {
+	iter->table = table;
+	iter->part = 0;
+	iter->last_part = pfs_table_parts (table) - 1;
+	iter->index = 0;
+}
+
+void pfs_table_iter_init_part (pfs_table_iter* iter, pfs_table* table, guint part) {
+	iter->table = table;
+	iter->part = part;
+	iter->last_part = part;
+	iter->index = 0;
+}
+
+gboolean pfs_table_iter_next (pfs_table_iter* iter, gpointer* key, gpointer* value) {
+	for (;;) {
+		pfs_table_part* part = &iter->table->parts[iter->part];
+		while (iter->index < part->capacity && part->control[iter->index] < 0) {
+			iter->index++;
+		}
+		if (iter->index < part->capacity) {
+			pfs_table_slot* slot = &part->slots[iter->index++];
+			if (key != NULL)
+				*key = slot->key;
+			if (value != NULL)
+				*value = slot->value;
+			return TRUE;
+		}
+		if (iter->part == iter->last_part) {
+			return FALSE;
+		}
+		iter->part++;
+		iter->index = 0;
+	}
+}
+
+void pfs_table_iter_steal (pfs_table_iter* iter) {
+	// Slots never move when erasing, so iteration goes on from the same place.
+	pfs_table_erase (iter->table, &iter->table->parts[iter->part], iter->index - 1);
+}
+
+void pfs_table_free (pfs_table* table) {
+	for (guint ipart = 0; ipart < pfs_table_parts (table); ipart++) {
+		pfs_table_part* part = &table->parts[ipart];
+		for (gsize index = 0; index < part->capacity; index++) {
+			if (part->control[index] < 0) {
+				continue;
+			}
+			if (table->key_destroy != NULL)
+				table->key_destroy (part->slots[index].key);
+			if (table->value_destroy != NULL)
+				table->value_destroy (part->slots[index].value);
+		}
+		g_free (part->control);
+		g_free (part->slots);
+	}
+	g_free (table->parts);
+	g_free (table);
+}
+
+/*
+Groups are probed in a triangular sequence, which visits every group as their number is a power of 2.
+A group with an empty slot ends the search, as a name would have been put there.
+*/
+static gssize pfs_table_find (
+	const pfs_table_part* part, const char* key, guint64 hash
+) {
+	gint8 tag = (gint8) (hash & 0x7F);
+	gsize groups_mask = part->capacity / PFS_TABLE_GROUP_SIZE - 1;
+	gsize group = (hash >> 7) & groups_mask;
+	for (gsize step = 1; step <= groups_mask + 1; step++) {
+		const gint8* control = part->control + group * PFS_TABLE_GROUP_SIZE;
+		for (guint32 matches = pfs_table_match (control, tag); matches != 0; matches &= matches - 1) {
+			gsize index = group * PFS_TABLE_GROUP_SIZE + __builtin_ctz (matches);
+			const pfs_table_slot* slot = &part->slots[index];
+			if (slot->hash == hash && 0 == strcmp (slot->key, key)) {
+				return index;
+			}
+		}
+		if (pfs_table_match (control, PFS_TABLE_EMPTY) != 0) {
+			return -1;
+		}
+		group = (group + step) & groups_mask;
+	}
+	return -1;
+}
+
+// A part always has free slots, as it is rebuilt before running out of them.
+static gsize pfs_table_find_free (
+	const pfs_table_part* part, guint64 hash
+) {
+	gsize groups_mask = part->capacity / PFS_TABLE_GROUP_SIZE - 1;
+	gsize group = (hash >> 7) & groups_mask;
+	for (gsize step = 1; ; step++) {
+		guint32 free = pfs_table_match_free (part->control + group * PFS_TABLE_GROUP_SIZE);
+		if (free != 0) {
+			return group * PFS_TABLE_GROUP_SIZE + __builtin_ctz (free);
+		}
+		group = (group + step) & groups_mask;
+	}
+}
+
+static void pfs_table_allocate (
+	pfs_table_part* part, gsize capacity
+) {
+	part->capacity = capacity;
+	part->control = g_malloc (capacity);
+	memset (part->control, PFS_TABLE_EMPTY, capacity);
+	// Slots are only read once their control bytes say they are used.
+	part->slots = g_new (pfs_table_slot, capacity);
+	part->growth_left = PFS_TABLE_MAX_LOAD (capacity) - part->size;
+}
+
+/*
+Move all names into new arrays, big enough to grow twice as much, dropping deleted slots.
+*/
+static void pfs_table_rebuild (
+	pfs_table_part* part
+) {
+	gint8* control = part->control;
+	pfs_table_slot* slots = part->slots;
+	gsize capacity = part->capacity;
+	gsize new_capacity = PFS_TABLE_GROUP_SIZE;
+	while (PFS_TABLE_MAX_LOAD (new_capacity) < (part->size + 1) * 2) {
+		new_capacity *= 2;
+	}
+	pfs_table_allocate (part, new_capacity);
+	for (gsize index = 0; index < capacity; index++) {
+		if (control[index] < 0) {
+			continue;
+		}
+		// Hashes are stored, so names are not read again.
+		gsize new_index = pfs_table_find_free (part, slots[index].hash);
+		part->control[new_index] = (gint8) (slots[index].hash & 0x7F);
+		part->slots[new_index] = slots[index];
+	}
+	g_free (control);
+	g_free (slots);
+}
+
+static void pfs_table_add (
+	pfs_table* table, pfs_table_part* part, char* key, gpointer value, guint64 hash
+) {
+	gsize index = pfs_table_find_free (part, hash);
+	if (part->control[index] == PFS_TABLE_EMPTY) {
+		if (part->growth_left == 0) {
+			pfs_table_rebuild (part);
+			index = pfs_table_find_free (part, hash);
+		}
+		part->growth_left--;
+	}
+	part->control[index] = (gint8) (hash & 0x7F);
+	part->slots[index] = (pfs_table_slot) { .hash = hash, .key = key, .value = value };
+	part->size++;
+	table->size++;
+}
+
+/*
+A slot can be made empty again only if its group has an empty slot, as then no search
+has ever gone past the group. Otherwise it is marked deleted, so that searches go on.
+*/
+static void pfs_table_erase (
+	pfs_table* table, pfs_table_part* part, gsize index
+) {
+	const gint8* group = part->control + index / PFS_TABLE_GROUP_SIZE * PFS_TABLE_GROUP_SIZE;
+	if (pfs_table_match (group, PFS_TABLE_EMPTY) != 0) {
+		part->control[index] = PFS_TABLE_EMPTY;
+		part->growth_left++;
+	}
+	else {
+		part->control[index] = PFS_TABLE_DELETED;
+	}
+	part->size--;
+	table->size--;
+}
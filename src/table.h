@@ -0,0 +1,136 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PLAYLISTFS_TABLE_H
+#define PLAYLISTFS_TABLE_H
+
+#include <glib.h>
+
+/*
+A hash table of names, used as the file table. It behaves like a GHashTable with
+g_str_hash() and g_str_equal(), but is faster with millions of names:
+slots are kept in one array with the full hash of each name, and in groups of 16
+with a control byte for each slot, holding 7 bits of the hash or marking it empty.
+A lookup compares all control bytes of a group at once (with SSE2 where available),
+and only compares names whose full hash matches.
+The table can be split into parts by top bits of hashes, each with its own slots,
+so that names of one part can be listed without looking at others.
+Like GHashTable, it must be locked by the caller if used from several threads.
+*/
+typedef struct pfs_table pfs_table;
+
+typedef struct {
+	pfs_table* table;
+	guint part; // Part being iterated over
+	guint last_part;
+	gsize index; // Next slot to look at in the part
+} pfs_table_iter;
+
+/*
+Hash a name.
+@parameter name: The name, does not have to be terminated
+@parameter length: Length of the name
+*/
+guint64 pfs_table_hash (const char* name, gsize length);
+
+/*
+@parameter key_destroy: Function to free names with, or NULL
+@parameter value_destroy: Function to free values with, or NULL
+*/
+pfs_table* pfs_table_new (GDestroyNotify key_destroy, GDestroyNotify value_destroy);
+
+/*
+Same as pfs_table_new(), but split into 2^part_bits parts.
+@parameter part_bits: Number of top bits of hashes choosing the part, 0 for a single part
+*/
+pfs_table* pfs_table_new_with_parts (guint part_bits, GDestroyNotify key_destroy, GDestroyNotify value_destroy);
+
+/*
+Find a value by name, or return NULL.
+*/
+gpointer pfs_table_lookup (pfs_table* table, const char* key);
+
+/*
+Find a name and its value. Returns FALSE if the name is not in the table.
+@parameter orig_key: Where to store the name as stored in the table, or NULL
+@parameter value: Where to store the value, or NULL
+*/
+gboolean pfs_table_lookup_extended (pfs_table* table, const char* key, gpointer* orig_key, gpointer* value);
+
+gboolean pfs_table_contains (pfs_table* table, const char* key);
+
+/*
+Insert a value. If the name is already there, its value is freed and replaced,
+and the new name is freed, same as with g_hash_table_insert().
+Returns TRUE if the name was not there.
+*/
+gboolean pfs_table_insert (pfs_table* table, char* key, gpointer value);
+
+/*
+Same as pfs_table_insert(), but the old name is freed and replaced instead of the new one.
+*/
+gboolean pfs_table_replace (pfs_table* table, char* key, gpointer value);
+
+/*
+Remove a name without freeing it or its value. Returns FALSE if the name is not in the table.
+*/
+gboolean pfs_table_steal (pfs_table* table, const char* key);
+
+/*
+Remove a name, freeing it and its value. Returns FALSE if the name is not in the table.
+*/
+gboolean pfs_table_remove (pfs_table* table, const char* key);
+
+guint pfs_table_size (pfs_table* table);
+
+guint pfs_table_parts (pfs_table* table);
+
+/*
+Part which a name belongs to, whether it is in the table or not.
+*/
+guint pfs_table_part_of (pfs_table* table, const char* key);
+
+/*
+Start iterating over the table. The table must not be changed while iterating,
+except through pfs_table_iter_steal().
+*/
+void pfs_table_iter_init (pfs_table_iter* iter, pfs_table* table);
+
+/*
+Same as pfs_table_iter_init(), but iterate over names of one part only.
+*/
+void pfs_table_iter_init_part (pfs_table_iter* iter, pfs_table* table, guint part);
+
+/*
+Get the next name and value. Returns FALSE once all were seen.
+@parameter key: Where to store the name, or NULL
+@parameter value: Where to store the value, or NULL
+*/
+gboolean pfs_table_iter_next (pfs_table_iter* iter, gpointer* key, gpointer* value);
+
+/*
+Remove the name last returned by pfs_table_iter_next(), without freeing it or its value.
+*/
+void pfs_table_iter_steal (pfs_table_iter* iter);
+
+/*
+Free the table, with all names and values.
+*/
+void pfs_table_free (pfs_table* table);
+
+#endif // PLAYLISTFS_TABLE_H
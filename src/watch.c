@@ -0,0 +1,373 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "watch.h"
+#include "files.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define PFS_WATCH_MASK (IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR | IN_EXCL_UNLINK)
+
+typedef struct {
+	pfs_data* data;
+	struct fuse* fuse;
+	int fd; // inotify descriptor
+	int wake_fd; // eventfd, signalled to stop the thread
+	gboolean watching; // Whether directories were added already
+	GHashTable* dirs; // Watch descriptor -> directory path
+	GHashTable* watched; // Set of watched directory paths
+	GHashTable* paths; // Set of original paths of files, to skip unrelated changes quickly
+} pfs_watch_state;
+
+static void pfs_watch_add_all (
+	pfs_watch_state* state
+);
+static gpointer pfs_watch_thread (
+	gpointer pointer
+);
+static void pfs_watch_process (
+	pfs_watch_state* state, char* buffer, size_t length
+);
+static void pfs_watch_changed (
+	pfs_watch_state* state, const char* path
+);
+static void pfs_watch_removed (
+	pfs_watch_state* state, const char* path
+);
+static void pfs_watch_moved (
+	pfs_watch_state* state, const char* path, const char* new_path
+);
+static void pfs_watch_invalidate (
+	pfs_watch_state* state, GPtrArray* names
+);
+
+void pfs_watch_start (
+	pfs_data* data, struct fuse* fuse
+) {
+	if (!data->opts.watch || data->watcher.thread != NULL) {
+		return;
+	}
+	pfs_watch_state* state = g_malloc0 (sizeof (*state));
+	state->data = data;
+	state->fuse = fuse;
+	state->fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+	state->wake_fd = eventfd (0, EFD_CLOEXEC);
+	if (state->fd < 0 || state->wake_fd < 0) {
+		printerrf ("could not watch original files: %s", strerror (errno));
+		if (state->fd >= 0)
+			close (state->fd);
+		if (state->wake_fd >= 0)
+			close (state->wake_fd);
+		g_free (state);
+		return;
+	}
+	state->dirs = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+	state->watched = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	state->paths = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	// Without background loading, start watching right away, so that no change is missed.
+	if (!g_atomic_int_get (&data->loader.running)) {
+		pfs_watch_add_all (state);
+	}
+	data->watcher.wake_fd = state->wake_fd;
+	data->watcher.thread = g_thread_new ("watcher", pfs_watch_thread, state);
+}
+
+void pfs_watch_added (
+	pfs_data* data
+) {
+	if (data->watcher.thread == NULL) {
+		return;
+	}
+	guint64 value = 1;
+	if (write (data->watcher.wake_fd, &value, sizeof (value)) < 0) {
+		printwarnf ("could not watch added files: %s", strerror (errno));
+	}
+}
+
+void pfs_watch_stop (
+	pfs_data* data
+) {
+	if (data->watcher.thread == NULL) {
+		return;
+	}
+	g_atomic_int_set (&data->watcher.stopping, 1);
+	guint64 value = 1;
+	if (write (data->watcher.wake_fd, &value, sizeof (value)) < 0) {
+		printerrf ("could not stop watching original files: %s", strerror (errno));
+	}
+	g_thread_join (data->watcher.thread);
+	data->watcher.thread = NULL;
+}
+
+static void pfs_watch_add_all (
+	pfs_watch_state* state
+) {
+	pfs_data* data = state->data;
+	gboolean warned = FALSE;
+	pfs_table_iter iter;
+	gpointer value;
+	g_rw_lock_reader_lock (&data->filetable_lock);
+	pfs_table_iter_init (&iter, data->filetable);
+	while (pfs_table_iter_next (&iter, NULL, &value)) {
+		pfs_file* file = value;
+		if (file->dir == NULL) {
+			continue;
+		}
+		if (!g_hash_table_contains (state->paths, file->path->str)) {
+			g_hash_table_add (state->paths, g_strdup (file->path->str));
+		}
+		if (g_hash_table_contains (state->watched, file->dir->path)) {
+			continue;
+		}
+		// Directories which could not be watched are not tried again either.
+		g_hash_table_add (state->watched, g_strdup (file->dir->path));
+		int wd = inotify_add_watch (state->fd, file->dir->path, PFS_WATCH_MASK);
+		if (wd < 0) {
+			if (!warned) {
+				printwarnf ("could not watch '%s': %s", file->dir->path, strerror (errno));
+				if (errno == ENOSPC) {
+					printwarn ("increase fs.inotify.max_user_watches to watch all directories");
+				}
+				warned = TRUE;
+			}
+			continue;
+		}
+		g_hash_table_replace (state->dirs, GINT_TO_POINTER (wd), g_strdup (file->dir->path));
+	}
+	g_rw_lock_reader_unlock (&data->filetable_lock);
+	state->watching = TRUE;
+}
+
+static gpointer pfs_watch_thread (
+	gpointer pointer
+) {
+	pfs_watch_state* state = pointer;
+	if (!state->watching) {
+		// Files loaded in background also need to be watched.
+		pfs_background_load_wait (state->data);
+		pfs_watch_add_all (state);
+	}
+
+	char buffer[16 * (sizeof (struct inotify_event) + NAME_MAX + 1)]
+		__attribute__ ((aligned (__alignof__ (struct inotify_event))));
+	struct pollfd fds[2] = {
+		{ .fd = state->fd, .events = POLLIN },
+		{ .fd = state->wake_fd, .events = POLLIN },
+	};
+	while (TRUE) {
+		if (poll (fds, G_N_ELEMENTS (fds), -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (fds[1].revents != 0) {
+			guint64 value;
+			if (read (state->wake_fd, &value, sizeof (value)) < 0 && errno == EINTR)
+				continue;
+			if (g_atomic_int_get (&state->data->watcher.stopping))
+				break;
+			// Directories which are watched already are skipped without syscalls.
+			pfs_watch_add_all (state);
+			continue;
+		}
+		ssize_t length = read (state->fd, buffer, sizeof (buffer));
+		if (length < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			break;
+		}
+		pfs_watch_process (state, buffer, length);
+	}
+
+	close (state->fd);
+	close (state->wake_fd);
+	g_hash_table_unref (state->dirs);
+	g_hash_table_unref (state->watched);
+	g_hash_table_unref (state->paths);
+	g_free (state);
+	return NULL;
+}
+
+static void pfs_watch_process (
+	pfs_watch_state* state, char* buffer, size_t length
+) {
+	pfs_data* data = state->data;
+	for (size_t offset = 0; offset < length; ) {
+		struct inotify_event* event = (struct inotify_event*) (buffer + offset);
+		offset += sizeof (*event) + event->len;
+
+		if (event->mask & IN_Q_OVERFLOW) {
+			printwarn ("too many changes to original files, some were missed");
+			continue;
+		}
+		if (event->mask & IN_IGNORED) {
+			// The directory is gone, files added to a new one with its path need a new watch.
+			const char* dir = g_hash_table_lookup (state->dirs, GINT_TO_POINTER (event->wd));
+			if (dir != NULL) {
+				g_hash_table_remove (state->watched, dir);
+			}
+			g_hash_table_remove (state->dirs, GINT_TO_POINTER (event->wd));
+			continue;
+		}
+		const char* dir = g_hash_table_lookup (state->dirs, GINT_TO_POINTER (event->wd));
+		if (event->len == 0 || dir == NULL) {
+			continue;
+		}
+
+		char* path = g_build_filename (dir, event->name, NULL);
+		if (event->mask & IN_MOVED_FROM) {
+			// Moves inside watched directories come in pairs, usually read together.
+			// A file moved elsewhere is as good as deleted.
+			char* new_path = NULL;
+			for (size_t next_offset = offset; next_offset < length; ) {
+				struct inotify_event* next = (struct inotify_event*) (buffer + next_offset);
+				next_offset += sizeof (*next) + next->len;
+				const char* next_dir = g_hash_table_lookup (state->dirs, GINT_TO_POINTER (next->wd));
+				if ((next->mask & IN_MOVED_TO) && next->cookie == event->cookie && next->len > 0 && next_dir != NULL) {
+					new_path = g_build_filename (next_dir, next->name, NULL);
+					// The pair is handled now, so the second event is skipped.
+					next->mask = 0;
+					break;
+				}
+			}
+			if (new_path != NULL) {
+				pfs_watch_moved (state, path, new_path);
+				g_free (new_path);
+			}
+			else {
+				pfs_watch_removed (state, path);
+			}
+		}
+		else if (event->mask & IN_DELETE) {
+			pfs_watch_removed (state, path);
+		}
+		else if (event->mask & (IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_TO)) {
+			// A file moved over the original one replaces it, the path stays valid.
+			pfs_watch_changed (state, path);
+		}
+		g_free (path);
+	}
+}
+
+static void pfs_watch_changed (
+	pfs_watch_state* state, const char* path
+) {
+	if (!g_hash_table_contains (state->paths, path)) {
+		return;
+	}
+	pfs_data* data = state->data;
+	GPtrArray* names = g_ptr_array_new_with_free_func (g_free);
+	pfs_table_iter iter;
+	gpointer key, value;
+	g_rw_lock_reader_lock (&data->filetable_lock);
+	pfs_table_iter_init (&iter, data->filetable);
+	while (pfs_table_iter_next (&iter, &key, &value)) {
+		pfs_file* file = value;
+		if (file->dir != NULL && 0 == strcmp (file->path->str, path)) {
+			g_ptr_array_add (names, pfs_name_to_path (data, key));
+		}
+	}
+	g_rw_lock_reader_unlock (&data->filetable_lock);
+	pfs_watch_invalidate (state, names);
+	g_ptr_array_unref (names);
+}
+
+static void pfs_watch_removed (
+	pfs_watch_state* state, const char* path
+) {
+	if (!g_hash_table_contains (state->paths, path)) {
+		return;
+	}
+	pfs_data* data = state->data;
+	GPtrArray* names = g_ptr_array_new_with_free_func (g_free);
+	pfs_table_iter iter;
+	gpointer key, value;
+	g_rw_lock_writer_lock (&data->filetable_lock);
+	pfs_table_iter_init (&iter, data->filetable);
+	while (pfs_table_iter_next (&iter, &key, &value)) {
+		pfs_file* file = value;
+		if (file->dir == NULL || 0 != strcmp (file->path->str, path)) {
+			continue;
+		}
+		printinfof ("Original of '%s' was removed", (char*) key);
+		// Same as in pfs_unlink().
+		g_ptr_array_add (names, pfs_name_to_path (data, key));
+		pfs_table_iter_steal (&iter);
+		g_free (key);
+		if (--file->nlink == 0) {
+			pfs_file_free (file);
+		}
+	}
+	g_rw_lock_writer_unlock (&data->filetable_lock);
+	g_hash_table_remove (state->paths, path);
+	pfs_watch_invalidate (state, names);
+	g_ptr_array_unref (names);
+}
+
+static void pfs_watch_moved (
+	pfs_watch_state* state, const char* path, const char* new_path
+) {
+	if (!g_hash_table_contains (state->paths, path)) {
+		// Another file may have been moved over an original one.
+		pfs_watch_changed (state, new_path);
+		return;
+	}
+	pfs_data* data = state->data;
+	GPtrArray* names = g_ptr_array_new_with_free_func (g_free);
+	pfs_table_iter iter;
+	gpointer key, value;
+	g_rw_lock_writer_lock (&data->filetable_lock);
+	pfs_table_iter_init (&iter, data->filetable);
+	while (pfs_table_iter_next (&iter, &key, &value)) {
+		pfs_file* file = value;
+		if (file->dir == NULL) {
+			continue;
+		}
+		// Files with several names are moved once, but all names need invalidating.
+		if (0 == strcmp (file->path->str, path)) {
+			printinfof ("Original of '%s' was moved to '%s'", (char*) key, new_path);
+			pfs_file_set_path (file, new_path);
+		}
+		else if (0 != strcmp (file->path->str, new_path)) {
+			continue;
+		}
+		g_ptr_array_add (names, pfs_name_to_path (data, key));
+	}
+	g_rw_lock_writer_unlock (&data->filetable_lock);
+	g_hash_table_remove (state->paths, path);
+	g_hash_table_add (state->paths, g_strdup (new_path));
+	pfs_watch_invalidate (state, names);
+	g_ptr_array_unref (names);
+}
+
+static void pfs_watch_invalidate (
+	pfs_watch_state* state, GPtrArray* names
+) {
+	#if FUSE_USE_VERSION >= 30
+	for (guint iname = 0; iname < names->len; iname++) {
+		// Fails with ENOENT if the kernel does not know the name, which is fine.
+		fuse_invalidate_path (state->fuse, g_ptr_array_index (names, iname));
+	}
+	#endif
+}
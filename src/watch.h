@@ -0,0 +1,51 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PLAYLISTFS_WATCH_H
+#define PLAYLISTFS_WATCH_H
+
+#include "playlistfs.h"
+
+/*
+Watching of original files, enabled by --watch.
+Directories of original files are watched with inotify. When a file is deleted,
+it is removed from the filesystem; when it is moved, its new path is used;
+when it is changed, kernel caches are invalidated (FUSE 3 only).
+*/
+
+/*
+Start watching, if --watch was given. If the playlist is being loaded in background,
+directories are watched only after it is loaded.
+Must be called after FUSE has daemonized, as threads do not survive fork().
+@parameter data: Filesystem data
+@parameter fuse: FUSE instance to invalidate caches in
+*/
+void pfs_watch_start (pfs_data* data, struct fuse* fuse);
+
+/*
+Also watch files added after the filesystem was loaded, if watching.
+Can be called from any thread, but not after pfs_watch_stop().
+*/
+void pfs_watch_added (pfs_data* data);
+
+/*
+Stop watching and wait for the watching thread. The loader must be stopped before this.
+*/
+void pfs_watch_stop (pfs_data* data);
+
+#endif // PLAYLISTFS_WATCH_H
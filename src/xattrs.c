@@ -0,0 +1,117 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "xattrs.h"
+
+#include <string.h>
+
+// The cache is simply dropped when it gets this big, as old entries are mostly expired anyway.
+#define PFS_XATTRS_MAX_ENTRIES 4096
+
+typedef struct {
+	ino_t ino;
+	const char* name;
+} pfs_xattrs_key;
+
+struct pfs_xattrs {
+	GMutex lock; // Protects missing
+	GHashTable* missing; // pfs_xattrs_key* -> expiration time, as gint64*
+};
+
+static guint pfs_xattrs_key_hash (
+	gconstpointer pointer
+) {
+	const pfs_xattrs_key* key = pointer;
+	return g_str_hash (key->name) ^ (guint) (key->ino * 0x9e3779b1u);
+}
+
+static gboolean pfs_xattrs_key_equal (
+	gconstpointer a, gconstpointer b
+) {
+	const pfs_xattrs_key* key_a = a;
+	const pfs_xattrs_key* key_b = b;
+	return key_a->ino == key_b->ino && 0 == strcmp (key_a->name, key_b->name);
+}
+
+static void pfs_xattrs_key_free (
+	gpointer pointer
+) {
+	pfs_xattrs_key* key = pointer;
+	g_free ((char*) key->name);
+	g_free (key);
+}
+
+pfs_xattrs* pfs_xattrs_new (
+	void
+) {
+	pfs_xattrs* cache = g_new (pfs_xattrs, 1);
+	g_mutex_init (&cache->lock);
+	cache->missing = g_hash_table_new_full (pfs_xattrs_key_hash, pfs_xattrs_key_equal, pfs_xattrs_key_free, g_free);
+	return cache;
+}
+
+gboolean pfs_xattrs_is_missing (
+	pfs_xattrs* cache, ino_t ino, const char* name
+) {
+	pfs_xattrs_key key = { ino, name };
+	gboolean result = FALSE;
+	g_mutex_lock (&cache->lock);
+	gint64* expires = g_hash_table_lookup (cache->missing, &key);
+	if (expires != NULL) {
+		result = (g_get_monotonic_time () < *expires);
+		if (!result) {
+			g_hash_table_remove (cache->missing, &key);
+		}
+	}
+	g_mutex_unlock (&cache->lock);
+	return result;
+}
+
+void pfs_xattrs_set_missing (
+	pfs_xattrs* cache, ino_t ino, const char* name
+) {
+	pfs_xattrs_key* key = g_new (pfs_xattrs_key, 1);
+	key->ino = ino;
+	key->name = g_strdup (name);
+	gint64* expires = g_new (gint64, 1);
+	*expires = g_get_monotonic_time () + PFS_XATTRS_MISSING_TTL;
+
+	g_mutex_lock (&cache->lock);
+	if (g_hash_table_size (cache->missing) >= PFS_XATTRS_MAX_ENTRIES) {
+		g_hash_table_remove_all (cache->missing);
+	}
+	g_hash_table_replace (cache->missing, key, expires);
+	g_mutex_unlock (&cache->lock);
+}
+
+void pfs_xattrs_forget (
+	pfs_xattrs* cache, ino_t ino, const char* name
+) {
+	pfs_xattrs_key key = { ino, name };
+	g_mutex_lock (&cache->lock);
+	g_hash_table_remove (cache->missing, &key);
+	g_mutex_unlock (&cache->lock);
+}
+
+void pfs_xattrs_free (
+	pfs_xattrs* cache
+) {
+	g_hash_table_unref (cache->missing);
+	g_mutex_clear (&cache->lock);
+	g_free (cache);
+}
@@ -0,0 +1,63 @@
+/*
+ * This file is part of Playlist File System
+ * Copyright © 2018-2026 Alexander Bulancov
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef PLAYLISTFS_XATTRS_H
+#define PLAYLISTFS_XATTRS_H
+
+#include <glib.h>
+#include <sys/types.h>
+
+/*
+Cache of extended attributes known to be missing from original files.
+The kernel asks for some attributes (like security.capability) on every write,
+and they are almost never there. Entries expire after PFS_XATTRS_MISSING_TTL,
+so that attributes added to original files outside the filesystem are noticed.
+Each filesystem has its own cache. All functions except pfs_xattrs_new()
+and pfs_xattrs_free() can be called from any thread.
+*/
+typedef struct pfs_xattrs pfs_xattrs;
+
+// Time in microseconds for which an attribute is considered missing.
+#define PFS_XATTRS_MISSING_TTL 1000000
+
+pfs_xattrs* pfs_xattrs_new (void);
+
+/*
+Check whether an attribute was recently found to be missing.
+@parameter ino: Inode number of the file inside the filesystem
+@parameter name: Name of the attribute
+*/
+gboolean pfs_xattrs_is_missing (pfs_xattrs* cache, ino_t ino, const char* name);
+
+/*
+Remember that an attribute is missing.
+@parameter ino: Inode number of the file inside the filesystem
+@parameter name: Name of the attribute
+*/
+void pfs_xattrs_set_missing (pfs_xattrs* cache, ino_t ino, const char* name);
+
+/*
+Forget that an attribute is missing, after it was set.
+@parameter ino: Inode number of the file inside the filesystem
+@parameter name: Name of the attribute
+*/
+void pfs_xattrs_forget (pfs_xattrs* cache, ino_t ino, const char* name);
+
+void pfs_xattrs_free (pfs_xattrs* cache);
+
+#endif // PLAYLISTFS_XATTRS_H
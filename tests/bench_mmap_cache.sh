@@ -0,0 +1,43 @@
+#!/bin/sh
+# Compare reading a big file through the filesystem with and without --mmap-cache,
+# and count syscalls saved per GiB read.
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+SIZE=${BENCH_MMAP_SIZE:-256}
+PASSES=${BENCH_MMAP_PASSES:-4}
+head -c $((SIZE * 1024 * 1024)) /dev/urandom > "$TEST_TMP/bench_mmap"
+
+read_passes() {
+    local start="$(date +%s.%N)"
+    for pass in $(seq $PASSES); do
+        cat "$1" > /dev/null
+    done
+    local end="$(date +%s.%N)"
+    awk "BEGIN { printf \"%d reads of %d MiB: %.3f s, %.1f MiB/s\n\", $PASSES, $SIZE, $end - $start, $PASSES * $SIZE / ($end - $start) }"
+}
+
+echo "Original file:"
+read_passes "$TEST_TMP/bench_mmap"
+
+for options in "" "--mmap-cache=1024"; do
+    echo "Mounted with '$options':"
+    test_mount $options --file "$TEST_TMP/bench_mmap" -q
+    read_passes "$TEST_MOUNT_POINT/bench_mmap"
+done
+cleanup
+
+# The report is only printed when running in foreground, on unmount.
+echo "Syscalls with '--mmap-cache=1024':"
+make_test_mount_point
+"$BIN" -d -v --mmap-cache=1024 --file "$TEST_TMP/bench_mmap" "$TEST_MOUNT_POINT" 2> "$TEST_TMP/bench_mmap.log" &
+for i in 1 2 3 4 5 6 7 8 9 10; do
+    [ -e "$TEST_MOUNT_POINT/bench_mmap" ] && break
+    sleep 0.1
+done
+read_passes "$TEST_MOUNT_POINT/bench_mmap" > /dev/null
+cleanup
+wait
+grep "Map cache:" "$TEST_TMP/bench_mmap.log"
+rm -f "$TEST_TMP/bench_mmap" "$TEST_TMP/bench_mmap.log"
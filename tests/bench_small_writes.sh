@@ -0,0 +1,21 @@
+#!/bin/sh
+# Compare throughput of small writes through the filesystem with different options.
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+SIZE=${BENCH_WRITE_SIZE:-512}
+COUNT=${BENCH_WRITE_COUNT:-20000}
+: > "$TEST_TMP/bench_small_writes"
+
+echo "Original file:"
+"$TEST_ROOT/utils/small_writes" "$TEST_TMP/bench_small_writes" $SIZE $COUNT
+
+for options in "" "--big-writes" "--writeback-cache" "--writeback-cache --max-write=1048576"; do
+    echo "Mounted with '$options':"
+    test_mount $options --file "$TEST_TMP/bench_small_writes" -q
+    "$TEST_ROOT/utils/small_writes" "$TEST_MOUNT_POINT/bench_small_writes" $SIZE $COUNT
+done
+
+cleanup
+rm -f "$TEST_TMP/bench_small_writes"
@@ -0,0 +1,20 @@
+#!/bin/sh
+# Compare throughput of concurrent mutations and reads through the filesystem at different thread counts.
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+SECONDS_PER_RUN=${BENCH_STRESS_SECONDS:-3}
+THREADS=${BENCH_STRESS_THREADS:-"1 2 4 8 16"}
+mkdir -p "$TEST_TMP/bench_stress"
+printf "original\n" > "$TEST_TMP/bench_stress/stress"
+
+echo "Original directory:"
+"$TEST_ROOT/utils/stress" "$TEST_TMP/bench_stress" stress $SECONDS_PER_RUN $THREADS
+
+echo "Mounted:"
+test_mount --file "$TEST_TMP/bench_stress/stress" -q
+"$TEST_ROOT/utils/stress" "$TEST_MOUNT_POINT" stress $SECONDS_PER_RUN $THREADS
+
+cleanup
+rm -rf "$TEST_TMP/bench_stress"
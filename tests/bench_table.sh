@@ -0,0 +1,8 @@
+#!/bin/sh
+# Compare the file table with GHashTable at different numbers of names.
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+
+SIZES=${BENCH_TABLE_SIZES:-"10000 1000000 10000000"}
+
+"$TEST_ROOT/utils/table_bench" $SIZES
@@ -13,6 +13,9 @@ fi
 TEST_FILE="$(basename "$0")"
 # Temporary directory for tests
 TEST_TMP="$TEST_ROOT/tmp"
+# Simulator of slow storage, preloaded into playlistfs if SLOW_BACKEND_DIR is set.
+# See utils/src/slow_backend.c for variables setting latencies and bandwidth.
+SLOW_BACKEND="$TEST_ROOT/utils/slow_backend.so"
 # This is defined by `test_mount()` and `make_test_mount_point()`
 TEST_MOUNT_POINT=
 
@@ -22,7 +25,13 @@ TEST_MOUNT_POINT=
 test_mount() {
     cleanup
     make_test_mount_point
-    "$BIN" "$@" "$TEST_MOUNT_POINT"
+    if [ -n "$SLOW_BACKEND_DIR" ]; then
+        # AddressSanitizer wants to be loaded first, but does not mind the simulator.
+        LD_PRELOAD="$SLOW_BACKEND" ASAN_OPTIONS="verify_asan_link_order=0${ASAN_OPTIONS:+:$ASAN_OPTIONS}" \
+            "$BIN" "$@" "$TEST_MOUNT_POINT"
+    else
+        "$BIN" "$@" "$TEST_MOUNT_POINT"
+    fi
 }
 
 # Perform cleanup before/after a test.
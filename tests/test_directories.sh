@@ -0,0 +1,51 @@
+#!/bin/sh
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+number_of_files() {
+    ls "$TEST_MOUNT_POINT" | wc -l
+}
+
+mkdir -p "$TEST_TMP/music/rock/old" "$TEST_TMP/music/jazz"
+echo "a" > "$TEST_TMP/music/a.flac"
+echo "b" > "$TEST_TMP/music/b.mp3"
+echo "c" > "$TEST_TMP/music/rock/c.flac"
+echo "d" > "$TEST_TMP/music/rock/old/d.flac"
+echo "old a" > "$TEST_TMP/music/jazz/a.flac"
+ln -s FAKE "$TEST_TMP/music/link.flac"
+
+printf "#directory music\n" > "$TEST_TMP/directory.playlist"
+run_test "Mounting a list with a directory" test_mount "$TEST_TMP/directory.playlist"
+subtest "Files from the directory are present" test -f "$TEST_MOUNT_POINT/a.flac" -a -f "$TEST_MOUNT_POINT/b.mp3"
+subtest "Symlinks from the directory are present" test -L "$TEST_MOUNT_POINT/link.flac"
+subtest "Subdirectories are not descended into" test ! -e "$TEST_MOUNT_POINT/c.flac"
+subtest "Subdirectories are not added" test ! -e "$TEST_MOUNT_POINT/rock"
+subtest "File system has number of files equal to files in the directory" test $(number_of_files) = 3
+
+printf "#directory music/*.flac\n" > "$TEST_TMP/glob.playlist"
+run_test "Mounting a list with a directory glob" test_mount "$TEST_TMP/glob.playlist"
+subtest "Matching files are present" test -f "$TEST_MOUNT_POINT/a.flac" -a -L "$TEST_MOUNT_POINT/link.flac"
+subtest "Non-matching files are absent" test ! -e "$TEST_MOUNT_POINT/b.mp3"
+
+printf "#directory-recursive music/*.flac\n" > "$TEST_TMP/recursive.playlist"
+run_test "Mounting a list with a recursive directory glob" test_mount "$TEST_TMP/recursive.playlist"
+subtest "Files from nested directories are present" test -f "$TEST_MOUNT_POINT/c.flac" -a -f "$TEST_MOUNT_POINT/d.flac"
+subtest "Files from subdirectories override files from parent" grep -q "old a" "$TEST_MOUNT_POINT/a.flac"
+subtest "Non-matching files are absent" test ! -e "$TEST_MOUNT_POINT/b.mp3"
+
+mkdir -p "$TEST_TMP/music/Album [2001]"
+echo "e" > "$TEST_TMP/music/Album [2001]/e.flac"
+printf "#directory music/Album [2001]\n" > "$TEST_TMP/brackets.playlist"
+run_test "Mounting a list with brackets in directory name" test_mount "$TEST_TMP/brackets.playlist"
+subtest "Files from the directory are present" test -f "$TEST_MOUNT_POINT/e.flac"
+subtest "Directory is not treated as a pattern" test $(number_of_files) = 1
+
+printf "#directory-recursive music\n/etc/hosts\nmusic/a.flac\n" > "$TEST_TMP/mixed.playlist"
+run_test "Mounting a list with a directory and files" test_mount "$TEST_TMP/mixed.playlist"
+subtest "Later file overrides file from directory" grep -q "^a$" "$TEST_MOUNT_POINT/a.flac"
+subtest "Other files are present" test -f "$TEST_MOUNT_POINT/hosts" -a -f "$TEST_MOUNT_POINT/d.flac"
+
+printf "#directory nowhere\n/etc/hosts\n" > "$TEST_TMP/missing.playlist"
+run_test "Mounting a list with a missing directory" test_mount "$TEST_TMP/missing.playlist"
+subtest "Other entries are present" test -f "$TEST_MOUNT_POINT/hosts"
@@ -0,0 +1,30 @@
+#!/bin/sh
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+run_test "Mounting a list with an include" test_mount "$(fixture include.playlist)"
+subtest "Files from included list are present" test -f "$TEST_MOUNT_POINT/hosts" -a -f "$TEST_MOUNT_POINT/test.playlist"
+subtest "Later entry overrides included one" compare_file_info "$TEST_MOUNT_POINT/fstab" "$(fixture fstab)"
+
+printf "fstab\n#include $(fixture test.playlist)\n" > "$TEST_TMP/include_last.playlist"
+run_test "Mounting a list with an include at the end" test_mount "$TEST_TMP/include_last.playlist"
+subtest "Included entry overrides earlier one" compare_file_info "$TEST_MOUNT_POINT/fstab" "/etc/fstab"
+
+mkdir -p "$TEST_TMP/nested"
+cp "$(fixture fstab)" "$TEST_TMP/nested/fstab"
+printf "#include ../cycle_a.playlist\nfstab\n" > "$TEST_TMP/nested/cycle_b.playlist"
+printf "/etc/hosts\n#include nested/cycle_b.playlist\n#include nested/cycle_b.playlist\n" > "$TEST_TMP/cycle_a.playlist"
+run_test "Mounting lists including each other" test_mount "$TEST_TMP/cycle_a.playlist"
+subtest "Files from both lists are present" test -f "$TEST_MOUNT_POINT/hosts" -a -f "$TEST_MOUNT_POINT/fstab"
+subtest "Relative paths are relative to the included list" compare_file_info "$TEST_MOUNT_POINT/fstab" "$TEST_TMP/nested/fstab"
+
+test_mount "$TEST_TMP/cycle_a.playlist" 2>"$TEST_TMP/cycle.log"
+run_test "Warns about recursive include" grep -Fq "is included recursively" "$TEST_TMP/cycle.log"
+
+printf "#include nowhere.playlist\n/etc/hosts\n" > "$TEST_TMP/missing.playlist"
+run_test "Mounting a list with a missing include" test_mount "$TEST_TMP/missing.playlist"
+subtest "Other entries are present" test -f "$TEST_MOUNT_POINT/hosts"
+
+run_test "Mounting with an include and --no-relative-paths" test_mount --no-relative-paths "$(fixture include.playlist)"
+subtest "Relative include is ignored" test ! -f "$TEST_MOUNT_POINT/hosts"
@@ -0,0 +1,19 @@
+#!/bin/sh
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+run_test "Mounting with --background-load" test_mount --background-load "$(fixture include.playlist)"
+subtest "Files from lists are present" test -f "$TEST_MOUNT_POINT/hosts" -a -f "$TEST_MOUNT_POINT/test.playlist"
+subtest "Later entry overrides earlier one" compare_file_info "$TEST_MOUNT_POINT/fstab" "$(fixture fstab)"
+subtest "Directory lists all files once loaded" sh -c "ls '$TEST_MOUNT_POINT' | grep -c . | grep -qx 3"
+
+cleanup
+make_test_mount_point
+run_test "Mounting relative lists with --background-load" \
+    sh -c "cd '$TEST_ROOT/fixtures' && '$BIN' --background-load include.playlist '$TEST_MOUNT_POINT'"
+subtest "Relative paths are resolved against starting directory" compare_file_info "$TEST_MOUNT_POINT/fstab" "$(fixture fstab)"
+
+test_mount --background-load --file /etc/hosts
+run_test "Renaming waits for loading to finish" mv "$TEST_MOUNT_POINT/hosts" "$TEST_MOUNT_POINT/hosts2"
+subtest "Renamed file is present" test -f "$TEST_MOUNT_POINT/hosts2" -a ! -e "$TEST_MOUNT_POINT/hosts"
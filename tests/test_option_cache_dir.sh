@@ -0,0 +1,24 @@
+#!/bin/sh
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+mkdir "$TEST_TMP/cache"
+head -c 3000000 /dev/urandom > "$TEST_TMP/original"
+
+run_test "--cache-dir mount" test_mount --cache-dir "$TEST_TMP/cache" --cache-size 2 -f "$TEST_TMP/original"
+subtest "File is read correctly" cmp "$TEST_MOUNT_POINT/original" "$TEST_TMP/original"
+subtest "Blocks are stored in the cache" test -n "$(ls "$TEST_TMP/cache")"
+subtest "Cache stays within its budget" sh -c "test \$(du -sb '$TEST_TMP/cache' | cut -f1) -le 2097152"
+subtest "File is read correctly from the cache" cmp "$TEST_MOUNT_POINT/original" "$TEST_TMP/original"
+printf "changed" | dd of="$TEST_TMP/original" conv=notrunc 2>/dev/null
+subtest "Changed file is not read from the cache" cmp "$TEST_MOUNT_POINT/original" "$TEST_TMP/original"
+SECOND_MOUNT_POINT="$(mktemp --tmpdir="$TEST_TMP" -dt "SECOND.XXXXXX")"
+run_test "Cache directory can not be used by two mounts" ! "$BIN" --cache-dir "$TEST_TMP/cache" "$SECOND_MOUNT_POINT"
+rmdir "$SECOND_MOUNT_POINT"
+
+cleanup
+touch "$TEST_TMP/cache/unrelated"
+run_test "Mounting with a cache left by an earlier mount" test_mount --cache-dir "$TEST_TMP/cache" -f "$TEST_TMP/original"
+subtest "File is read correctly" cmp "$TEST_MOUNT_POINT/original" "$TEST_TMP/original"
+subtest "Unrelated files are kept" test -e "$TEST_TMP/cache/unrelated"
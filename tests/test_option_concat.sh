@@ -0,0 +1,42 @@
+#!/bin/sh
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+printf "first," > "$TEST_TMP/concat1"
+: > "$TEST_TMP/concat2"
+printf "second" > "$TEST_TMP/concat3"
+
+run_test "--concat mount" test_mount --concat all \
+    --file "$TEST_TMP/concat1" --file "$TEST_TMP/concat2" --file "$TEST_TMP/concat3"
+subtest "File is present with the total size" test "$(stat -c %s "$TEST_MOUNT_POINT/all")" = 12
+subtest "File contains all files in order" test "$(cat "$TEST_MOUNT_POINT/all")" = "first,second"
+subtest "Reads spanning several files" \
+    test "$(dd if="$TEST_MOUNT_POINT/all" bs=1 skip=4 count=5 2>/dev/null)" = "t,sec"
+subtest "File is read-only" ! sh -c "echo data >> '$TEST_MOUNT_POINT/all'"
+subtest "Original files are still present" compare_file_info "$TEST_MOUNT_POINT/concat1" "$TEST_TMP/concat1"
+
+mkdir -p "$TEST_TMP/gone"
+run_test "--concat mount with a symlink left by a missing file" test_mount --concat all \
+    --file "$TEST_TMP/concat3" --symlink "$TEST_TMP/concat1" --file "$TEST_TMP/gone/concat1"
+subtest "Symlink is not concatenated" test "$(cat "$TEST_MOUNT_POINT/all")" = "second"
+
+# Every file is opened for reading, but only a few are kept open.
+mkdir -p "$TEST_TMP/many"
+: > "$TEST_TMP/many.playlist"
+: > "$TEST_TMP/many.expected"
+for i in $(seq 300); do
+    echo "$i" > "$TEST_TMP/many/$i"
+    echo "many/$i" >> "$TEST_TMP/many.playlist"
+    echo "$i" >> "$TEST_TMP/many.expected"
+done
+printf '#!/bin/sh\nulimit -n 64 && exec "%s" "$@"\n' "$BIN" > "$TEST_TMP/few_descriptors"
+chmod +x "$TEST_TMP/few_descriptors"
+REAL_BIN="$BIN"
+BIN="$TEST_TMP/few_descriptors"
+run_test "--concat mount with more files than descriptors" test_mount --concat all "$TEST_TMP/many.playlist"
+BIN="$REAL_BIN"
+subtest "File contains all files" cmp "$TEST_MOUNT_POINT/all" "$TEST_TMP/many.expected"
+
+run_test "--concat with a path is rejected" ! "$BIN" --concat a/b "$TEST_MOUNT_POINT"
+run_test "--concat with an empty name is rejected" ! "$BIN" --concat "" "$TEST_MOUNT_POINT"
@@ -0,0 +1,41 @@
+#!/bin/sh
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+SOCKET="$TEST_TMP/control.socket"
+CONTROLLED="$TEST_TMP/controlled"
+rm -rf "$CONTROLLED"
+mkdir -p "$CONTROLLED"
+printf "first\n" > "$CONTROLLED/first"
+printf "second\n" > "$CONTROLLED/second"
+printf "third\n" > "$CONTROLLED/third"
+
+apply () {
+    printf "$1" | "$BIN" --apply="$SOCKET"
+}
+
+run_test "Applying without a filesystem fails" ! apply 'remove\tfirst\n'
+
+run_test "--control mount" test_mount --control="$SOCKET" -f "$CONTROLLED/first" -f "$CONTROLLED/second"
+subtest "Socket is created" test -S "$SOCKET"
+subtest "Applying a batch" apply "add\t$CONTROLLED/third\nremove\tfirst\nrename\tsecond\trenamed\n"
+subtest "Added file is present" cmp "$TEST_MOUNT_POINT/third" "$CONTROLLED/third"
+subtest "Removed file is gone" test ! -e "$TEST_MOUNT_POINT/first"
+subtest "Renamed file is present" cmp "$TEST_MOUNT_POINT/renamed" "$CONTROLLED/second"
+subtest "Relative paths are resolved against client directory" \
+    sh -c "cd '$CONTROLLED' && printf 'add\tfirst\n' | '$BIN' --apply='$SOCKET'"
+subtest "Relative file is present" cmp "$TEST_MOUNT_POINT/first" "$CONTROLLED/first"
+subtest "Failing batch is rejected" ! apply "remove\tthird\nremove\tmissing\n"
+subtest "Nothing is changed by failing batch" test -e "$TEST_MOUNT_POINT/third"
+subtest "Errors are reported to client" sh -c \
+    "printf 'add\t$CONTROLLED/missing\nbogus\n' | '$BIN' --apply='$SOCKET' 2>&1 | grep -q 'unknown command'"
+subtest "Symbolic links can be added" apply "symlink\t/etc/hosts\n"
+subtest "Symbolic link is present" test -L "$TEST_MOUNT_POINT/hosts"
+SECOND_MOUNT_POINT="$(mktemp --tmpdir="$TEST_TMP" -dt "SECOND.XXXXXX")"
+subtest "Another mount can not use the same socket" ! "$BIN" --control="$SOCKET" -f "$CONTROLLED/first" "$SECOND_MOUNT_POINT"
+rmdir "$SECOND_MOUNT_POINT"
+
+cleanup
+subtest "Socket is removed on unmounting" sh -c "sleep 0.2; test ! -e '$SOCKET'"
+rm -rf "$CONTROLLED"
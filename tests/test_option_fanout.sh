@@ -0,0 +1,20 @@
+#!/bin/sh
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+printf "one\n" > "$TEST_TMP/one"
+printf "two\n" > "$TEST_TMP/two"
+
+run_test "--fanout mount" test_mount --fanout -f "$TEST_TMP/one" -f "$TEST_TMP/two"
+subtest "Root has 256 subdirectories" test "$(ls "$TEST_MOUNT_POINT" | wc -l)" -eq 256
+subtest "Subdirectories are named by hex digits" test -d "$TEST_MOUNT_POINT/00" -a -d "$TEST_MOUNT_POINT/ff"
+subtest "File is not at root" test ! -e "$TEST_MOUNT_POINT/one"
+subtest "File is in exactly one subdirectory" test "$(ls "$TEST_MOUNT_POINT"/*/one | wc -l)" -eq 1
+one="$(ls "$TEST_MOUNT_POINT"/*/one)"
+bucket="$(dirname "$one")"
+subtest "File is read correctly" cmp "$one" "$TEST_TMP/one"
+subtest "Subdirectory lists its files" sh -c "ls '$bucket' | grep -qx one"
+subtest "File can be renamed only if it stays in its subdirectory" \
+    sh -c "! mv '$one' '$bucket/two' 2>/dev/null && test -e '$one'"
+subtest "File can be removed" sh -c "rm '$one' && test ! -e '$one' && test -e '$TEST_TMP/one'"
@@ -11,3 +11,13 @@ subtest "File is read-only" test "$(extract_mode "$TEST_MOUNT_POINT/script.sh")"
 
 run_test "--read-only and --symlinks mount" test_mount --read-only --symlinks -f "$(fixture script.sh)"
 subtest "Symlink reports full permissions" test "$(extract_mode "$TEST_MOUNT_POINT/script.sh")" = "lrwxrwxrwx"
+
+# Read-only mounts use a frozen file table.
+test_mount --read-only --timings "$(fixture include.playlist)" 2>"$TEST_TMP/timings.log"
+run_test "--read-only mount with lists" cmp /etc/hosts "$TEST_MOUNT_POINT/hosts"
+subtest "File table is frozen" grep -Eq "^ +freeze table +[0-9.]+ ms" "$TEST_TMP/timings.log"
+subtest "Directory lists all files" sh -c "ls '$TEST_MOUNT_POINT' | grep -c . | grep -qx 4"
+subtest "Missing file is not found" test ! -e "$TEST_MOUNT_POINT/missing"
+subtest "Deleting a file fails" ! unlink "$TEST_MOUNT_POINT/hosts"
+subtest "Renaming a file fails" ! mv "$TEST_MOUNT_POINT/hosts" "$TEST_MOUNT_POINT/renamed"
+subtest "Files are still there" test -f "$TEST_MOUNT_POINT/hosts"
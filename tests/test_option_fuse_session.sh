@@ -0,0 +1,22 @@
+#!/bin/sh
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+run_test "Mounting with worker thread options" \
+    test_mount --clone-fd --max-idle-threads=2 --max-threads=4 "$(fixture test.playlist)"
+subtest "Files are readable" cmp "$TEST_MOUNT_POINT/hosts" /etc/hosts
+subtest "Files are readable in parallel" sh -c "
+    for i in 1 2 3 4 5 6 7 8; do cat '$TEST_MOUNT_POINT/fstab' > /dev/null & done; wait"
+
+run_test "Mounting with request options" \
+    test_mount --max-background=32 --congestion-threshold=24 --max-read=65536 "$(fixture test.playlist)"
+subtest "Files are readable" cmp "$TEST_MOUNT_POINT/hosts" /etc/hosts
+
+run_test "Negative number of threads is rejected" ! test_mount --max-threads=-1 "$(fixture test.playlist)"
+run_test "Negative --max-read is rejected" ! test_mount --max-read=-1 "$(fixture test.playlist)"
+
+test_mount --timings "$(fixture test.playlist)" 2>"$TEST_TMP/session.log"
+if using_fuse3; then
+    run_test "Timings include mounting" grep -Eq "^  mount +[0-9.]+ ms" "$TEST_TMP/session.log"
+fi
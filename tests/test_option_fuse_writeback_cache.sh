@@ -0,0 +1,23 @@
+#!/bin/sh
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+printf "first\n" > "$TEST_TMP/writeback"
+
+run_test "--writeback-cache mount" test_mount --writeback-cache -f "$TEST_TMP/writeback"
+subtest "Appending to a file" sh -c "printf 'second\n' >> '$TEST_MOUNT_POINT/writeback'"
+subtest "Writing many small pieces" sh -c "for i in 1 2 3 4 5 6 7 8; do printf \"\$i\"; done >> '$TEST_MOUNT_POINT/writeback'"
+subtest "Data reaches original file after close" test "$(cat "$TEST_TMP/writeback")" = "$(printf "first\nsecond\n12345678")"
+subtest "Size is the same as original" test "$(stat --format %s "$TEST_MOUNT_POINT/writeback")" = "$(stat --format %s "$TEST_TMP/writeback")"
+subtest "Modification time is the same as original" compare_file_info "$TEST_MOUNT_POINT/writeback" "$TEST_TMP/writeback"
+subtest "Setting modification time after writing" utils/write_times "$TEST_MOUNT_POINT/writeback" "9" 978307200
+subtest "Original file gets the modification time" test "$(stat --format %Y "$TEST_TMP/writeback")" = 978307200
+
+run_test "--max-write and --big-writes mount" test_mount --max-write=1048576 --big-writes -f "$TEST_TMP/writeback"
+subtest "Overwriting a file with big writes" sh -c "head -c 3000000 /dev/zero > '$TEST_MOUNT_POINT/writeback'"
+subtest "Data reaches original file" test "$(stat --format %s "$TEST_TMP/writeback")" = 3000000
+
+run_test "Negative --max-write is rejected" ! test_mount --max-write=-1 -f "$TEST_TMP/writeback"
+
+rm -f "$TEST_TMP/writeback"
@@ -0,0 +1,19 @@
+#!/bin/sh
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+printf "#define SMALL 1\n" > "$TEST_TMP/small.h"
+head -c 200000 /dev/urandom > "$TEST_TMP/big"
+
+run_test "--memory-cache mount" test_mount --memory-cache 1 -f "$TEST_TMP/small.h" -f "$TEST_TMP/big"
+subtest "Small file is read correctly" cmp "$TEST_MOUNT_POINT/small.h" "$TEST_TMP/small.h"
+subtest "Small file is read correctly again" cmp "$TEST_MOUNT_POINT/small.h" "$TEST_TMP/small.h"
+subtest "Reads inside a small file" \
+    test "$(dd if="$TEST_MOUNT_POINT/small.h" bs=1 skip=8 count=5 2>/dev/null)" = "SMALL"
+printf "#define SMALL 2\n" > "$TEST_TMP/small.h"
+subtest "Changed file is read anew" cmp "$TEST_MOUNT_POINT/small.h" "$TEST_TMP/small.h"
+subtest "Big file is read from original file" cmp "$TEST_MOUNT_POINT/big" "$TEST_TMP/big"
+subtest "Big file is copied correctly" \
+    sh -c "rm -f '$TEST_TMP/big.copy' && cp '$TEST_MOUNT_POINT/big' '$TEST_TMP/big.copy' && cmp '$TEST_TMP/big.copy' '$TEST_TMP/big'"
+subtest "Small file can still be written" sh -c "echo '#define MORE 1' >> '$TEST_MOUNT_POINT/small.h' && grep -q MORE '$TEST_TMP/small.h'"
@@ -0,0 +1,33 @@
+#!/bin/sh
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+head -c 3000000 /dev/urandom > "$TEST_TMP/mapped"
+printf "small\n" > "$TEST_TMP/not_mapped"
+
+# Compare the same range of the original and mounted files.
+compare_range() {
+    dd if="$TEST_MOUNT_POINT/mapped" bs=1000 skip=$1 count=$2 2>/dev/null > "$TEST_TMP/range.mounted"
+    dd if="$TEST_TMP/mapped" bs=1000 skip=$1 count=$2 2>/dev/null > "$TEST_TMP/range.original"
+    cmp "$TEST_TMP/range.mounted" "$TEST_TMP/range.original"
+}
+
+run_test "--mmap-cache mount" test_mount --mmap-cache 64 -f "$TEST_TMP/mapped" -f "$TEST_TMP/not_mapped"
+subtest "Big file is read correctly" cmp "$TEST_MOUNT_POINT/mapped" "$TEST_TMP/mapped"
+subtest "Big file is read correctly again" cmp "$TEST_MOUNT_POINT/mapped" "$TEST_TMP/mapped"
+subtest "Reads inside a big file" compare_range 1234 17
+subtest "Reads at the end of a big file" compare_range 2990 20
+subtest "Small file is read from original file" cmp "$TEST_MOUNT_POINT/not_mapped" "$TEST_TMP/not_mapped"
+subtest "Big file is copied correctly" \
+    sh -c "rm -f '$TEST_TMP/mapped.copy' && cp '$TEST_MOUNT_POINT/mapped' '$TEST_TMP/mapped.copy' && cmp '$TEST_TMP/mapped.copy' '$TEST_TMP/mapped'"
+
+exec 3< "$TEST_MOUNT_POINT/mapped"
+truncate -s 1500000 "$TEST_TMP/mapped"
+subtest "Reading past end of a truncated open file" \
+    test "$(dd bs=1000 skip=2000 count=10 <&3 2>/dev/null | wc -c)" -eq 0
+exec 3<&-
+subtest "Filesystem survives truncation" cmp "$TEST_MOUNT_POINT/not_mapped" "$TEST_TMP/not_mapped"
+subtest "Truncated file is mapped anew" cmp "$TEST_MOUNT_POINT/mapped" "$TEST_TMP/mapped"
+
+run_test "Budget smaller than a window is rejected" ! test_mount --mmap-cache 15 -f "$TEST_TMP/not_mapped"
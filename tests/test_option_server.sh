@@ -0,0 +1,56 @@
+#!/bin/sh
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+SOCKET="$TEST_TMP/server.socket"
+
+run_test "Connecting without a server fails" ! "$BIN" --connect="$SOCKET" "$(fixture test.playlist)" "$TEST_TMP"
+
+if using_fuse3; then
+    "$BIN" --server="$SOCKET" &
+    SERVER=$!
+    for i in 1 2 3 4 5 6 7 8 9 10; do
+        [ -S "$SOCKET" ] && break
+        sleep 0.1
+    done
+    run_test "Starting a server" test -S "$SOCKET"
+    subtest "Starting another server at the same socket fails" ! "$BIN" --server="$SOCKET"
+
+    make_test_mount_point
+    FIRST="$TEST_MOUNT_POINT"
+    make_test_mount_point
+    SECOND="$TEST_MOUNT_POINT"
+    run_test "Mounting through the server" "$BIN" --connect="$SOCKET" "$(fixture test.playlist)" "$FIRST"
+    subtest "Files are present" cmp "$FIRST/hosts" /etc/hosts
+    subtest "Mounting another filesystem with relative paths" \
+        sh -c "cd '$TEST_ROOT/fixtures' && '$BIN' --connect='$SOCKET' -f fstab '$SECOND'"
+    subtest "Relative paths are resolved against client directory" compare_file_info "$SECOND/fstab" "$(fixture fstab)"
+    subtest "Filesystems have separate files" test ! -e "$SECOND/hosts"
+    subtest "Errors are reported to client" sh -c \
+        "out=\$('$BIN' --connect='$SOCKET' -f /etc/hosts '$TEST_TMP/missing' 2>&1); test \$? -ne 0 && echo \"\$out\" | grep -q 'mount target is not accessible'"
+    subtest "Version requests are refused by the server" \
+        ! "$BIN" --connect="$SOCKET" -V -f /etc/hosts "$FIRST"
+    subtest "Server keeps running after a refused request" kill -0 $SERVER
+
+    # A list which is a FIFO keeps its filesystem being built until the list is written.
+    mkfifo "$TEST_TMP/slow.playlist"
+    make_test_mount_point
+    THIRD="$TEST_MOUNT_POINT"
+    "$BIN" --connect="$SOCKET" "$TEST_TMP/slow.playlist" "$THIRD" &
+    SLOW_CLIENT=$!
+    subtest "Server answers while another filesystem is built" sh -c \
+        "out=\$(timeout 5 '$BIN' --connect='$SOCKET' -f /etc/hosts '$TEST_TMP/missing' 2>&1); echo \"\$out\" | grep -q 'mount target is not accessible'"
+    echo /etc/hosts > "$TEST_TMP/slow.playlist"
+    subtest "Slowly built filesystem is mounted" wait $SLOW_CLIENT
+    subtest "Its files are present" cmp "$THIRD/hosts" /etc/hosts
+    rm -f "$TEST_TMP/slow.playlist"
+
+    subtest "Unmounting one filesystem" fusermount3 -u "$FIRST"
+    subtest "Other filesystem still works" cmp "$SECOND/fstab" "$(fixture fstab)"
+    kill $SERVER
+    wait $SERVER
+    subtest "Stopping the server unmounts all filesystems" sh -c "! mountpoint -q '$SECOND'"
+    subtest "Socket is removed" test ! -e "$SOCKET"
+    rmdir "$FIRST" "$SECOND" "$THIRD"
+fi
@@ -5,6 +5,7 @@ TEST_ROOT="$(dirname "$(realpath "$0")")"
 
 run_test "--symlinks mount" test_mount --symlinks "$(fixture test.playlist)"
 subtest "File is a symlink" test "$(extract_mode "$TEST_MOUNT_POINT/test.playlist")" = "lrwxrwxrwx"
+subtest "Link points to normalized path" test "$(readlink "$TEST_MOUNT_POINT/test.playlist")" = "$(fixture test.playlist)"
 
 run_test "-S mount" test_mount -S "$(fixture test.playlist)"
 subtest "File is a symlink" test "$(extract_mode "$TEST_MOUNT_POINT/test.playlist")" = "lrwxrwxrwx"
@@ -0,0 +1,14 @@
+#!/bin/sh
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+test_mount --timings "$(fixture include.playlist)" 2>"$TEST_TMP/timings.log"
+run_test "Mounting with --timings" test -f "$TEST_MOUNT_POINT/hosts"
+subtest "Reports time of phases" grep -Eq "^ +read lists +[0-9.]+ ms +[0-9.]+ ms" "$TEST_TMP/timings.log"
+subtest "Reports lines read" grep -Eq "^ +lines read +5$" "$TEST_TMP/timings.log"
+subtest "Reports shadowed entries" grep -Eq "^ +entries shadowed +1$" "$TEST_TMP/timings.log"
+subtest "Reports peak memory usage" grep -Eq "^ +peak RSS +[0-9]+ KiB$" "$TEST_TMP/timings.log"
+
+test_mount "$(fixture include.playlist)" 2>"$TEST_TMP/timings.log"
+run_test "Does not report without --timings" ! grep -q "Startup timings" "$TEST_TMP/timings.log"
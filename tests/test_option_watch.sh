@@ -0,0 +1,36 @@
+#!/bin/sh
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+WATCHED="$TEST_TMP/watched"
+rm -rf "$WATCHED"
+mkdir -p "$WATCHED"
+printf "first\n" > "$WATCHED/first"
+printf "second\n" > "$WATCHED/second"
+printf "third\n" > "$WATCHED/third"
+
+run_test "--watch mount" test_mount --watch --cache-timeout=60 -f "$WATCHED/first" -f "$WATCHED/second" -f "$WATCHED/third"
+subtest "Files are present" test -f "$TEST_MOUNT_POINT/first" -a -f "$TEST_MOUNT_POINT/second"
+subtest "Deleting original file" rm "$WATCHED/first"
+subtest "File disappears" sh -c "sleep 0.2; test ! -e '$TEST_MOUNT_POINT/first'"
+subtest "Moving original file" mv "$WATCHED/second" "$WATCHED/moved"
+subtest "File is still there" sh -c "sleep 0.2; test \"\$(cat '$TEST_MOUNT_POINT/second')\" = second"
+if using_fuse3; then
+    subtest "Reading a file to cache its attributes" test "$(cat "$TEST_MOUNT_POINT/third")" = third
+    subtest "Changing original file" sh -c "printf 'changed third\n' > '$WATCHED/third'"
+    subtest "Cached attributes are invalidated" sh -c "sleep 0.2; test \"\$(cat '$TEST_MOUNT_POINT/third')\" = 'changed third'"
+fi
+
+SOCKET="$TEST_TMP/watch.socket"
+mkdir -p "$WATCHED/added"
+printf "added\n" > "$WATCHED/added/file"
+run_test "--watch mount with --control" test_mount --watch --control="$SOCKET" -f "$WATCHED/third"
+subtest "Adding a file from another directory" sh -c "printf 'add\t$WATCHED/added/file\n' | '$BIN' --apply='$SOCKET'"
+subtest "Deleting original of the added file" sh -c "sleep 0.2; rm '$WATCHED/added/file'"
+subtest "Added file disappears" sh -c "sleep 0.2; test ! -e '$TEST_MOUNT_POINT/file'"
+
+run_test "Negative --cache-timeout is rejected" ! test_mount --cache-timeout=-1 -f "$WATCHED/third"
+
+cleanup
+rm -rf "$WATCHED"
@@ -29,3 +29,8 @@ subtest "--file after --symlink wins" compare_file_info "$TEST_MOUNT_POINT/fstab
 subtest "--symlink after --file wins" test "$(readlink "$TEST_MOUNT_POINT/test.playlist")" = "../test.playlist"
 subtest "Non-overriden file exists" compare_file_info "$TEST_MOUNT_POINT/fstab.playlist" "$(fixture fstab.playlist)"
 subtest "Non-overriden symlink exists" test "$(readlink "$TEST_MOUNT_POINT/tmp")" = "../../tmp"
+
+mkdir -p "$TEST_TMP/gone"
+printf "fstab\ngone/fstab\n" > "$TEST_TMP/fallback.playlist"
+run_test "Mounting with a missing overriding file" test_mount "$TEST_TMP/fallback.playlist"
+subtest "Earlier file is used instead of the missing one" compare_file_info "$TEST_MOUNT_POINT/fstab" "$TEST_TMP/fstab"
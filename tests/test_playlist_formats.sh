@@ -0,0 +1,46 @@
+#!/bin/sh
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+mkdir -p "$TEST_TMP/formats"
+cp "$(fixture fstab)" "$TEST_TMP/formats/my fstab"
+
+printf '#EXTM3U\r\n#EXTINF:10,Artist - Title\r\nmy fstab\r\nhttp://example.com/stream\r\nfile:///etc/hosts\r\n' > "$TEST_TMP/formats/list.m3u8"
+run_test "Mounting an extended M3U playlist" test_mount "$TEST_TMP/formats/list.m3u8"
+subtest "Relative path is present" compare_file_info "$TEST_MOUNT_POINT/my fstab" "$TEST_TMP/formats/my fstab"
+subtest "File URI is present" compare_file_info "$TEST_MOUNT_POINT/hosts" "/etc/hosts"
+subtest "Comments and remote locations are ignored" test "$(ls "$TEST_MOUNT_POINT" | wc -l)" = 2
+
+printf '[playlist]\nFile1=my fstab\nTitle1=Fstab\nFile2=file:///etc/hosts\nNumberOfEntries=2\nVersion=2\n' > "$TEST_TMP/formats/list.pls"
+run_test "Mounting a PLS playlist" test_mount "$TEST_TMP/formats/list.pls"
+subtest "Relative path is present" compare_file_info "$TEST_MOUNT_POINT/my fstab" "$TEST_TMP/formats/my fstab"
+subtest "File URI is present" compare_file_info "$TEST_MOUNT_POINT/hosts" "/etc/hosts"
+subtest "Only files are added" test "$(ls "$TEST_MOUNT_POINT" | wc -l)" = 2
+
+cat > "$TEST_TMP/formats/list.xspf" <<'XSPF'
+<?xml version="1.0" encoding="UTF-8"?>
+<playlist version="1" xmlns="http://xspf.org/ns/0/">
+  <location>http://example.com/list.xspf</location>
+  <trackList>
+    <track><title>Fstab</title><location>my%20fstab</location><location>other</location></track>
+    <track><location>file:///etc/hosts</location></track>
+    <track><location>https://example.com/remote.mp3</location></track>
+  </trackList>
+</playlist>
+XSPF
+run_test "Mounting an XSPF playlist" test_mount "$TEST_TMP/formats/list.xspf"
+subtest "Escaped relative location is present" compare_file_info "$TEST_MOUNT_POINT/my fstab" "$TEST_TMP/formats/my fstab"
+subtest "File URI is present" compare_file_info "$TEST_MOUNT_POINT/hosts" "/etc/hosts"
+subtest "Alternative and remote locations are ignored" test "$(ls "$TEST_MOUNT_POINT" | wc -l)" = 2
+
+cp "$TEST_TMP/formats/list.pls" "$TEST_TMP/formats/list"
+run_test "Mounting a playlist without an extension" test_mount "$TEST_TMP/formats/list"
+subtest "Format is detected by content" compare_file_info "$TEST_MOUNT_POINT/my fstab" "$TEST_TMP/formats/my fstab"
+
+printf '<?xml version="1.0"?>\n<playlist><trackList><track><location>my%%20fstab</location></track>\n<track><location>' > "$TEST_TMP/formats/broken.xspf"
+run_test "Mounting a truncated XSPF playlist" test_mount "$TEST_TMP/formats/broken.xspf"
+subtest "Tracks before the error are present" test -f "$TEST_MOUNT_POINT/my fstab"
+
+cleanup
+rm -rf "$TEST_TMP/formats"
@@ -0,0 +1,19 @@
+#!/bin/sh
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+# Probes are only there when built with SDT=1.
+if readelf --notes "$BIN" 2>/dev/null | grep -q "Provider: playlistfs"; then
+    PROBES_SKIP=
+else
+    PROBES_SKIP=skip
+fi
+
+probe_exists() {
+    readelf --notes "$BIN" | grep -q "Name: $1\$"
+}
+
+$PROBES_SKIP run_test "Operations have entry probes" probe_exists read_entry
+$PROBES_SKIP subtest "Operations have return probes" probe_exists rename_return
+$PROBES_SKIP subtest "Startup phases have probes" probe_exists phase_end
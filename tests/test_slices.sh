@@ -0,0 +1,37 @@
+#!/bin/sh
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+printf "0123456789abcdef" > "$TEST_TMP/image.bin"
+printf "not a slice" > "$TEST_TMP/name#with,separator"
+printf "literal" > "$TEST_TMP/x#1,2"
+printf "x" > "$TEST_TMP/x"
+cat > "$TEST_TMP/slices.playlist" <<LIST
+image.bin#2,5
+image.bin#10,6
+image.bin#16,0
+image.bin#12,10
+name#with,separator
+x#1,2
+LIST
+
+run_test "Mounting a list with slices" test_mount "$TEST_TMP/slices.playlist"
+subtest "Slice has its own size" test "$(stat -c %s "$TEST_MOUNT_POINT/image.bin#2,5")" = 5
+subtest "Slice contains its part of the file" test "$(cat "$TEST_MOUNT_POINT/image.bin#2,5")" = "23456"
+subtest "Slice at the end of the file" test "$(cat "$TEST_MOUNT_POINT/image.bin#10,6")" = "abcdef"
+subtest "Reads inside a slice are offset" \
+    test "$(dd if="$TEST_MOUNT_POINT/image.bin#10,6" bs=1 skip=2 count=10 2>/dev/null)" = "cdef"
+subtest "Empty slice at the end is allowed" test -f "$TEST_MOUNT_POINT/image.bin#16,0" -a ! -s "$TEST_MOUNT_POINT/image.bin#16,0"
+subtest "Slice past the end is skipped" test ! -e "$TEST_MOUNT_POINT/image.bin#12,10"
+subtest "Slice is read-only" ! sh -c "echo data >> '$TEST_MOUNT_POINT/image.bin#2,5'"
+subtest "Times of a slice can not be changed" ! touch -d 2001-01-01 "$TEST_MOUNT_POINT/image.bin#2,5"
+subtest "Times of the original file are kept" test "$(stat -c %Y "$TEST_TMP/image.bin")" != "$(date -d 2001-01-01 +%s)"
+subtest "Names merely containing the separator are not slices" \
+    test "$(cat "$TEST_MOUNT_POINT/name#with,separator")" = "not a slice"
+subtest "Existing files named like slices are not slices" test "$(cat "$TEST_MOUNT_POINT/x#1,2")" = "literal"
+subtest "Copying a slice copies only its part" \
+    sh -c "cp '$TEST_MOUNT_POINT/image.bin#2,5' '$TEST_TMP/copy' && test \"\$(cat '$TEST_TMP/copy')\" = 23456"
+
+run_test "Mounting slices with --symlinks" test_mount --symlinks -f "$TEST_TMP/image.bin#2,5"
+subtest "Slice is still a regular file" test -f "$TEST_MOUNT_POINT/image.bin#2,5" -a ! -L "$TEST_MOUNT_POINT/image.bin#2,5"
@@ -0,0 +1,46 @@
+#!/bin/sh
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+# Original files are on simulated slow storage, see utils/src/slow_backend.c.
+export SLOW_BACKEND_DIR="$TEST_TMP/slow"
+export SLOW_BACKEND_LOG="$TEST_TMP/slow.log"
+mkdir -p "$SLOW_BACKEND_DIR"
+rm -f "$SLOW_BACKEND_LOG"
+printf "#define SLOW 1\n" > "$SLOW_BACKEND_DIR/small.h"
+head -c 200000 /dev/urandom > "$SLOW_BACKEND_DIR/big"
+
+# Print how many times a call reached the slow storage.
+count_calls() {
+    grep -c "^$1" "$SLOW_BACKEND_LOG"
+}
+
+# Print how long a command takes, in milliseconds.
+time_ms() {
+    local start="$(date +%s%N)"
+    "$@" > /dev/null
+    echo $(( ($(date +%s%N) - start) / 1000000 ))
+}
+
+run_test "Mount over slow storage" test_mount -f "$SLOW_BACKEND_DIR/small.h" -f "$SLOW_BACKEND_DIR/big"
+subtest "Files are read correctly" cmp "$TEST_MOUNT_POINT/big" "$SLOW_BACKEND_DIR/big"
+subtest "Original files were checked on slow storage" test "$(count_calls "stat .*big$")" -ge 1
+subtest "Original files were read from slow storage" test "$(count_calls "read ")" -ge 1
+
+export SLOW_BACKEND_OPEN_LATENCY=300000
+run_test "Mount with slow opening" test_mount -f "$SLOW_BACKEND_DIR/small.h"
+subtest "Opening takes at least the latency" test "$(time_ms cat "$TEST_MOUNT_POINT/small.h")" -ge 300
+unset SLOW_BACKEND_OPEN_LATENCY
+
+export SLOW_BACKEND_BANDWIDTH=1000
+run_test "Mount with limited bandwidth" test_mount -f "$SLOW_BACKEND_DIR/big"
+subtest "Reading takes at least the transfer time" test "$(time_ms cat "$TEST_MOUNT_POINT/big")" -ge 195
+unset SLOW_BACKEND_BANDWIDTH
+
+run_test "--memory-cache mount over slow storage" test_mount --memory-cache 1 -f "$SLOW_BACKEND_DIR/small.h"
+subtest "Small file is read correctly" cmp "$TEST_MOUNT_POINT/small.h" "$SLOW_BACKEND_DIR/small.h"
+opened="$(count_calls "open .*small.h$")"
+subtest "Small file is read correctly again" cmp "$TEST_MOUNT_POINT/small.h" "$SLOW_BACKEND_DIR/small.h"
+subtest "Cached file is not opened again" test "$(count_calls "open .*small.h$")" -eq "$opened"
+cleanup
@@ -0,0 +1,32 @@
+#!/bin/sh
+# Run mutations and reads from many threads at once. Most useful with a SANITIZER build,
+# as the filesystem's own sanitizer reports are checked after unmounting.
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+STRESS="$TEST_ROOT/utils/stress"
+SECONDS_PER_RUN=${STRESS_SECONDS:-1}
+
+sanitizer_reports() {
+    grep -l -e "ERROR: AddressSanitizer" -e "WARNING: ThreadSanitizer" "$PFS_SANITIZER_LOG".* 2>/dev/null
+}
+
+if [ -n "$PFS_SANITIZER_LOG" ]; then
+    SANITIZER_SKIP=
+    rm -f "$PFS_SANITIZER_LOG".*
+else
+    SANITIZER_SKIP=skip
+fi
+
+printf "original\n" > "$TEST_TMP/stress"
+
+test_mount --file "$TEST_TMP/stress"
+run_test "Concurrent operations cause no unexpected errors" "$STRESS" "$TEST_MOUNT_POINT" stress $SECONDS_PER_RUN 1 4 16
+subtest "Only the original file remains" test "$(ls "$TEST_MOUNT_POINT")" = stress
+subtest "File is still readable" test "$(cat "$TEST_MOUNT_POINT/stress")" = original
+
+cleanup
+$SANITIZER_SKIP run_test "Filesystem produced no sanitizer reports" test -z "$(sanitizer_reports)"
+
+rm -f "$TEST_TMP/stress"
@@ -0,0 +1,29 @@
+#!/bin/sh
+
+TEST_ROOT="$(dirname "$(realpath "$0")")"
+. "$TEST_ROOT/setup.sh"
+
+printf "data\n" > "$TEST_TMP/xattrs"
+# Extended attributes need support from the filesystem of temporary directory.
+if setfattr -n user.original -v value "$TEST_TMP/xattrs" 2>/dev/null; then
+    XATTRS_SKIP=
+else
+    XATTRS_SKIP=skip
+fi
+
+test_mount -f "$TEST_TMP/xattrs"
+$XATTRS_SKIP run_test "Reading an attribute" test "$(getfattr --only-values -n user.original "$TEST_MOUNT_POINT/xattrs")" = value
+$XATTRS_SKIP subtest "Listing attributes" sh -c "getfattr -d '$TEST_MOUNT_POINT/xattrs' | grep -q '^user.original='"
+$XATTRS_SKIP subtest "Missing attribute is not found" ! getfattr -n user.missing "$TEST_MOUNT_POINT/xattrs"
+$XATTRS_SKIP subtest "Missing attribute is not found again" ! getfattr -n user.missing "$TEST_MOUNT_POINT/xattrs"
+$XATTRS_SKIP subtest "Setting a missing attribute" setfattr -n user.missing -v new "$TEST_MOUNT_POINT/xattrs"
+$XATTRS_SKIP subtest "Attribute is found after setting" test "$(getfattr --only-values -n user.missing "$TEST_MOUNT_POINT/xattrs")" = new
+$XATTRS_SKIP subtest "Attribute reaches original file" test "$(getfattr --only-values -n user.missing "$TEST_TMP/xattrs")" = new
+$XATTRS_SKIP subtest "Removing an attribute" setfattr -x user.missing "$TEST_MOUNT_POINT/xattrs"
+$XATTRS_SKIP subtest "Attribute is removed from original file" ! getfattr -n user.missing "$TEST_TMP/xattrs"
+$XATTRS_SKIP subtest "Writing to a file" sh -c "printf 'more\n' >> '$TEST_MOUNT_POINT/xattrs'"
+
+test_mount --symlinks -f "$TEST_TMP/xattrs"
+$XATTRS_SKIP run_test "Symlinks have no attributes" ! getfattr -h -n user.original "$TEST_MOUNT_POINT/xattrs"
+
+rm -f "$TEST_TMP/xattrs"
@@ -0,0 +1,338 @@
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+// Simulate slow storage (a network share, a USB disk) under one directory, deterministically.
+// Preloaded into a process with LD_PRELOAD, it delays stat, open and read calls on files
+// under SLOW_BACKEND_DIR, and limits bandwidth of reads, shared by all threads like a real link.
+// Absolute paths are matched, which is how playlistfs refers to original files,
+// and paths relative to directories opened under SLOW_BACKEND_DIR.
+// Memory mappings of slow files are not slowed down.
+//
+// Variables (latencies in microseconds, 0 if not set):
+//   SLOW_BACKEND_DIR            Absolute path of the slow directory; nothing is slowed down if not set
+//   SLOW_BACKEND_LATENCY        Default latency of every call
+//   SLOW_BACKEND_STAT_LATENCY   Latency of stat, lstat, fstatat and statx
+//   SLOW_BACKEND_OPEN_LATENCY   Latency of open and openat
+//   SLOW_BACKEND_READ_LATENCY   Latency of read, pread and copy_file_range from slow files
+//   SLOW_BACKEND_BANDWIDTH      Bandwidth of reads in KiB/s, unlimited if not set
+//   SLOW_BACKEND_LOG            File to append a line to for every slowed down call,
+//                               like "open /path", "stat /path" or "read 131072",
+//                               to count calls reaching the slow storage
+
+#define MAX_FDS 65536
+
+static const char* slow_dir;
+static size_t slow_dir_length;
+static long stat_latency;
+static long open_latency;
+static long read_latency;
+static long bandwidth; // Bytes per second
+static int log_fd = -1;
+
+static unsigned char slow_fds[MAX_FDS]; // Whether a descriptor was opened under slow_dir
+static pthread_mutex_t link_lock = PTHREAD_MUTEX_INITIALIZER;
+static int64_t link_free_at; // When the last read finishes transferring, in nanoseconds
+
+static long latency_from_env (const char* name, long fallback) {
+    const char* value = getenv (name);
+    return value != NULL && *value != '\0' ? strtol (value, NULL, 10) : fallback;
+}
+
+__attribute__((constructor))
+static void slow_backend_init (void) {
+    const char* dir = getenv ("SLOW_BACKEND_DIR");
+    if (dir == NULL || dir[0] != '/') {
+        return;
+    }
+    slow_dir_length = strlen (dir);
+    while (slow_dir_length > 1 && dir[slow_dir_length - 1] == '/') {
+        slow_dir_length--;
+    }
+    slow_dir = dir;
+
+    long latency = latency_from_env ("SLOW_BACKEND_LATENCY", 0);
+    stat_latency = latency_from_env ("SLOW_BACKEND_STAT_LATENCY", latency);
+    open_latency = latency_from_env ("SLOW_BACKEND_OPEN_LATENCY", latency);
+    read_latency = latency_from_env ("SLOW_BACKEND_READ_LATENCY", latency);
+    bandwidth = latency_from_env ("SLOW_BACKEND_BANDWIDTH", 0) * 1024;
+
+    const char* log = getenv ("SLOW_BACKEND_LOG");
+    if (log != NULL && *log != '\0') {
+        // open() is not slowed down before slow_dir is known, but the log may be in it.
+        int (*real_open) (const char*, int, ...) = dlsym (RTLD_NEXT, "open");
+        log_fd = real_open (log, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    }
+}
+
+static int64_t now (void) {
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void sleep_until (int64_t deadline) {
+    struct timespec ts = { deadline / 1000000000, deadline % 1000000000 };
+    while (clock_nanosleep (CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+static void delay (long microseconds) {
+    if (microseconds > 0) {
+        sleep_until (now () + (int64_t) microseconds * 1000);
+    }
+}
+
+static int is_slow_path (const char* path) {
+    return slow_dir != NULL && path != NULL
+        && strncmp (path, slow_dir, slow_dir_length) == 0
+        && (path[slow_dir_length] == '/' || path[slow_dir_length] == '\0');
+}
+
+static int is_slow_fd (int fd) {
+    return fd >= 0 && fd < MAX_FDS && slow_fds[fd];
+}
+
+static int is_slow_path_at (int dirfd, const char* path) {
+    return path != NULL && path[0] != '/' ? is_slow_fd (dirfd) : is_slow_path (path);
+}
+
+static void log_call (const char* call, const char* path, long long size) {
+    if (log_fd < 0) {
+        return;
+    }
+    char line[4200];
+    int length = path != NULL
+        ? snprintf (line, sizeof (line), "%s %s\n", call, path)
+        : snprintf (line, sizeof (line), "%s %lld\n", call, size);
+    if (length > (int) sizeof (line) - 1) {
+        length = sizeof (line) - 1;
+        line[length - 1] = '\n';
+    }
+    // One write with O_APPEND, so lines of different threads are not mixed.
+    ssize_t written = write (log_fd, line, length);
+    (void) written;
+}
+
+// Slow down a call on a path, relative to dirfd or absolute, before it is made.
+static void slow_path_call (const char* call, int dirfd, const char* path, long latency) {
+    if (is_slow_path_at (dirfd, path)) {
+        log_call (call, path, 0);
+        delay (latency);
+    }
+}
+
+// Slow down a read from a slow descriptor after it is made, by latency and transfer time.
+// Transfers of all threads take turns on one link.
+static void slow_read (ssize_t size) {
+    log_call ("read", NULL, size);
+    delay (read_latency);
+    if (bandwidth <= 0 || size <= 0) {
+        return;
+    }
+    int64_t transfer = (int64_t) size * 1000000000 / bandwidth;
+    pthread_mutex_lock (&link_lock);
+    int64_t start = now ();
+    if (link_free_at > start) {
+        start = link_free_at;
+    }
+    link_free_at = start + transfer;
+    int64_t done = link_free_at;
+    pthread_mutex_unlock (&link_lock);
+    sleep_until (done);
+}
+
+static void track_fd (int fd, int dirfd, const char* path) {
+    if (fd >= 0 && fd < MAX_FDS) {
+        slow_fds[fd] = is_slow_path_at (dirfd, path);
+    }
+}
+
+#define REAL(name, type, ...) \
+    static type (*real) (__VA_ARGS__); \
+    if (real == NULL) \
+        real = (type (*) (__VA_ARGS__)) dlsym (RTLD_NEXT, name)
+
+// --- stat ---
+
+#define WRAP_STAT(name, stat_type) \
+    int name (const char* path, struct stat_type* buf) { \
+        REAL (#name, int, const char*, struct stat_type*); \
+        slow_path_call ("stat", AT_FDCWD, path, stat_latency); \
+        return real (path, buf); \
+    }
+WRAP_STAT (stat, stat)
+WRAP_STAT (lstat, stat)
+WRAP_STAT (stat64, stat64)
+WRAP_STAT (lstat64, stat64)
+
+#define WRAP_FSTATAT(name, stat_type) \
+    int name (int dirfd, const char* path, struct stat_type* buf, int flags) { \
+        REAL (#name, int, int, const char*, struct stat_type*, int); \
+        slow_path_call ("stat", dirfd, path, stat_latency); \
+        return real (dirfd, path, buf, flags); \
+    }
+WRAP_FSTATAT (fstatat, stat)
+WRAP_FSTATAT (fstatat64, stat64)
+
+int statx (int dirfd, const char* path, int flags, unsigned int mask, struct statx* buf) {
+    REAL ("statx", int, int, const char*, int, unsigned int, struct statx*);
+    slow_path_call ("stat", dirfd, path, stat_latency);
+    return real (dirfd, path, flags, mask, buf);
+}
+
+// Before glibc 2.33, stat functions are inline wrappers of these.
+#define WRAP_XSTAT(name, stat_type) \
+    int name (int version, const char* path, struct stat_type* buf) { \
+        REAL (#name, int, int, const char*, struct stat_type*); \
+        slow_path_call ("stat", AT_FDCWD, path, stat_latency); \
+        return real (version, path, buf); \
+    }
+WRAP_XSTAT (__xstat, stat)
+WRAP_XSTAT (__lxstat, stat)
+WRAP_XSTAT (__xstat64, stat64)
+WRAP_XSTAT (__lxstat64, stat64)
+
+#define WRAP_FXSTATAT(name, stat_type) \
+    int name (int version, int dirfd, const char* path, struct stat_type* buf, int flags) { \
+        REAL (#name, int, int, int, const char*, struct stat_type*, int); \
+        slow_path_call ("stat", dirfd, path, stat_latency); \
+        return real (version, dirfd, path, buf, flags); \
+    }
+WRAP_FXSTATAT (__fxstatat, stat)
+WRAP_FXSTATAT (__fxstatat64, stat64)
+
+// --- open ---
+
+#define WRAP_OPEN(name) \
+    int name (const char* path, int flags, ...) { \
+        REAL (#name, int, const char*, int, ...); \
+        mode_t mode = 0; \
+        if (flags & (O_CREAT | O_TMPFILE)) { \
+            va_list args; \
+            va_start (args, flags); \
+            mode = va_arg (args, mode_t); \
+            va_end (args); \
+        } \
+        slow_path_call ("open", AT_FDCWD, path, open_latency); \
+        int fd = real (path, flags, mode); \
+        track_fd (fd, AT_FDCWD, path); \
+        return fd; \
+    }
+WRAP_OPEN (open)
+WRAP_OPEN (open64)
+
+#define WRAP_OPENAT(name) \
+    int name (int dirfd, const char* path, int flags, ...) { \
+        REAL (#name, int, int, const char*, int, ...); \
+        mode_t mode = 0; \
+        if (flags & (O_CREAT | O_TMPFILE)) { \
+            va_list args; \
+            va_start (args, flags); \
+            mode = va_arg (args, mode_t); \
+            va_end (args); \
+        } \
+        slow_path_call ("open", dirfd, path, open_latency); \
+        int fd = real (dirfd, path, flags, mode); \
+        track_fd (fd, dirfd, path); \
+        return fd; \
+    }
+WRAP_OPENAT (openat)
+WRAP_OPENAT (openat64)
+
+// With _FORTIFY_SOURCE, open calls without a mode are compiled to these.
+#define WRAP_OPEN_2(name) \
+    int name (const char* path, int flags) { \
+        REAL (#name, int, const char*, int); \
+        slow_path_call ("open", AT_FDCWD, path, open_latency); \
+        int fd = real (path, flags); \
+        track_fd (fd, AT_FDCWD, path); \
+        return fd; \
+    }
+WRAP_OPEN_2 (__open_2)
+WRAP_OPEN_2 (__open64_2)
+
+#define WRAP_OPENAT_2(name) \
+    int name (int dirfd, const char* path, int flags) { \
+        REAL (#name, int, int, const char*, int); \
+        slow_path_call ("open", dirfd, path, open_latency); \
+        int fd = real (dirfd, path, flags); \
+        track_fd (fd, dirfd, path); \
+        return fd; \
+    }
+WRAP_OPENAT_2 (__openat_2)
+WRAP_OPENAT_2 (__openat64_2)
+
+int close (int fd) {
+    REAL ("close", int, int);
+    if (fd >= 0 && fd < MAX_FDS) {
+        slow_fds[fd] = 0;
+    }
+    return real (fd);
+}
+
+// --- read ---
+
+ssize_t read (int fd, void* buf, size_t count) {
+    REAL ("read", ssize_t, int, void*, size_t);
+    ssize_t result = real (fd, buf, count);
+    if (is_slow_fd (fd)) {
+        slow_read (result);
+    }
+    return result;
+}
+
+#define WRAP_PREAD(name, off_type) \
+    ssize_t name (int fd, void* buf, size_t count, off_type offset) { \
+        REAL (#name, ssize_t, int, void*, size_t, off_type); \
+        ssize_t result = real (fd, buf, count, offset); \
+        if (is_slow_fd (fd)) { \
+            slow_read (result); \
+        } \
+        return result; \
+    }
+WRAP_PREAD (pread, off_t)
+WRAP_PREAD (pread64, off64_t)
+
+// With _FORTIFY_SOURCE, reads into buffers of known size are compiled to these.
+ssize_t __read_chk (int fd, void* buf, size_t count, size_t buflen) {
+    REAL ("__read_chk", ssize_t, int, void*, size_t, size_t);
+    ssize_t result = real (fd, buf, count, buflen);
+    if (is_slow_fd (fd)) {
+        slow_read (result);
+    }
+    return result;
+}
+
+#define WRAP_PREAD_CHK(name, off_type) \
+    ssize_t name (int fd, void* buf, size_t count, off_type offset, size_t buflen) { \
+        REAL (#name, ssize_t, int, void*, size_t, off_type, size_t); \
+        ssize_t result = real (fd, buf, count, offset, buflen); \
+        if (is_slow_fd (fd)) { \
+            slow_read (result); \
+        } \
+        return result; \
+    }
+WRAP_PREAD_CHK (__pread_chk, off_t)
+WRAP_PREAD_CHK (__pread64_chk, off64_t)
+
+ssize_t copy_file_range (int fd_in, off64_t* off_in, int fd_out, off64_t* off_out, size_t len, unsigned int flags) {
+    REAL ("copy_file_range", ssize_t, int, off64_t*, int, off64_t*, size_t, unsigned int);
+    ssize_t result = real (fd_in, off_in, fd_out, off_out, len, flags);
+    if (is_slow_fd (fd_in)) {
+        slow_read (result);
+    }
+    return result;
+}
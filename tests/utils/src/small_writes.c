@@ -0,0 +1,46 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Write COUNT chunks of SIZE bytes to an existing FILE one by one, then fsync it.
+// Prints throughput, to compare mount options affecting the write path.
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        fprintf (stderr, "usage: %s FILE SIZE COUNT\n", argv[0]);
+        return 1;
+    }
+    size_t size = strtoul (argv[2], NULL, 10);
+    long count = strtol (argv[3], NULL, 10);
+    if (size == 0 || count <= 0) {
+        return 1;
+    }
+
+    char* buffer = malloc (size);
+    memset (buffer, 'x', size);
+    int fd = open (argv[1], O_WRONLY | O_TRUNC);
+    if (fd < 0) {
+        return errno;
+    }
+
+    struct timespec start, end;
+    clock_gettime (CLOCK_MONOTONIC, &start);
+    for (long i = 0; i < count; i++) {
+        if (write (fd, buffer, size) != (ssize_t) size) {
+            return errno;
+        }
+    }
+    if (fsync (fd) < 0 || close (fd) < 0) {
+        return errno;
+    }
+    clock_gettime (CLOCK_MONOTONIC, &end);
+    free (buffer);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    fprintf (stdout, "%ld writes of %zu bytes: %.3f s, %.0f writes/s, %.2f MiB/s\n",
+        count, size, seconds, count / seconds, count * size / seconds / (1024 * 1024));
+    return 0;
+}
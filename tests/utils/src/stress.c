@@ -0,0 +1,204 @@
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Run rename, RENAME_EXCHANGE, link, unlink, symlink, stat, readdir and read from many threads
+// against names in DIR for SECONDS, once for each thread count. FILE is an existing file in DIR,
+// which is linked to and read, but never changed. Prints ops/s for each thread count.
+// Errors which can result from racing with other threads (ENOENT, EEXIST) are expected,
+// anything else is reported and makes the exit status non-zero.
+
+#define SHARED_NAMES 4
+#define OWN_NAMES 3
+#define MAX_REPORTED_ERRORS 10
+
+enum { OP_LINK, OP_RENAME, OP_EXCHANGE, OP_UNLINK, OP_SYMLINK, OP_STAT, OP_READDIR, OP_READ, OP_COUNT };
+static const char* op_names[OP_COUNT] = {
+    "link", "rename", "rename RENAME_EXCHANGE", "unlink", "symlink", "stat", "readdir", "read"
+};
+
+static const char* dir;
+static const char* file;
+static char file_path[4096];
+static atomic_int stop;
+static atomic_long errors;
+
+typedef struct {
+    int index;
+    unsigned int seed;
+    long ops;
+} worker;
+
+static void name_for (char* buffer, size_t size, worker* self, int index) {
+    if (index < SHARED_NAMES) {
+        snprintf (buffer, size, "%s/stress.shared.%d", dir, index);
+    }
+    else {
+        snprintf (buffer, size, "%s/stress.%d.%d", dir, self->index, index - SHARED_NAMES);
+    }
+}
+
+static void random_name (char* buffer, size_t size, worker* self) {
+    name_for (buffer, size, self, rand_r (&self->seed) % (SHARED_NAMES + OWN_NAMES));
+}
+
+static void check (int op, int result, int expected_errno) {
+    if (result >= 0 || errno == ENOENT || errno == EEXIST || errno == expected_errno) {
+        return;
+    }
+    if (atomic_fetch_add (&errors, 1) < MAX_REPORTED_ERRORS) {
+        fprintf (stderr, "%s: %s\n", op_names[op], strerror (errno));
+    }
+}
+
+static int read_file (void) {
+    char buffer[4096];
+    int fd = open (file_path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t result = pread (fd, buffer, sizeof (buffer), 0);
+    int saved_errno = errno;
+    close (fd);
+    errno = saved_errno;
+    return result < 0 ? -1 : 0;
+}
+
+static int read_dir (void) {
+    DIR* stream = opendir (dir);
+    if (stream == NULL) {
+        return -1;
+    }
+    errno = 0;
+    while (readdir (stream) != NULL);
+    int saved_errno = errno;
+    closedir (stream);
+    errno = saved_errno;
+    return errno == 0 ? 0 : -1;
+}
+
+static void* work (void* arg) {
+    worker* self = arg;
+    char name[4096], other[4096];
+    struct stat st;
+    while (!atomic_load_explicit (&stop, memory_order_relaxed)) {
+        int op = rand_r (&self->seed) % OP_COUNT;
+        random_name (name, sizeof (name), self);
+        random_name (other, sizeof (other), self);
+        switch (op) {
+            case OP_LINK:
+                check (op, link (file_path, name), 0);
+                break;
+            case OP_RENAME:
+                check (op, rename (name, other), 0);
+                break;
+            case OP_EXCHANGE:
+                // FUSE 2 does not support rename flags.
+                check (op, renameat2 (AT_FDCWD, name, AT_FDCWD, other, RENAME_EXCHANGE), EINVAL);
+                break;
+            case OP_UNLINK:
+                check (op, unlink (name), 0);
+                break;
+            case OP_SYMLINK:
+                check (op, symlink (file_path, name), 0);
+                break;
+            case OP_STAT:
+                check (op, stat (name, &st), 0);
+                break;
+            case OP_READDIR:
+                check (op, read_dir (), 0);
+                break;
+            case OP_READ:
+                check (op, read_file (), 0);
+                break;
+        }
+        self->ops++;
+    }
+    return NULL;
+}
+
+static void remove_names (int threads) {
+    char name[4096];
+    for (int ithread = 0; ithread < threads; ithread++) {
+        worker self = { .index = ithread };
+        for (int index = 0; index < SHARED_NAMES + OWN_NAMES; index++) {
+            name_for (name, sizeof (name), &self, index);
+            unlink (name);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 5) {
+        fprintf (stderr, "usage: %s DIR FILE SECONDS THREADS...\n", argv[0]);
+        return 1;
+    }
+    dir = argv[1];
+    file = argv[2];
+    snprintf (file_path, sizeof (file_path), "%s/%s", dir, file);
+    double duration = strtod (argv[3], NULL);
+    if (duration <= 0) {
+        return 1;
+    }
+
+    int max_threads = 0;
+    for (int iarg = 4; iarg < argc; iarg++) {
+        int threads = atoi (argv[iarg]);
+        if (threads <= 0) {
+            return 1;
+        }
+        max_threads = threads > max_threads ? threads : max_threads;
+
+        worker* workers = calloc (threads, sizeof (*workers));
+        pthread_t* ids = calloc (threads, sizeof (*ids));
+        atomic_store (&stop, 0);
+        struct timespec start, end;
+        clock_gettime (CLOCK_MONOTONIC, &start);
+        for (int ithread = 0; ithread < threads; ithread++) {
+            workers[ithread] = (worker) { .index = ithread, .seed = ithread + 1 };
+            // Returns the error instead of setting errno.
+            int error = pthread_create (&ids[ithread], NULL, work, &workers[ithread]);
+            if (error != 0) {
+                fprintf (stderr, "pthread_create: %s\n", strerror (error));
+                return 1;
+            }
+        }
+        struct timespec pause = { (time_t) duration, (long) ((duration - (time_t) duration) * 1e9) };
+        while (nanosleep (&pause, &pause) < 0 && errno == EINTR);
+        atomic_store (&stop, 1);
+        long ops = 0;
+        for (int ithread = 0; ithread < threads; ithread++) {
+            pthread_join (ids[ithread], NULL);
+            ops += workers[ithread].ops;
+        }
+        clock_gettime (CLOCK_MONOTONIC, &end);
+        free (ids);
+        free (workers);
+
+        double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        fprintf (stdout, "%3d threads: %ld ops in %.3f s, %.0f ops/s\n", threads, ops, seconds, ops / seconds);
+    }
+    remove_names (max_threads);
+
+    // Whatever happened to other names, the original file must still be there.
+    if (read_file () < 0) {
+        perror (file);
+        return 1;
+    }
+    long total_errors = atomic_load (&errors);
+    if (total_errors > 0) {
+        fprintf (stderr, "%ld unexpected errors\n", total_errors);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,107 @@
+#include "table.h"
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Compare the file table with GHashTable: inserting SIZE names, then looking up
+// every name in random order, and as many names which are not there.
+// Names look like typical playlist entries and are shared by both tables.
+
+static double now (void) {
+    struct timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report (const char* table, const char* what, guint count, double seconds) {
+    fprintf (stdout, "  %-10s %-8s %8.1f ns/op\n", table, what, seconds * 1e9 / count);
+}
+
+static void bench (guint size) {
+    char** names = g_new (char*, size);
+    char** missing = g_new (char*, size);
+    guint* order = g_new (guint, size);
+    for (guint i = 0; i < size; i++) {
+        names[i] = g_strdup_printf ("%08u - Artist Name - Track Title.flac", i);
+        missing[i] = g_strdup_printf ("%08u - Artist Name - Track Title.flac.missing", i);
+        order[i] = i;
+    }
+    // Random order, so that lookups do not follow insertion.
+    GRand* rand = g_rand_new_with_seed (size);
+    for (guint i = size - 1; i > 0; i--) {
+        guint j = g_rand_int_range (rand, 0, i + 1);
+        guint swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+    g_rand_free (rand);
+
+    fprintf (stdout, "%u names:\n", size);
+    guint found = 0;
+    double start;
+
+    GHashTable* hash_table = g_hash_table_new (g_str_hash, g_str_equal);
+    start = now ();
+    for (guint i = 0; i < size; i++) {
+        g_hash_table_insert (hash_table, names[i], names[i]);
+    }
+    report ("GHashTable", "insert", size, now () - start);
+    start = now ();
+    for (guint i = 0; i < size; i++) {
+        found += g_hash_table_lookup (hash_table, names[order[i]]) != NULL;
+    }
+    report ("GHashTable", "hit", size, now () - start);
+    start = now ();
+    for (guint i = 0; i < size; i++) {
+        found += g_hash_table_lookup (hash_table, missing[order[i]]) != NULL;
+    }
+    report ("GHashTable", "miss", size, now () - start);
+    g_hash_table_unref (hash_table);
+
+    pfs_table* table = pfs_table_new (NULL, NULL);
+    start = now ();
+    for (guint i = 0; i < size; i++) {
+        pfs_table_insert (table, names[i], names[i]);
+    }
+    report ("pfs_table", "insert", size, now () - start);
+    start = now ();
+    for (guint i = 0; i < size; i++) {
+        found += pfs_table_lookup (table, names[order[i]]) != NULL;
+    }
+    report ("pfs_table", "hit", size, now () - start);
+    start = now ();
+    for (guint i = 0; i < size; i++) {
+        found += pfs_table_lookup (table, missing[order[i]]) != NULL;
+    }
+    report ("pfs_table", "miss", size, now () - start);
+    pfs_table_free (table);
+
+    if (found != 2 * size) {
+        fprintf (stderr, "found %u names instead of %u\n", found, 2 * size);
+        exit (1);
+    }
+    for (guint i = 0; i < size; i++) {
+        g_free (names[i]);
+        g_free (missing[i]);
+    }
+    g_free (names);
+    g_free (missing);
+    g_free (order);
+}
+
+int main (int argc, char** argv) {
+    if (argc < 2) {
+        fprintf (stderr, "usage: %s SIZE...\n", argv[0]);
+        return 1;
+    }
+    for (int i = 1; i < argc; i++) {
+        guint size = strtoul (argv[i], NULL, 10);
+        if (size == 0) {
+            return 1;
+        }
+        bench (size);
+    }
+    return 0;
+}
@@ -0,0 +1,33 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Append DATA to FILE and set its modification time to SECONDS through the same descriptor,
+// so that the filesystem gets the times with the file handle.
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        return 1;
+    }
+    int fd = open (argv[1], O_WRONLY | O_APPEND);
+    if (fd < 0) {
+        return errno;
+    }
+    size_t length = strlen (argv[2]);
+    if (write (fd, argv[2], length) != (ssize_t) length) {
+        return errno;
+    }
+    struct timespec times[2] = {
+        { .tv_nsec = UTIME_OMIT },
+        { .tv_sec = atol (argv[3]) },
+    };
+    if (futimens (fd, times) < 0) {
+        return errno;
+    }
+    if (close (fd) < 0) {
+        return errno;
+    }
+    return 0;
+}